@@ -0,0 +1,36 @@
+#!/bin/sh
+# Generates the benchmark/PGO training corpus from the scripts in testdata/.
+#
+# usage: gencorpus.sh [OUTDIR] [COUNT]
+#
+# Files are built by repeating the sample scripts, so that sizes range from a
+# few bytes up to close to the largest payload an AppVar can hold.
+
+set -eu
+
+root=$(dirname "$0")/..
+out=${1:-"$root/bench/corpus"}
+count=${2:-200}
+
+mkdir -p "$out"
+
+# the most repetitions whose source still fits in one AppVar (65511 bytes)
+size=$(cat "$root"/testdata/*.py | wc -c)
+max_reps=$((65511 / size))
+
+i=0
+while [ "$i" -lt "$count" ]; do
+    # 1, 2, 4, ... 512 repetitions, cycling, but no more than fit
+    reps=$((1 << (i % 10)))
+    [ "$reps" -le "$max_reps" ] || reps=$max_reps
+    f="$out/script$i.py"
+    : > "$f"
+    r=0
+    while [ "$r" -lt "$reps" ]; do
+        for src in "$root"/testdata/*.py; do
+            cat "$src" >> "$f"
+        done
+        r=$((r + 1))
+    done
+    i=$((i + 1))
+done
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Runs tipyconv over the benchmark corpus in both directions. Used as the
+# training run for `make pgo', and as a quick benchmark by `make bench'.
+#
+# usage: train.sh [TIPYCONV]
+
+set -eu
+
+root=$(dirname "$0")/..
+bin=${1:-"$root/tipyconv"}
+corpus="$root/bench/corpus"
+out="$root/bench/out"
+
+[ -d "$corpus" ] || sh "$root/bench/gencorpus.sh" "$corpus"
+
+rm -rf "$out"
+mkdir -p "$out"
+
+# converts quietly, but says what failed. Sources too large for one AppVar
+# fail without --split, see gencorpus.sh.
+run() {
+    "$bin" -o "$1" "$2" > /dev/null 2>&1 || {
+        echo "train.sh: could not convert $2" >&2
+        exit 1
+    }
+}
+
+for f in "$corpus"/*.py "$root"/testdata/*.py; do
+    name=$(basename "$f" .py)
+    run "$out/$name.8xv" "$f"
+    run "$out/$name.py" "$out/$name.8xv"
+done
+
+for f in "$root"/testdata/*.8xv; do
+    name=$(basename "$f" .8xv)
+    run "$out/$name.rt.py" "$f"
+done
+
+# a pax header with a record that runs past its own end, which is ignored
+"$bin" --tar-in "$root/testdata/badpax.tar" --tar-out "$out/badpax.tar" \
+    > /dev/null 2>&1 || {
+    echo "train.sh: could not convert testdata/badpax.tar" >&2
+    exit 1
+}
@@ -0,0 +1,1017 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv bundle`, which inlines the modules a script imports from its
+ * own directory, so that it ships (and loads) as a single AppVar
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "commands.h"
+#include "hash.h"
+#include "lexer.h"
+#include "minify.h"
+#include "names.h"
+#include "tipyconv.h"
+
+#define BUNDLE_HELP                                                            \
+    "usage: tipyconv bundle [OPTIONS] <main.py>\n"                             \
+    "Inlines the modules that a script imports from its own directory, each "  \
+    "one\n"                                                                    \
+    "once and before its first use, and packs the result into one AppVar.\n"   \
+    "Options:\n"                                                               \
+    "  -o, --outfile FILE:  Output path (default: the variable name, as "      \
+    ".8xv). A .py\n"                                                           \
+    "                       path gets the bundled source instead, - is "       \
+    "stdout\n"                                                                 \
+    "  -N, --varname NAME:  Variable name of the AppVar\n"                     \
+    "  -t, --tree-shake:    Drop top-level functions and classes nothing "     \
+    "refers to\n"                                                              \
+    "  -m, --minify[=names]:\n"                                                \
+    "                       Minify the bundle, like tipyconv --minify\n"       \
+    "  -h, --help:          Show this help screen"
+
+// longest module name that is looked up
+#define MODULE_NAME_SZ 64
+// `import x as y` names of a module, whose `y.` is dropped
+#define MAX_ALIASES 64
+
+typedef enum {
+    MODULE_NEW = 0,
+    // its imports are being bundled
+    MODULE_OPEN,
+    MODULE_DONE,
+    // not next to the main script, left to the calculator
+    MODULE_MISSING,
+} Module_State;
+
+typedef struct {
+    char name[MODULE_NAME_SZ];
+    char* src;
+    usize len;
+    Module_State state;
+} Module;
+
+// a name bound at the top level of a module, to find clashes
+typedef struct {
+    u64 hash;
+    const char* name;
+    usize len;
+    usize module;
+} Global;
+
+typedef struct {
+    u64 hash;
+    const char* name;
+    usize len;
+} Alias;
+
+typedef struct {
+    char* data;
+    usize len;
+    usize cap;
+} Buf;
+
+static struct {
+    char dir[PATH_MAX];
+    Module* modules;
+    usize nmodules;
+    usize modules_cap;
+    Global* globals;
+    usize nglobals;
+    usize globals_cap;
+    Buf out;
+    // an error was reported, bundling stops
+    bool failed;
+} state;
+
+static void buf_add(Buf* b, const char* s, usize len) {
+    if (b->len + len + 1 > b->cap) {
+        b->cap = b->cap ? b->cap : 4096;
+        while (b->len + len + 1 > b->cap)
+            b->cap *= 2;
+        b->data = realloc(b->data, b->cap);
+        check_alloc(b->data);
+    }
+    memcpy(&b->data[b->len], s, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void buf_adds(Buf* b, const char* s) {
+    buf_add(b, s, strlen(s));
+}
+
+static char* read_file(const char* path, usize* len) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+
+    struct stat st;
+    char* data = NULL;
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)) {
+        data = malloc((usize)st.st_size + 1);
+        check_alloc(data);
+        *len = fread(data, 1, (usize)st.st_size, fp);
+        data[*len] = '\0';
+        if (ferror(fp)) {
+            free(data);
+            data = NULL;
+        }
+    } else {
+        errno = EISDIR;
+    }
+    fclose(fp);
+    return data;
+}
+
+static usize line_of(const char* src, usize pos) {
+    usize line = 1;
+    for (usize i = 0; i < pos; i++)
+        line += src[i] == '\n';
+    return line;
+}
+
+static usize add_module(const char* name, usize len) {
+    if (state.nmodules == state.modules_cap) {
+        state.modules_cap = state.modules_cap ? state.modules_cap * 2 : 16;
+        state.modules =
+            realloc(state.modules, state.modules_cap * sizeof(Module));
+        check_alloc(state.modules);
+    }
+    Module* mod = &state.modules[state.nmodules];
+    *mod = (Module){0};
+    memcpy(mod->name, name, len);
+    mod->name[len] = '\0';
+    return state.nmodules++;
+}
+
+// the module `name` next to the main script, loading it the first time.
+// Returns -1 if there is none.
+static isize find_module(const char* name, usize len) {
+    if (len >= MODULE_NAME_SZ)
+        return -1;
+    for (usize i = 0; i < state.nmodules; i++) {
+        const Module* mod = &state.modules[i];
+        if (!strncmp(mod->name, name, len) && mod->name[len] == '\0')
+            return mod->state == MODULE_MISSING ? -1 : (isize)i;
+    }
+
+    usize m = add_module(name, len);
+    Module* mod = &state.modules[m];
+    char path[PATH_MAX + MODULE_NAME_SZ + 4];
+    snprintf(path, sizeof(path), "%s/%s.py", state.dir, mod->name);
+    mod->src = read_file(path, &mod->len);
+    if (!mod->src) {
+        mod->state = MODULE_MISSING;
+        return -1;
+    }
+    info("bundling \"%s\"", path);
+    return (isize)m;
+}
+
+static void add_global(const Lexer* l, Token t, usize module) {
+    if (state.nglobals == state.globals_cap) {
+        state.globals_cap = state.globals_cap ? state.globals_cap * 2 : 256;
+        state.globals =
+            realloc(state.globals, state.globals_cap * sizeof(Global));
+        check_alloc(state.globals);
+    }
+    state.globals[state.nglobals++] = (Global){
+        .hash = tok_hash(l, t),
+        .name = &l->src[t.start],
+        .len = t.len,
+        .module = module,
+    };
+}
+
+static int cmp_globals(const void* a, const void* b) {
+    const Global* ga = a;
+    const Global* gb = b;
+    if (ga->hash != gb->hash)
+        return ga->hash < gb->hash ? -1 : 1;
+    return (ga->module > gb->module) - (ga->module < gb->module);
+}
+
+// checks for names that more than one module binds at its top level: they
+// all share one namespace once bundled, so one module would see the other's.
+// Returns false if there are any.
+static bool check_globals(void) {
+    bool ok = true;
+    qsort(state.globals, state.nglobals, sizeof(Global), cmp_globals);
+    for (usize i = 1; i < state.nglobals; i++) {
+        const Global* a = &state.globals[i - 1];
+        const Global* b = &state.globals[i];
+        if (a->hash == b->hash && a->module != b->module &&
+            a->len == b->len && !memcmp(a->name, b->name, a->len)) {
+            warn("\"%.*s\" is defined in both \"%s\" and \"%s\", which "
+                 "can't be bundled",
+                 (int)a->len, a->name, state.modules[a->module].name,
+                 state.modules[b->module].name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// records the name a top-level statement binds, if it is a plain one
+static void note_global(Lexer lex, Token t, usize module) {
+    if (tok_is(&lex, t, "async"))
+        t = lex_next(&lex);
+    if (tok_is(&lex, t, "def") || tok_is(&lex, t, "class")) {
+        Token name = lex_next(&lex);
+        if (name.kind == TOK_NAME)
+            add_global(&lex, name, module);
+        return;
+    }
+    if (t.kind != TOK_NAME)
+        return;
+    // `x = ...`, but not `x == ...`
+    Token eq = lex_next(&lex);
+    if (tok_is_op(&lex, eq, '=') && !tok_is_op(&lex, lex_next(&lex), '='))
+        add_global(&lex, t, module);
+}
+
+// `if __name__ == "__main__":`, whose block doesn't run in an imported module
+static bool is_main_guard(Lexer lex, Token t) {
+    if (!tok_is(&lex, t, "if") || !tok_is(&lex, lex_next(&lex), "__name__"))
+        return false;
+    if (!tok_is_op(&lex, lex_next(&lex), '=') ||
+        !tok_is_op(&lex, lex_next(&lex), '='))
+        return false;
+    Token s = lex_next(&lex);
+    return s.kind == TOK_STRING &&
+           memmem(&lex.src[s.start], s.len, "__main__", 8) != NULL;
+}
+
+// skips to the end of the logical line. Returns false on a tokenizer error.
+static bool skip_line(Lexer* lex, Token t) {
+    while (t.kind != TOK_NEWLINE && t.kind != TOK_END) {
+        if (t.kind == TOK_ERROR)
+            return false;
+        t = lex_next(lex);
+    }
+    return true;
+}
+
+// reads a dotted name. Returns false if there is none at `t`.
+static bool dotted_name(Lexer* lex, Token* t, usize* start, usize* end,
+                        bool* dotted) {
+    if (t->kind != TOK_NAME)
+        return false;
+    *start = t->start;
+    *dotted = false;
+    for (;;) {
+        *end = t->start + t->len;
+        *t = lex_next(lex);
+        if (!tok_is_op(lex, *t, '.'))
+            return true;
+        *t = lex_next(lex);
+        if (t->kind != TOK_NAME)
+            return false;
+        *dotted = true;
+    }
+}
+
+static bool bundle_module(usize m);
+
+// bundles a module for an import in `m`. Returns false on error, and sets
+// `local` if the module was found.
+static bool import_module(usize m, const char* name, usize len, bool* local) {
+    isize dep = find_module(name, len);
+    *local = dep >= 0;
+    if (dep == (isize)m) {
+        warn("\"%s\" imports itself", state.modules[m].name);
+        return false;
+    }
+    return dep < 0 || bundle_module((usize)dep);
+}
+
+// the rest of an `import` statement: bundles the local modules, and leaves
+// the others in `kept`
+static bool bundle_import(usize m, Lexer* lex, Token* t, Buf* kept,
+                          Alias* aliases, usize* naliases) {
+    const char* src = lex->src;
+    for (;;) {
+        usize start, end;
+        bool dotted;
+        if (!dotted_name(lex, t, &start, &end, &dotted))
+            return false;
+        // the name the module is bound to, and the end of the whole item
+        usize name_start = start;
+        usize name_end = end;
+        usize item_end = end;
+        if (tok_is(lex, *t, "as")) {
+            *t = lex_next(lex);
+            if (t->kind != TOK_NAME)
+                return false;
+            name_start = t->start;
+            name_end = item_end = t->start + t->len;
+            *t = lex_next(lex);
+        }
+
+        bool local = false;
+        if (!dotted && !import_module(m, &src[start], end - start, &local))
+            return false;
+        if (!local) {
+            buf_adds(kept, kept->len ? ", " : "import ");
+            buf_add(kept, &src[start], item_end - start);
+        } else if (*naliases == MAX_ALIASES) {
+            warn("too many modules imported by \"%s\"", state.modules[m].name);
+            return false;
+        } else {
+            aliases[(*naliases)++] = (Alias){
+                .hash = hash_bytes(&src[name_start], name_end - name_start,
+                                   HASH_SEED),
+                .name = &src[name_start],
+                .len = name_end - name_start,
+            };
+        }
+
+        if (!tok_is_op(lex, *t, ','))
+            return true;
+        *t = lex_next(lex);
+    }
+}
+
+// the rest of a `from` statement. Local modules are bundled, and names they
+// are imported as become assignments in `kept`. `*kept_all` is set if the
+// statement has to stay as it is.
+static bool bundle_from(usize m, Lexer* lex, Token* t, Buf* kept,
+                        Alias* aliases, usize* naliases, bool* keep_all) {
+    const char* src = lex->src;
+    // relative imports are looked up next to the main script as well
+    while (tok_is_op(lex, *t, '.'))
+        *t = lex_next(lex);
+
+    usize start = 0, end = 0;
+    bool dotted = false;
+    bool named = t->kind == TOK_NAME && !tok_is(lex, *t, "import");
+    if (named && !dotted_name(lex, t, &start, &end, &dotted))
+        return false;
+    if (!tok_is(lex, *t, "import"))
+        return false;
+    *t = lex_next(lex);
+
+    bool local = false;
+    if (named && !dotted &&
+        !import_module(m, &src[start], end - start, &local))
+        return false;
+    if (named && !local) {
+        *keep_all = true;
+        return skip_line(lex, *t);
+    }
+
+    bool paren = tok_is_op(lex, *t, '(');
+    if (paren)
+        *t = lex_next(lex);
+    if (tok_is_op(lex, *t, '*')) {
+        *t = lex_next(lex);
+        *keep_all = !named;
+        return true;
+    }
+
+    for (;;) {
+        if (t->kind != TOK_NAME)
+            return false;
+        Token what = *t;
+        Token as = what;
+        *t = lex_next(lex);
+        if (tok_is(lex, *t, "as")) {
+            as = lex_next(lex);
+            if (as.kind != TOK_NAME)
+                return false;
+            *t = lex_next(lex);
+        }
+
+        if (named) {
+            // the name is a global of the bundle now
+            if (as.len != what.len ||
+                memcmp(&src[as.start], &src[what.start], what.len)) {
+                if (kept->len)
+                    buf_adds(kept, ";");
+                buf_add(kept, &src[as.start], as.len);
+                buf_adds(kept, "=");
+                buf_add(kept, &src[what.start], what.len);
+            }
+        } else {
+            // `from . import x`: the names are modules
+            if (!import_module(m, &src[what.start], what.len, &local))
+                return false;
+            if (!local) {
+                *keep_all = true;
+            } else if (*naliases == MAX_ALIASES) {
+                warn("too many modules imported by \"%s\"",
+                     state.modules[m].name);
+                return false;
+            } else {
+                aliases[(*naliases)++] = (Alias){
+                    .hash = tok_hash(lex, as),
+                    .name = &src[as.start],
+                    .len = as.len,
+                };
+            }
+        }
+
+        if (!tok_is_op(lex, *t, ','))
+            break;
+        *t = lex_next(lex);
+        // a trailing comma within the brackets
+        if (paren && tok_is_op(lex, *t, ')'))
+            break;
+    }
+    if (paren) {
+        if (!tok_is_op(lex, *t, ')'))
+            return false;
+        *t = lex_next(lex);
+    }
+    return true;
+}
+
+static const Alias* find_alias(const Alias* aliases, usize naliases,
+                               const Lexer* l, Token t) {
+    u64 hash = tok_hash(l, t);
+    for (usize i = 0; i < naliases; i++) {
+        if (aliases[i].hash == hash && aliases[i].len == t.len &&
+            !memcmp(aliases[i].name, &l->src[t.start], t.len))
+            return &aliases[i];
+    }
+    return NULL;
+}
+
+// copies a logical line, dropping the `x.` of modules that were inlined.
+// Returns false on a tokenizer error, or if an inlined module is used as a
+// value (`getattr(x, ...)`, `y = x`), which no longer exists in the bundle.
+static bool copy_line(usize m, Lexer* lex, usize pos, Token t, Buf* body,
+                      const Alias* aliases, usize naliases) {
+    const char* src = lex->src;
+    const char* name = state.modules[m].name;
+    usize copied = pos;
+    Token prev = {0};
+    for (bool first = true; t.kind != TOK_NEWLINE && t.kind != TOK_END;
+         first = false) {
+        if (t.kind == TOK_ERROR) {
+            warn("could not tokenize \"%s\" at line %zu", name,
+                 line_of(src, t.start));
+            return false;
+        }
+        if (!first && tok_is(lex, t, "import"))
+            warn("the import at line %zu of \"%s\" is not bundled",
+                 line_of(src, t.start), name);
+
+        const Alias* a = NULL;
+        if (t.kind == TOK_NAME && naliases && !tok_is_op(lex, prev, '.'))
+            a = find_alias(aliases, naliases, lex, t);
+        if (a) {
+            Lexer peek = *lex;
+            if (!tok_is_op(&peek, lex_next(&peek), '.')) {
+                warn("module \"%.*s\" is used as a value at line %zu of "
+                     "\"%s\", which can't be bundled",
+                     (int)a->len, a->name, line_of(src, t.start), name);
+                return false;
+            }
+            buf_add(body, &src[copied], t.start - copied);
+            copied = peek.pos;
+        }
+        prev = t;
+        t = lex_next(lex);
+    }
+    buf_add(body, &src[copied], lex->pos - copied);
+    return true;
+}
+
+// appends a module to the bundle, after the modules it imports
+static bool bundle_module(usize m) {
+    switch (state.modules[m].state) {
+        case MODULE_DONE: return true;
+        case MODULE_OPEN: {
+            warn("\"%s\" is imported in a cycle, which can't be bundled",
+                 state.modules[m].name);
+            state.failed = true;
+            return false;
+        } break;
+        default: break;
+    }
+    state.modules[m].state = MODULE_OPEN;
+
+    // the module list may grow (and move) while its imports are bundled
+    const char* src = state.modules[m].src;
+    usize len = state.modules[m].len;
+    Lexer lex = {.src = src, .len = len};
+    Buf body = {0};
+    Alias aliases[MAX_ALIASES];
+    usize naliases = 0;
+    bool skipping = false;
+    bool ok = true;
+
+    usize pos = 0;
+    while (ok && pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            if (!skipping)
+                buf_add(&body, &src[pos], p - pos);
+            pos = p;
+            continue;
+        }
+
+        lex.pos = p;
+        lex.depth = 0;
+        Token t = lex_next(&lex);
+        if (width == 0) {
+            // the main script is the only `__main__`
+            skipping = m != 0 && is_main_guard(lex, t);
+            note_global(lex, t, m);
+        }
+        if (skipping) {
+            ok = skip_line(&lex, t);
+            pos = lex.pos;
+            continue;
+        }
+
+        bool is_import = tok_is(&lex, t, "import");
+        bool is_from = tok_is(&lex, t, "from");
+        if (!is_import && !is_from) {
+            ok = copy_line(m, &lex, pos, t, &body, aliases, naliases);
+            pos = lex.pos;
+            continue;
+        }
+
+        Buf kept = {0};
+        bool keep_all = false;
+        t = lex_next(&lex);
+        if (is_import)
+            ok = bundle_import(m, &lex, &t, &kept, aliases, &naliases);
+        else
+            ok = bundle_from(m, &lex, &t, &kept, aliases, &naliases,
+                             &keep_all);
+        // where the import ends, the rest of the line is copied as it is
+        bool semicolon = ok && tok_is_op(&lex, t, ';');
+        usize stop = t.start;
+        if (ok && !semicolon && t.kind != TOK_NEWLINE && t.kind != TOK_END)
+            ok = false;
+        if (ok)
+            ok = skip_line(&lex, t);
+        if (!ok) {
+            // errors of imported modules were reported already
+            if (!state.failed)
+                warn("could not read the import at line %zu of \"%s\"",
+                     line_of(src, p), state.modules[m].name);
+            free(kept.data);
+            break;
+        }
+
+        if (keep_all) {
+            buf_add(&body, &src[pos], lex.pos - pos);
+        } else {
+            // top-level imports can just go, blocks need a statement
+            buf_add(&body, &src[pos], p - pos);
+            if (kept.len)
+                buf_add(&body, kept.data, kept.len);
+            else if (width > 0 || semicolon)
+                buf_adds(&body, "pass");
+            if (semicolon)
+                buf_add(&body, &src[stop], lex.pos - stop);
+            else if (kept.len || width > 0)
+                buf_adds(&body, "\n");
+        }
+        free(kept.data);
+        pos = lex.pos;
+    }
+
+    if (!ok)
+        state.failed = true;
+    if (ok) {
+        buf_add(&state.out, body.data ? body.data : "", body.len);
+        if (body.len && body.data[body.len - 1] != '\n')
+            buf_adds(&state.out, "\n");
+        state.modules[m].state = MODULE_DONE;
+    }
+    free(body.data);
+    return ok;
+}
+
+
+// === tree shaking ===
+
+// a top-level statement, with the decorators before it
+typedef struct {
+    usize start;
+    usize end;
+    // where the name of the function or class it defines is, 0 if it's none
+    usize name;
+    // that function or class, -1 for other statements
+    isize def;
+} Stmt;
+
+// the name of top-level functions or classes. Every definition of it is kept
+// as long as anything outside of them refers to it.
+typedef struct {
+    u64 hash;
+    const char* name;
+    usize len;
+    usize refs;
+    bool dropped;
+} Def;
+
+typedef struct {
+    Stmt* stmts;
+    usize nstmts;
+    Def* defs;
+    usize ndefs;
+    // open addressing, indices into `defs` plus one
+    usize* table;
+    usize mask;
+    // the definition being scanned, which doesn't keep itself alive
+    isize self;
+} Shaker;
+
+// names that reach globals without spelling them out
+static const char* DYNAMIC_NAMES[] = {
+    "globals", "eval", "exec", "vars", "__import__", "__all__",
+};
+
+static isize shaker_find(const Shaker* sh, const char* name, usize len) {
+    u64 hash = hash_bytes(name, len, HASH_SEED);
+    for (usize i = hash & sh->mask; sh->table[i]; i = (i + 1) & sh->mask) {
+        const Def* d = &sh->defs[sh->table[i] - 1];
+        if (d->hash == hash && d->len == len && !memcmp(d->name, name, len))
+            return (isize)(sh->table[i] - 1);
+    }
+    return -1;
+}
+
+static void shaker_ref(Shaker* sh, const char* name, usize len, int delta) {
+    isize d = shaker_find(sh, name, len);
+    if (d < 0 || d == sh->self)
+        return;
+    if (delta > 0)
+        sh->defs[d].refs++;
+    else if (sh->defs[d].refs > 0)
+        sh->defs[d].refs--;
+}
+
+// adds (or with a negative `delta`, takes away) the references of a
+// statement. Words within strings count as well, they could be used with
+// `getattr`. Returns false if the statement can reach globals without naming
+// them.
+static bool shaker_count(Shaker* sh, const char* src, const Stmt* st,
+                         int delta) {
+    Lexer lex = {.src = src, .len = st->end, .pos = st->start};
+    Token t;
+    while ((t = lex_next(&lex)).kind != TOK_END) {
+        if (t.kind == TOK_ERROR)
+            return false;
+        if (t.kind == TOK_NAME) {
+            for (usize i = 0; i < LENGTH(DYNAMIC_NAMES); i++) {
+                if (tok_is(&lex, t, DYNAMIC_NAMES[i]))
+                    return false;
+            }
+            shaker_ref(sh, &src[t.start], t.len, delta);
+        } else if (t.kind == TOK_STRING) {
+            usize end = t.start + t.len;
+            for (usize i = t.start; i < end; i++) {
+                usize j = i;
+                while (j < end && lex_is_word(src[j]))
+                    j++;
+                if (j > i)
+                    shaker_ref(sh, &src[i], j - i, delta);
+                i = j;
+            }
+        }
+    }
+    return true;
+}
+
+// where the name of the function or class a statement defines is, 0 if it's
+// none
+static usize def_name(Lexer lex, Token t) {
+    // decorators are lines of their own
+    while (tok_is_op(&lex, t, '@')) {
+        if (!skip_line(&lex, t))
+            return 0;
+        usize width;
+        lex.pos = lex_indent(lex.src, lex.len, lex.pos, &width);
+        while (lex_skip_blank(lex.src, lex.len, &lex.pos))
+            lex.pos = lex_indent(lex.src, lex.len, lex.pos, &width);
+        t = lex_next(&lex);
+    }
+    if (tok_is(&lex, t, "async"))
+        t = lex_next(&lex);
+    if (!tok_is(&lex, t, "def") && !tok_is(&lex, t, "class"))
+        return 0;
+    Token name = lex_next(&lex);
+    return name.kind == TOK_NAME ? name.start : 0;
+}
+
+// splits the bundle into its top-level statements
+static bool shaker_split(Shaker* sh, const char* src, usize len) {
+    usize cap = 0;
+    Lexer lex = {.src = src, .len = len};
+    bool decorated = false;
+    usize pos = 0;
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            pos = p;
+            continue;
+        }
+
+        lex.pos = p;
+        lex.depth = 0;
+        Token t = lex_next(&lex);
+        if (width == 0 && !decorated && !tok_continues_stmt(&lex, t)) {
+            if (sh->nstmts == cap) {
+                cap = cap ? cap * 2 : 256;
+                sh->stmts = realloc(sh->stmts, cap * sizeof(Stmt));
+                check_alloc(sh->stmts);
+            }
+            if (sh->nstmts)
+                sh->stmts[sh->nstmts - 1].end = pos;
+            sh->stmts[sh->nstmts++] = (Stmt){
+                .start = pos,
+                .name = def_name(lex, t),
+                .def = -1,
+            };
+        }
+        if (width == 0)
+            decorated = tok_is_op(&lex, t, '@');
+        if (!skip_line(&lex, t))
+            return false;
+        pos = lex.pos;
+    }
+    if (sh->nstmts)
+        sh->stmts[sh->nstmts - 1].end = len;
+    return true;
+}
+
+// gathers the definitions of the statements, by name
+static void shaker_add_defs(Shaker* sh, const char* src) {
+    usize cap = 16;
+    while (cap < sh->nstmts * 2)
+        cap *= 2;
+    sh->table = calloc(cap, sizeof(usize));
+    check_alloc(sh->table);
+    sh->mask = cap - 1;
+    sh->defs = calloc(sh->nstmts + 1, sizeof(Def));
+    check_alloc(sh->defs);
+
+    for (usize i = 0; i < sh->nstmts; i++) {
+        Stmt* st = &sh->stmts[i];
+        if (!st->name)
+            continue;
+        const char* name = &src[st->name];
+        usize len = 0;
+        while (lex_is_word(name[len]))
+            len++;
+
+        isize d = shaker_find(sh, name, len);
+        if (d < 0) {
+            d = (isize)sh->ndefs++;
+            u64 hash = hash_bytes(name, len, HASH_SEED);
+            sh->defs[d] = (Def){.hash = hash, .name = name, .len = len};
+            usize j = hash & sh->mask;
+            while (sh->table[j])
+                j = (j + 1) & sh->mask;
+            sh->table[j] = (usize)d + 1;
+        }
+        st->def = d;
+    }
+}
+
+// drops the top-level functions and classes that nothing else refers to,
+// until every one that is left is. Returns the number of bytes dropped.
+static usize tree_shake(Buf* b, usize* ndropped) {
+    Shaker sh = {0};
+    usize saved = 0;
+    *ndropped = 0;
+    if (!shaker_split(&sh, b->data, b->len)) {
+        free(sh.stmts);
+        return 0;
+    }
+    shaker_add_defs(&sh, b->data);
+
+    bool ok = true;
+    for (usize i = 0; ok && i < sh.nstmts; i++) {
+        sh.self = sh.stmts[i].def;
+        ok = shaker_count(&sh, b->data, &sh.stmts[i], 1);
+    }
+    if (!ok)
+        warn("not tree shaking: the bundle uses its globals without naming "
+             "them (globals(), eval and the like)");
+
+    for (bool changed = ok; changed;) {
+        changed = false;
+        for (usize i = 0; i < sh.ndefs; i++) {
+            Def* d = &sh.defs[i];
+            if (d->dropped || d->refs > 0)
+                continue;
+            info("dropping unused \"%.*s\"", (int)d->len, d->name);
+            d->dropped = true;
+            (*ndropped)++;
+            changed = true;
+            sh.self = (isize)i;
+            for (usize j = 0; j < sh.nstmts; j++) {
+                if (sh.stmts[j].def == (isize)i)
+                    shaker_count(&sh, b->data, &sh.stmts[j], -1);
+            }
+        }
+    }
+
+    if (*ndropped) {
+        // comments before the first statement stay where they are
+        usize len = sh.nstmts ? sh.stmts[0].start : b->len;
+        for (usize i = 0; i < sh.nstmts; i++) {
+            const Stmt* st = &sh.stmts[i];
+            usize n = st->end - st->start;
+            if (st->def >= 0 && sh.defs[st->def].dropped) {
+                saved += n;
+                continue;
+            }
+            memmove(&b->data[len], &b->data[st->start], n);
+            len += n;
+        }
+        b->len = len;
+        b->data[len] = '\0';
+    }
+
+    free(sh.stmts);
+    free(sh.defs);
+    free(sh.table);
+    return saved;
+}
+
+// writes the bundle out, as an AppVar unless `path` is a Python file
+static bool write_bundle(const char* path, const char* var_name) {
+    usize path_len = path ? strlen(path) : 0;
+    bool as_source = path_len > 3 && !strcasecmp(&path[path_len - 3], ".py");
+    const char* data = state.out.data;
+    usize len = state.out.len;
+    char* appvar = NULL;
+    if (!as_source) {
+        if (len > TI_MAX_SRC_SZ) {
+            warn("the bundle is too large for an AppVar (%zu bytes, at most "
+                 "%d). Write it to a .py file, and convert that with --split",
+                 len, TI_MAX_SRC_SZ);
+            return false;
+        }
+        Ti_PyFile f = ti_pyfile_new_with_metadata_full(data, (u16)len, NULL, 0,
+                                                       NULL, var_name);
+        len = ti_pyfile_dump(&f, &appvar);
+        data = appvar;
+        ti_pyfile_free(&f);
+    }
+
+    char default_path[VAR_NAME_SZ + 5];
+    if (!path) {
+        snprintf(default_path, sizeof(default_path), "%s.8xv", var_name);
+        path = default_path;
+    }
+
+    FILE* fp = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+    if (!fp) {
+        warn("could not open \"%s\" for writing: %s", path, strerror(errno));
+        free(appvar);
+        return false;
+    }
+    bool ok = fwrite(data, 1, len, fp) == len;
+    if (fp == stdout ? fflush(fp) != 0 : fclose(fp) != 0)
+        ok = false;
+    if (!ok)
+        warn("could not write \"%s\"", path);
+    free(appvar);
+    return ok;
+}
+
+int bundle_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"outfile", required_argument, 0, 'o'},
+        {"varname", required_argument, 0, 'N'},
+        {"tree-shake", no_argument, 0, 't'},
+        {"minify", optional_argument, 0, 'm'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    const char* out_path = NULL;
+    const char* var_name = NULL;
+    bool shake = false;
+    bool min = false;
+    bool min_names = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "o:N:tm::h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'o': {
+                out_path = optarg;
+            } break;
+            case 'N': {
+                var_name = optarg;
+            } break;
+            case 't': {
+                shake = true;
+            } break;
+            case 'm': {
+                min = true;
+                if (optarg && !strcasecmp(optarg, "names"))
+                    min_names = true;
+                else if (optarg)
+                    fatal("unknown minify option: \"%s\"", optarg);
+            } break;
+            case 'h': {
+                puts(BUNDLE_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(BUNDLE_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (argc - optind != 1) {
+        puts(BUNDLE_HELP);
+        return EXIT_FAILURE;
+    }
+
+    // modules are looked up next to the main script
+    const char* main_path = argv[optind];
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", main_path);
+    snprintf(state.dir, sizeof(state.dir), "%s", dirname(dir));
+    const char* base = strrchr(main_path, '/');
+    base = base ? base + 1 : main_path;
+    usize base_len = strlen(base);
+    if (base_len > 3 && !strcasecmp(&base[base_len - 3], ".py"))
+        base_len -= 3;
+
+    char path_name[VAR_NAME_SZ + 1];
+    if (!var_name) {
+        name_sanitize(base, base_len, path_name);
+        var_name = path_name;
+    }
+
+    add_module(base, base_len < MODULE_NAME_SZ ? base_len : 0);
+    state.modules[0].src = read_file(main_path, &state.modules[0].len);
+    if (!state.modules[0].src)
+        fatal("could not read \"%s\": %s", main_path, strerror(errno));
+
+    bool ok = bundle_module(0);
+    if (ok)
+        ok = check_globals();
+
+    if (ok && shake) {
+        usize n;
+        usize saved = tree_shake(&state.out, &n);
+        info("tree shaking dropped %zu definition(s), %zu bytes", n, saved);
+    }
+
+    if (ok && min) {
+        char* dest = malloc(state.out.len + 1);
+        check_alloc(dest);
+        usize len;
+        if (minify(state.out.data, state.out.len, dest, &len, min_names)) {
+            info("minified the bundle, %zu bytes saved", state.out.len - len);
+            dest[len] = '\0';
+            free(state.out.data);
+            state.out = (Buf){.data = dest, .len = len, .cap = len + 1};
+        } else {
+            warn("could not minify the bundle, leaving it as is");
+            free(dest);
+        }
+    }
+
+    if (ok)
+        ok = write_bundle(out_path, var_name);
+    if (ok) {
+        usize n = 0;
+        for (usize i = 1; i < state.nmodules; i++)
+            n += state.modules[i].state == MODULE_DONE;
+        info("bundled \"%s\" and %zu module(s), %zu bytes of source", main_path,
+             n, state.out.len);
+    }
+
+    for (usize i = 0; i < state.nmodules; i++)
+        free(state.modules[i].src);
+    free(state.modules);
+    free(state.globals);
+    free(state.out.data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,182 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: subcommands (`tipyconv <command> ...`)
+ */
+
+#ifndef _COMMANDS_H
+#define _COMMANDS_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/**
+ * `tipyconv merge`: merges the journals of sharded runs, and checks them for
+ * gaps.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int merge_main(int argc, char** argv);
+
+/**
+ * `tipyconv mount`: mounts a read-only view of a directory, with AppVars shown
+ * as Python files. Needs FUSE.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int mount_main(int argc, char** argv);
+
+/**
+ * `tipyconv bundle`: inlines the modules a script imports from its own
+ * directory, and packs it into a single AppVar.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int bundle_main(int argc, char** argv);
+
+/**
+ * `tipyconv plan`: works out how much memory a set of scripts takes on the
+ * calculator, and packs them into sets that fit on one.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int plan_main(int argc, char** argv);
+
+/**
+ * `tipyconv pack`: packs scripts and AppVars into a single archive, with an
+ * index that `tipyconv get` looks entries up in. Compresses with zstd, if it
+ * was built with it.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int pack_main(int argc, char** argv);
+
+/**
+ * `tipyconv unpack`: restores every entry of an archive.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int unpack_main(int argc, char** argv);
+
+/**
+ * `tipyconv get`: extracts one entry of an archive, by its path or its
+ * variable name.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int get_main(int argc, char** argv);
+
+/**
+ * `tipyconv dedupe`: finds scripts and AppVars with the same source, and
+ * optionally replaces identical files with hard links.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int dedupe_main(int argc, char** argv);
+
+/**
+ * `tipyconv grep`: searches the sources of AppVars and scripts for a pattern,
+ * without converting them.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status
+ */
+int grep_main(int argc, char** argv);
+
+/**
+ * `tipyconv diff`: compares the metadata and the sources of two AppVars, or
+ * of an AppVar and a script.
+ *
+ * @param argc number of arguments, starting with the command name
+ * @param argv the arguments
+ * @return the exit status: 0 if they are the same, 1 if they differ, 2 on
+ * errors
+ */
+int diff_main(int argc, char** argv);
+
+// === helpers of the main program, for the commands ===
+
+/**
+ * Reads a whole file (or stdin, for `-`) into a null-terminated, heap
+ * allocated buffer.
+ *
+ * @param path the file
+ * @param len length of the file
+ * @return the buffer, NULL on error (with errno set)
+ */
+char* read_input(const char* path, usize* len);
+
+/**
+ * Parses a byte count, with an optional K, M or G suffix (powers of 1024).
+ *
+ * @param s the text
+ * @param res the byte count
+ * @return false if it is invalid, or 0
+ */
+bool parse_size(const char* s, usize* res);
+
+/**
+ * Makes a variable name out of a file name, without its extension.
+ *
+ * @param path the path of the file
+ * @param dest the name, `VAR_NAME_SZ + 1` bytes
+ */
+void get_var_name_from_path(const char* path, char* dest);
+
+/**
+ * Checks the extension of a path, ignoring case.
+ *
+ * @param path the path
+ * @param ext the extension, with its dot
+ * @return true if the path ends in `ext` and is longer than it
+ */
+bool has_ext(const char* path, const char* ext);
+
+/**
+ * Collects the scripts and AppVars (`.py` and `.8xv` files) in a directory
+ * tree. Hidden files and directories are left out.
+ *
+ * @param dir the directory
+ * @param add called with the path of every file found
+ * @param ctx passed on to `add`
+ */
+void scan_scripts(const char* dir, void (*add)(const char* path, void* ctx),
+                  void* ctx);
+
+/**
+ * Runs a worker on up to `jobs` threads, the calling thread included, and
+ * waits for all of them. Threads that can't be started are left out with a
+ * warning. The workers share their work out among themselves.
+ *
+ * @param jobs the number of threads; 0 runs it on the calling thread only
+ * @param worker the worker
+ * @param arg passed on to every worker
+ */
+void run_workers(usize jobs, void* (*worker)(void*), void* arg);
+
+#endif // _COMMANDS_H
@@ -19,17 +19,86 @@
 #define VERSION_TXT "tipyconv version " VERSION
 
 #define HELP                                                                   \
-    "usage: tipyconv [OPTIONS] <filename>\n"                                   \
+    "usage: tipyconv [OPTIONS] <filename>...\n"                                \
+    "       tipyconv merge [OPTIONS] <journal>... [-- <input>...]\n"           \
+    "       tipyconv mount [OPTIONS] <source dir> <mountpoint>\n"              \
+    "       tipyconv bundle [OPTIONS] <main.py>\n"                             \
+    "       tipyconv plan [OPTIONS] --ram BYTES <filename>...\n"               \
+    "       tipyconv pack [OPTIONS] -o ARCHIVE <file or dir>...\n"             \
+    "       tipyconv unpack [OPTIONS] ARCHIVE\n"                               \
+    "       tipyconv get [OPTIONS] ARCHIVE NAME\n"                             \
+    "       tipyconv dedupe [OPTIONS] <dir or file>...\n"                      \
+    "       tipyconv grep [OPTIONS] PATTERN <dir or file>...\n"                \
+    "       tipyconv diff [OPTIONS] <A> <B>\n"                                 \
     "Options:\n"                                                               \
     "  -o, --outfile:       Output path of conversion\n"                       \
+    "  -d, --outdir DIR:    Directory to write the output files to "           \
+    "(default: .)\n"                                                           \
     "  -n, --varname:       Name of file in calculator\n"                      \
+    "  -j, --jobs:          Number of files to convert in parallel (0: all "   \
+    "cores)\n"                                                                 \
+    "  -s, --stats[=FMT]:   Print per-phase timings (FMT: text, json)\n"       \
+    "  -t, --trace FILE:    Write a Chrome trace-event (Perfetto) JSON file\n" \
+    "      --tar-in FILE:   Convert each file in a tar stream (- for stdin)\n" \
+    "      --tar-out FILE:  Write the converted files of --tar-in as a tar "   \
+    "stream\n"                                                                 \
+    "                       (default: stdout)\n"                               \
+    "      --io BACKEND:    I/O backend for batches: blocking (default), "     \
+    "uring\n"                                                                  \
+    "                       (io_uring, single threaded, ignores -j), or "      \
+    "pipeline\n"                                                               \
+    "                       (separate reader, converter and writer threads)\n" \
+    "      --io-threads N:  Reader and writer threads of the pipeline "        \
+    "(default: 2)\n"                                                           \
+    "      --max-inflight SIZE:\n"                                             \
+    "                       Bytes the pipeline may hold at once (default: "    \
+    "64M)\n"                                                                   \
+    "      --watch DIR:     Convert files in DIR (and below) whenever they "   \
+    "change\n"                                                                 \
+    "      --debounce MS:   Wait for files to stay unchanged this long "       \
+    "(default: 150)\n"                                                         \
+    "      --minify[=names]:\n"                                                \
+    "                       Strip comments, docstrings and whitespace from "   \
+    "Python\n"                                                                 \
+    "                       sources (names: also shorten local variables)\n"   \
+    "      --split:         Cut Python sources too large for one AppVar into " \
+    "parts\n"                                                                  \
+    "                       that are imported by the output\n"                 \
+    "      --normalize:     Turn CRLF into LF, drop the byte order mark and"   \
+    " write\n"                                                                 \
+    "                       UTF-8 in the calculator's character set (and back" \
+    " when\n"                                                                  \
+    "                       extracting)\n"                                     \
+    "      --heap-check[=SIZE]:\n"                                             \
+    "                       Warn about scripts that may need more Python "     \
+    "heap than\n"                                                              \
+    "                       SIZE (default: 17K)\n"                             \
+    "      --heap-report FILE:\n"                                              \
+    "                       Write the heap estimate of each script as JSON "   \
+    "lines\n"                                                                  \
+    "      --no-clobber:    Fail instead of overwriting existing files\n"      \
+    "      --durable:       Sync outputs to disk, in groups of files\n"        \
+    "      --journal FILE:  Record finished files in FILE, and skip the ones " \
+    "already\n"                                                                \
+    "                       recorded there (with the same contents)\n"         \
+    "      --shard I/N:     Only convert the inputs of shard I out of N "      \
+    "(0 <= I < N)\n"                                                           \
+    "      --manifest FILE: Read the inputs, and their options, from FILE "    \
+    "(JSON\n"                                                                  \
+    "                       lines, or null separated paths; - for stdin)\n"    \
+    "      --results FILE:  Write a JSON line with the result of each input "  \
+    "to FILE\n"                                                                \
+    "      --name-map FILE: Write the variable name given to each input to "   \
+    "FILE\n"                                                                   \
     "  -V, --version:       Show the version\n"                                \
     "  -v, --verbose:       Show verbose output\n"                             \
     "  -h, --help:          Show this help screen\n"                           \
     "  -l, --license:       Show the license\n"                                \
-    "The format of the output file can be inferred from the input "            \
-    "file, but\n"                                                              \
-    "passing in an invalid input file is disallowed."
+    "The format of the input file is detected from its contents, and the "     \
+    "format\n"                                                                 \
+    "of the output file is inferred from it. Use - as the input or output "    \
+    "path to\n"                                                                \
+    "read from stdin or write to stdout."
 
 #define LICENSE                                                                \
     "BSD 3-Clause License\n"                                                   \
@@ -0,0 +1,468 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv dedupe`, which finds scripts and AppVars with the same
+ * source (and optionally the same source up to formatting and names)
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "hash.h"
+#include "minify.h"
+#include "text.h"
+#include "tipyconv.h"
+
+#define DEDUPE_HELP                                                            \
+    "usage: tipyconv dedupe [OPTIONS] <dir or file>...\n"                      \
+    "Finds scripts and AppVars (directories are searched for .py and .8xv "    \
+    "files)\n"                                                                 \
+    "with the same source, whatever their variable name, file name or file "   \
+    "info.\n"                                                                  \
+    "Options:\n"                                                               \
+    "  -n, --near[=names]:  Also group sources that are the same once "        \
+    "minified (with\n"                                                         \
+    "                       names, once their locals are renamed as well)\n"   \
+    "  -l, --link:          Replace files that are identical to the first of " \
+    "their\n"                                                                  \
+    "                       group with hard links to it\n"                     \
+    "  -j, --jobs N:        Number of files to read in parallel (0: all "      \
+    "CPUs, default\n"                                                          \
+    "                       0)\n"                                              \
+    "  -h, --help:          Show this help screen"
+
+typedef struct {
+    char* path;
+    bool appvar;
+    bool ok;
+    dev_t dev;
+    ino_t ino;
+    usize size;
+
+    char var_name[VAR_NAME_SZ + 1];
+    char file_info[FILE_INFO_SZ];
+    // of the long file name, 0 if there is none
+    u64 name_hash;
+    usize src_len;
+    u64 src_hash;
+    // of the minified source
+    u64 near_hash;
+} Dedupe_Item;
+
+static struct {
+    Dedupe_Item* items;
+    usize nitems;
+    usize cap;
+    bool near;
+    bool near_names;
+    atomic_size_t next;
+} state;
+
+static void add_item(const char* path, void* ctx) {
+    (void)ctx;
+    if (state.nitems == state.cap) {
+        state.cap = state.cap ? state.cap * 2 : 64;
+        state.items = realloc(state.items, state.cap * sizeof(Dedupe_Item));
+        check_alloc(state.items);
+    }
+    Dedupe_Item* it = &state.items[state.nitems++];
+    *it = (Dedupe_Item){.path = strdup(path)};
+    check_alloc(it->path);
+}
+
+static bool read_at(int fd, char* buf, usize len, usize off) {
+    usize got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, &buf[got], len - got, (off_t)(off + got));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        got += (usize)n;
+    }
+    return true;
+}
+
+static u64 near_hash(const char* src, usize len) {
+    char* text = malloc(len + 1);
+    char* min = malloc(len + 1);
+    check_alloc(text);
+    check_alloc(min);
+
+    usize text_len = text_to_ti(src, len, text, NULL);
+    usize min_len;
+    u64 res;
+    // what can't be minified is compared as it is
+    if (minify(text, text_len, min, &min_len, state.near_names))
+        res = hash_bytes(min, min_len, HASH_SEED);
+    else
+        res = hash_bytes(text, text_len, HASH_SEED);
+
+    free(text);
+    free(min);
+    return res;
+}
+
+// hashes the source of an AppVar. Past its header, nothing but the file name
+// and the source is read.
+static bool hash_appvar(Dedupe_Item* it, int fd, const char* header) {
+    usize offset;
+    u16 src_len;
+    if (it->size < TI_HEADER_SZ ||
+        !ti_pyfile_locate_src(header, TI_HEADER_SZ, &offset, &src_len) ||
+        offset + src_len > it->size)
+        return false;
+
+    memcpy(it->file_info, &header[0xB], FILE_INFO_SZ);
+    memcpy(it->var_name, &header[0x3C], VAR_NAME_SZ);
+
+    // the file name (after its length and SOH) is between the header and the
+    // source
+    usize start = TI_HEADER_SZ - 1;
+    usize len = offset + src_len - start;
+    char* data = malloc(len + 1);
+    check_alloc(data);
+    if (!read_at(fd, data, len, start)) {
+        free(data);
+        return false;
+    }
+    if (offset > start)
+        it->name_hash = hash_bytes(data, offset - start, HASH_SEED);
+    it->src_len = src_len;
+    it->src_hash = hash_bytes(&data[offset - start], src_len, HASH_SEED);
+    if (state.near)
+        it->near_hash = near_hash(&data[offset - start], src_len);
+    free(data);
+    return true;
+}
+
+static bool hash_script(Dedupe_Item* it, int fd) {
+    char* data = malloc(it->size + 1);
+    check_alloc(data);
+    if (!read_at(fd, data, it->size, 0)) {
+        free(data);
+        return false;
+    }
+    get_var_name_from_path(it->path, it->var_name);
+    it->src_len = it->size;
+    it->src_hash = hash_bytes(data, it->size, HASH_SEED);
+    if (state.near)
+        it->near_hash = near_hash(data, it->size);
+    free(data);
+    return true;
+}
+
+static void hash_item(Dedupe_Item* it) {
+    int fd = open(it->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        warn("could not read \"%s\": %s", it->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    it->dev = st.st_dev;
+    it->ino = st.st_ino;
+    it->size = (usize)st.st_size;
+
+    char header[TI_HEADER_SZ];
+    usize n = it->size < sizeof(header) ? it->size : sizeof(header);
+    if (!read_at(fd, header, n, 0)) {
+        warn("could not read \"%s\": %s", it->path, strerror(errno));
+        close(fd);
+        return;
+    }
+    it->appvar = ti_is_appvar(header, n);
+    it->ok = it->appvar ? hash_appvar(it, fd, header) : hash_script(it, fd);
+    if (!it->ok && it->appvar)
+        warn("\"%s\" is not a valid Python AppVar", it->path);
+    else if (!it->ok)
+        warn("could not read \"%s\": %s", it->path, strerror(errno));
+    close(fd);
+}
+
+static void* hash_worker(void* arg) {
+    (void)arg;
+    usize i;
+    while ((i = atomic_fetch_add(&state.next, 1)) < state.nitems)
+        hash_item(&state.items[i]);
+    return NULL;
+}
+
+// hashes every item, on up to `jobs` threads (the calling thread included)
+static void hash_all(usize jobs) {
+    if (jobs > state.nitems)
+        jobs = state.nitems;
+    run_workers(jobs, hash_worker, NULL);
+}
+
+// failed items last, then by source and path
+static int cmp_exact(const void* a, const void* b) {
+    const Dedupe_Item* ia = a;
+    const Dedupe_Item* ib = b;
+    if (ia->ok != ib->ok)
+        return ia->ok ? -1 : 1;
+    if (ia->src_len != ib->src_len)
+        return ia->src_len < ib->src_len ? -1 : 1;
+    if (ia->src_hash != ib->src_hash)
+        return ia->src_hash < ib->src_hash ? -1 : 1;
+    return strcmp(ia->path, ib->path);
+}
+
+static bool same_src(const Dedupe_Item* a, const Dedupe_Item* b) {
+    return a->src_len == b->src_len && a->src_hash == b->src_hash;
+}
+
+static int cmp_near(const void* a, const void* b) {
+    const Dedupe_Item* ia = *(Dedupe_Item* const*)a;
+    const Dedupe_Item* ib = *(Dedupe_Item* const*)b;
+    if (ia->near_hash != ib->near_hash)
+        return ia->near_hash < ib->near_hash ? -1 : 1;
+    return ia < ib ? -1 : ia > ib;
+}
+
+// what sets an item apart from the first of its group
+static void describe(const Dedupe_Item* it, const Dedupe_Item* first,
+                     char* dest, usize sz) {
+    dest[0] = '\0';
+    if (it == first) {
+        snprintf(dest, sz, "-");
+        return;
+    }
+    if (it->appvar != first->appvar) {
+        snprintf(dest, sz, "format");
+        return;
+    }
+
+    const char* diffs[3];
+    usize n = 0;
+    if (strncmp(it->var_name, first->var_name, VAR_NAME_SZ))
+        diffs[n++] = "var name";
+    if (it->name_hash != first->name_hash)
+        diffs[n++] = "file name";
+    if (memcmp(it->file_info, first->file_info, FILE_INFO_SZ))
+        diffs[n++] = "file info";
+    for (usize i = 0; i < n; i++)
+        snprintf(&dest[strlen(dest)], sz - strlen(dest), "%s%s",
+                 i ? ", " : "", diffs[i]);
+    if (n == 0)
+        snprintf(dest, sz, "same");
+}
+
+static char* read_whole(const char* path, usize* len) {
+    char* data = read_input(path, len);
+    if (!data)
+        warn("could not read \"%s\": %s", path, strerror(errno));
+    return data;
+}
+
+// replaces `path` with a hard link to `target`
+static bool replace_with_link(const char* target, const char* path) {
+    usize len = strlen(path) + 16;
+    char* tmp = malloc(len);
+    check_alloc(tmp);
+    snprintf(tmp, len, "%s.tipyconv-link", path);
+
+    bool ok = link(target, tmp) == 0;
+    if (ok && rename(tmp, path) != 0) {
+        ok = false;
+        unlink(tmp);
+    }
+    if (!ok)
+        warn("could not link \"%s\" to \"%s\": %s", path, target,
+             strerror(errno));
+    free(tmp);
+    return ok;
+}
+
+// links the files of a group that are identical to its first one. Returns
+// the bytes that were freed.
+static usize link_group(Dedupe_Item* group, usize n, usize* linked) {
+    Dedupe_Item* first = &group[0];
+    usize first_len;
+    char* first_data = NULL;
+    usize freed = 0;
+
+    for (usize i = 1; i < n; i++) {
+        Dedupe_Item* it = &group[i];
+        if (it->size != first->size || it->dev != first->dev ||
+            it->ino == first->ino)
+            continue;
+        if (!first_data && !(first_data = read_whole(first->path, &first_len)))
+            return freed;
+
+        usize len;
+        char* data = read_whole(it->path, &len);
+        if (data && len == first_len && !memcmp(data, first_data, len) &&
+            replace_with_link(first->path, it->path)) {
+            it->ino = first->ino;
+            freed += len;
+            (*linked)++;
+        }
+        free(data);
+    }
+    free(first_data);
+    return freed;
+}
+
+int dedupe_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"near", optional_argument, 0, 'n'},
+        {"link", no_argument, 0, 'l'},
+        {"jobs", required_argument, 0, 'j'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    bool hardlink = false;
+    usize jobs = 0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n::lj:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'n': {
+                state.near = true;
+                if (optarg && !strcasecmp(optarg, "names"))
+                    state.near_names = true;
+                else if (optarg)
+                    fatal("unknown near option: \"%s\"", optarg);
+            } break;
+            case 'l': {
+                hardlink = true;
+            } break;
+            case 'j': {
+                char* end;
+                long l = strtol(optarg, &end, 10);
+                if (*end != '\0' || l < 0)
+                    fatal("invalid number of jobs: \"%s\"", optarg);
+                jobs = (usize)l;
+            } break;
+            case 'h': {
+                puts(DEDUPE_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(DEDUPE_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (optind >= argc) {
+        puts(DEDUPE_HELP);
+        return EXIT_FAILURE;
+    }
+    if (jobs == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = n > 0 ? (usize)n : 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+            scan_scripts(argv[i], add_item, NULL);
+        else
+            add_item(argv[i], NULL);
+    }
+
+    hash_all(jobs);
+    Dedupe_Item* items = state.items;
+    usize n = state.nitems;
+    qsort(items, n, sizeof(Dedupe_Item), cmp_exact);
+
+    usize failed = 0;
+    usize groups = 0;
+    usize dups = 0;
+    usize dup_bytes = 0;
+    usize linked = 0;
+    usize freed = 0;
+    char diff[64];
+    for (usize i = 0; i < n;) {
+        if (!items[i].ok) {
+            failed++;
+            i++;
+            continue;
+        }
+        usize j = i + 1;
+        while (j < n && items[j].ok && same_src(&items[i], &items[j]))
+            j++;
+        if (j - i > 1) {
+            groups++;
+            dups += j - i - 1;
+            dup_bytes += (j - i - 1) * items[i].src_len;
+            printf("%sgroup %zu: %zu files, %zu bytes of source\n",
+                   groups > 1 ? "\n" : "", groups, j - i, items[i].src_len);
+            for (usize k = i; k < j; k++) {
+                describe(&items[k], &items[i], diff, sizeof(diff));
+                printf("  %-8s  %-30s  %s\n", items[k].var_name, diff,
+                       items[k].path);
+            }
+            if (hardlink)
+                freed += link_group(&items[i], j - i, &linked);
+        }
+        i = j;
+    }
+
+    // sources that are the same once minified, but not byte for byte
+    usize near_groups = 0;
+    if (state.near) {
+        Dedupe_Item** by_near = calloc(n + 1, sizeof(Dedupe_Item*));
+        check_alloc(by_near);
+        usize m = 0;
+        for (usize i = 0; i < n; i++) {
+            if (items[i].ok)
+                by_near[m++] = &items[i];
+        }
+        qsort(by_near, m, sizeof(Dedupe_Item*), cmp_near);
+
+        for (usize i = 0; i < m;) {
+            usize j = i + 1;
+            bool differ = false;
+            while (j < m && by_near[j]->near_hash == by_near[i]->near_hash) {
+                differ = differ || !same_src(by_near[j], by_near[i]);
+                j++;
+            }
+            if (differ) {
+                near_groups++;
+                printf("%snear group %zu: %zu files\n",
+                       groups + near_groups > 1 ? "\n" : "", near_groups,
+                       j - i);
+                for (usize k = i; k < j; k++)
+                    printf("  %-8s  %8zu  %s\n", by_near[k]->var_name,
+                           by_near[k]->src_len, by_near[k]->path);
+            }
+            i = j;
+        }
+        free(by_near);
+    }
+
+    info("%zu of %zu file(s) are duplicates, in %zu group(s) (%zu bytes of "
+         "source)",
+         dups, n - failed, groups, dup_bytes);
+    if (state.near)
+        info("%zu group(s) of near duplicates", near_groups);
+    if (hardlink)
+        info("linked %zu file(s), freeing %zu bytes", linked, freed);
+
+    for (usize i = 0; i < n; i++)
+        free(items[i].path);
+    free(items);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
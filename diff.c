@@ -0,0 +1,531 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv diff`, which compares the metadata and the sources of two
+ * AppVars (or an AppVar and a script)
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "hash.h"
+#include "text.h"
+#include "tipyconv.h"
+
+#define DIFF_HELP                                                              \
+    "usage: tipyconv diff [OPTIONS] <A> <B>\n"                                 \
+    "Compares two AppVars, or an AppVar and a script: first their metadata, "  \
+    "field by\n"                                                               \
+    "field, then their sources as a unified diff. Exits with 0 if they are "   \
+    "the same,\n"                                                              \
+    "1 if they differ and 2 on errors, like diff(1).\n"                        \
+    "Options:\n"                                                               \
+    "  -U, --unified N:     Lines of context around changes (default 3)\n"     \
+    "  -q, --brief:         Only tell whether the files differ\n"              \
+    "  -h, --help:          Show this help screen"
+
+#define DIFF_SAME    0
+#define DIFF_CHANGED 1
+#define DIFF_TROUBLE 2
+
+// a file, and the fields of its AppVar, all pointing into the mapping
+typedef struct {
+    const char* path;
+    const char* data;
+    usize len;
+    bool appvar;
+
+    char var_name[VAR_NAME_SZ + 1];
+    const char* file_name;
+    usize file_name_len;
+    const char* file_info;
+    const char* src;
+    usize src_len;
+    u16 checksum;
+    bool checksum_valid;
+} Diff_View;
+
+static bool view_open(Diff_View* v, const char* path) {
+    *v = (Diff_View){.path = path};
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        warn("could not read \"%s\": %s", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    v->len = (usize)st.st_size;
+    if (v->len) {
+        void* map = mmap(NULL, v->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            warn("could not map \"%s\": %s", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        v->data = map;
+    }
+    close(fd);
+
+    v->appvar = ti_is_appvar(v->data, v->len);
+    if (!v->appvar) {
+        get_var_name_from_path(path, v->var_name);
+        v->src = v->data;
+        v->src_len = v->len;
+        return true;
+    }
+
+    usize offset;
+    u16 src_len;
+    if (!ti_pyfile_locate_src(v->data, v->len, &offset, &src_len) ||
+        offset + src_len + 2 > v->len) {
+        warn("\"%s\" is not a valid Python AppVar", path);
+        munmap((void*)v->data, v->len);
+        return false;
+    }
+    memcpy(v->var_name, &v->data[0x3C], VAR_NAME_SZ);
+    v->file_info = &v->data[0xB];
+    // the length and SOH are before the name, its terminator after it
+    if (offset > TI_HEADER_SZ - 1) {
+        v->file_name = &v->data[TI_HEADER_SZ];
+        v->file_name_len = offset - TI_HEADER_SZ - 1;
+    }
+    v->src = &v->data[offset];
+    v->src_len = src_len;
+    v->checksum = (u16)((u8)v->data[v->len - 2] |
+                        (u8)v->data[v->len - 1] << 8);
+    v->checksum_valid = ti_pyfile_checksum_valid(v->data, v->len);
+    return true;
+}
+
+static void view_close(Diff_View* v) {
+    if (v->len)
+        munmap((void*)v->data, v->len);
+}
+
+// === metadata ===
+
+static void print_quoted(const char* s, usize len) {
+    if (!s) {
+        fputs("none", stdout);
+        return;
+    }
+    // fixed size fields are padded with nulls
+    while (len && s[len - 1] == '\0')
+        len--;
+    putchar('"');
+    for (usize i = 0; i < len; i++) {
+        u8 c = (u8)s[i];
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c >= 0x20 && c < 0x7f)
+            putchar(c);
+        else
+            printf("\\x%02x", c);
+    }
+    putchar('"');
+}
+
+static bool field_differs(const char* a, usize alen, const char* b,
+                          usize blen) {
+    if (!a || !b)
+        return a != b;
+    return alen != blen || memcmp(a, b, alen) != 0;
+}
+
+// prints a field of both files, if it differs
+static void print_field(const char* name, const char* a, usize alen,
+                        const char* b, usize blen) {
+    if (!field_differs(a, alen, b, blen))
+        return;
+    printf("%s: ", name);
+    print_quoted(a, alen);
+    fputs(" -> ", stdout);
+    print_quoted(b, blen);
+    putchar('\n');
+}
+
+// prints the fields that differ
+static void print_metadata(const Diff_View* a, const Diff_View* b) {
+    if (a->appvar != b->appvar)
+        printf("format: %s -> %s\n", a->appvar ? "AppVar" : "script",
+               b->appvar ? "AppVar" : "script");
+    print_field("var name", a->var_name, strlen(a->var_name), b->var_name,
+                strlen(b->var_name));
+    print_field("file name", a->file_name, a->file_name_len, b->file_name,
+                b->file_name_len);
+    if (a->appvar && b->appvar)
+        print_field("file info", a->file_info, FILE_INFO_SZ, b->file_info,
+                    FILE_INFO_SZ);
+    if (a->len != b->len)
+        printf("size: %zu -> %zu bytes\n", a->len, b->len);
+    if (a->src_len != b->src_len)
+        printf("source: %zu -> %zu bytes\n", a->src_len, b->src_len);
+    if (a->appvar && b->appvar && (a->checksum != b->checksum ||
+                                   a->checksum_valid != b->checksum_valid)) {
+        printf("checksum: 0x%04x%s -> 0x%04x%s\n", a->checksum,
+               a->checksum_valid ? "" : " (invalid)", b->checksum,
+               b->checksum_valid ? "" : " (invalid)");
+    }
+}
+
+// === sources ===
+
+typedef struct {
+    const char* s;
+    // with the line break, if there is one
+    usize len;
+    u64 hash;
+} Diff_Line;
+
+typedef struct {
+    Diff_Line* a;
+    Diff_Line* b;
+    // lines of a that are removed, and of b that are added
+    bool* del;
+    bool* ins;
+    // the furthest reaching paths of the forward and reverse searches
+    isize* v1;
+    isize* v2;
+} Diff_Ctx;
+
+static Diff_Line* split_lines(const char* src, usize len, usize* n) {
+    usize cap = 64;
+    Diff_Line* lines = malloc(cap * sizeof(Diff_Line));
+    check_alloc(lines);
+    *n = 0;
+    for (usize i = 0; i < len;) {
+        const char* nl = memchr(&src[i], '\n', len - i);
+        usize end = nl ? (usize)(nl - src) + 1 : len;
+        if (*n == cap) {
+            cap *= 2;
+            lines = realloc(lines, cap * sizeof(Diff_Line));
+            check_alloc(lines);
+        }
+        lines[(*n)++] = (Diff_Line){
+            .s = &src[i],
+            .len = end - i,
+            .hash = hash_bytes(&src[i], end - i, HASH_SEED),
+        };
+        i = end;
+    }
+    return lines;
+}
+
+static bool line_eq(const Diff_Ctx* c, isize i, isize j) {
+    const Diff_Line* a = &c->a[i];
+    const Diff_Line* b = &c->b[j];
+    return a->hash == b->hash && a->len == b->len &&
+           !memcmp(a->s, b->s, a->len);
+}
+
+// finds where the shortest edit script of a[a0..a1) and b[b0..b1) crosses
+// its middle, searching from both ends at once (Myers, 1986). Returns false
+// if the two have no line in common.
+static bool middle_snake(Diff_Ctx* c, isize a0, isize a1, isize b0, isize b1,
+                         isize* x, isize* y) {
+    isize n = a1 - a0;
+    isize m = b1 - b0;
+    isize max_d = (n + m + 1) / 2;
+    isize off = max_d;
+    isize vlen = 2 * max_d + 2;
+    for (isize i = 0; i < vlen; i++)
+        c->v1[i] = c->v2[i] = -1;
+    c->v1[off + 1] = 0;
+    c->v2[off + 1] = 0;
+
+    isize delta = n - m;
+    // paths overlap in the forward search if delta is odd
+    bool front = delta % 2 != 0;
+    isize k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+    for (isize d = 0; d < max_d; d++) {
+        for (isize k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            isize k1o = off + k1;
+            isize x1;
+            if (k1 == -d || (k1 != d && c->v1[k1o - 1] < c->v1[k1o + 1]))
+                x1 = c->v1[k1o + 1];
+            else
+                x1 = c->v1[k1o - 1] + 1;
+            isize y1 = x1 - k1;
+            while (x1 < n && y1 < m && line_eq(c, a0 + x1, b0 + y1)) {
+                x1++;
+                y1++;
+            }
+            c->v1[k1o] = x1;
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                isize k2o = off + delta - k1;
+                if (k2o >= 0 && k2o < vlen && c->v2[k2o] != -1 &&
+                    x1 >= n - c->v2[k2o]) {
+                    *x = a0 + x1;
+                    *y = b0 + y1;
+                    return true;
+                }
+            }
+        }
+
+        for (isize k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            isize k2o = off + k2;
+            isize x2;
+            if (k2 == -d || (k2 != d && c->v2[k2o - 1] < c->v2[k2o + 1]))
+                x2 = c->v2[k2o + 1];
+            else
+                x2 = c->v2[k2o - 1] + 1;
+            isize y2 = x2 - k2;
+            while (x2 < n && y2 < m &&
+                   line_eq(c, a1 - x2 - 1, b1 - y2 - 1)) {
+                x2++;
+                y2++;
+            }
+            c->v2[k2o] = x2;
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (!front) {
+                isize k1o = off + delta - k2;
+                if (k1o >= 0 && k1o < vlen && c->v1[k1o] != -1) {
+                    isize x1 = c->v1[k1o];
+                    isize y1 = off + x1 - k1o;
+                    if (x1 >= n - x2) {
+                        *x = a0 + x1;
+                        *y = b0 + y1;
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// marks the lines of a[a0..a1) and b[b0..b1) that are not in their longest
+// common subsequence
+static void compare(Diff_Ctx* c, isize a0, isize a1, isize b0, isize b1) {
+    while (a0 < a1 && b0 < b1 && line_eq(c, a0, b0)) {
+        a0++;
+        b0++;
+    }
+    while (a0 < a1 && b0 < b1 && line_eq(c, a1 - 1, b1 - 1)) {
+        a1--;
+        b1--;
+    }
+
+    isize x, y;
+    if (a0 == a1 || b0 == b1 || !middle_snake(c, a0, a1, b0, b1, &x, &y) ||
+        (x == a0 && y == b0) || (x == a1 && y == b1)) {
+        for (isize i = a0; i < a1; i++)
+            c->del[i] = true;
+        for (isize j = b0; j < b1; j++)
+            c->ins[j] = true;
+        return;
+    }
+    compare(c, a0, x, b0, y);
+    compare(c, x, a1, y, b1);
+}
+
+typedef struct {
+    // ' ', '-' or '+'
+    char op;
+    usize a;
+    usize b;
+} Diff_Op;
+
+static void print_line(char op, const Diff_Line* l) {
+    putchar(op);
+    usize len = l->len;
+    bool nl = len && l->s[len - 1] == '\n';
+    if (nl)
+        len--;
+    // in the calculator's character set, most likely
+    if (!text_is_utf8(l->s, len)) {
+        char* utf8 = malloc(3 * len + 1);
+        check_alloc(utf8);
+        fwrite(utf8, 1, text_from_ti(l->s, len, utf8), stdout);
+        free(utf8);
+    } else {
+        fwrite(l->s, 1, len, stdout);
+    }
+    putchar('\n');
+    if (!nl)
+        puts("\\ No newline at end of file");
+}
+
+// `start,count` of a hunk, as diff(1) writes it
+static void print_range(usize first, usize count) {
+    if (count == 1)
+        printf("%zu", first + 1);
+    else
+        printf("%zu,%zu", count ? first + 1 : first, count);
+}
+
+static void print_hunks(const Diff_Ctx* c, const Diff_Op* ops, usize nops,
+                        usize context) {
+    usize i = 0;
+    while (i < nops) {
+        if (ops[i].op == ' ') {
+            i++;
+            continue;
+        }
+
+        // from the context before the change to the context after the last
+        // change that is at most 2 * context lines further
+        usize start = i > context ? i - context : 0;
+        usize last = i;
+        for (usize k = i + 1; k < nops && k <= last + 2 * context + 1; k++) {
+            if (ops[k].op != ' ')
+                last = k;
+        }
+        usize end = last + 1 + context < nops ? last + 1 + context : nops;
+
+        usize alen = 0, blen = 0;
+        for (usize k = start; k < end; k++) {
+            alen += ops[k].op != '+';
+            blen += ops[k].op != '-';
+        }
+        fputs("@@ -", stdout);
+        print_range(ops[start].a, alen);
+        fputs(" +", stdout);
+        print_range(ops[start].b, blen);
+        puts(" @@");
+        for (usize k = start; k < end; k++) {
+            const Diff_Op* op = &ops[k];
+            print_line(op->op, op->op == '+' ? &c->b[op->b] : &c->a[op->a]);
+        }
+        i = end;
+    }
+}
+
+static void print_source_diff(const Diff_View* a, const Diff_View* b,
+                              usize context) {
+    usize na, nb;
+    Diff_Ctx c = {
+        .a = split_lines(a->src, a->src_len, &na),
+        .b = split_lines(b->src, b->src_len, &nb),
+    };
+    usize vlen = na + nb + 4;
+    c.del = calloc(na + 1, sizeof(bool));
+    c.ins = calloc(nb + 1, sizeof(bool));
+    c.v1 = malloc(vlen * sizeof(isize));
+    c.v2 = malloc(vlen * sizeof(isize));
+    check_alloc(c.del);
+    check_alloc(c.ins);
+    check_alloc(c.v1);
+    check_alloc(c.v2);
+    compare(&c, 0, (isize)na, 0, (isize)nb);
+
+    Diff_Op* ops = malloc((na + nb + 1) * sizeof(Diff_Op));
+    check_alloc(ops);
+    usize nops = 0;
+    usize i = 0, j = 0;
+    while (i < na || j < nb) {
+        if (i < na && c.del[i])
+            ops[nops++] = (Diff_Op){'-', i++, j};
+        else if (j < nb && c.ins[j])
+            ops[nops++] = (Diff_Op){'+', i, j++};
+        else
+            ops[nops++] = (Diff_Op){' ', i++, j++};
+    }
+
+    printf("--- %s\n+++ %s\n", a->path, b->path);
+    print_hunks(&c, ops, nops, context);
+
+    free(ops);
+    free(c.a);
+    free(c.b);
+    free(c.del);
+    free(c.ins);
+    free(c.v1);
+    free(c.v2);
+}
+
+int diff_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"unified", required_argument, 0, 'U'},
+        {"brief", no_argument, 0, 'q'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    usize context = 3;
+    bool brief = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "U:qh", opts, NULL)) != -1) {
+        switch (c) {
+            case 'U': {
+                char* end;
+                long l = strtol(optarg, &end, 10);
+                if (*end != '\0' || l < 0)
+                    fatal("invalid number of lines: \"%s\"", optarg);
+                context = (usize)l;
+            } break;
+            case 'q': {
+                brief = true;
+            } break;
+            case 'h': {
+                puts(DIFF_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(DIFF_HELP);
+                return DIFF_TROUBLE;
+            } break;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        puts(DIFF_HELP);
+        return DIFF_TROUBLE;
+    }
+
+    Diff_View a, b;
+    if (!view_open(&a, argv[optind]))
+        return DIFF_TROUBLE;
+    if (!view_open(&b, argv[optind + 1])) {
+        view_close(&a);
+        return DIFF_TROUBLE;
+    }
+
+    // the stored checksums tell most changed AppVars apart without reading
+    // them
+    bool same = a.len == b.len && a.appvar == b.appvar &&
+                (!a.appvar || a.checksum == b.checksum) &&
+                (a.len == 0 || !memcmp(a.data, b.data, a.len));
+    if (!same) {
+        bool src_same = a.src_len == b.src_len &&
+                        (a.src_len == 0 || !memcmp(a.src, b.src, a.src_len));
+        if (brief) {
+            printf("%s and %s differ%s\n", a.path, b.path,
+                   src_same ? " (in their metadata only)" : "");
+        } else {
+            print_metadata(&a, &b);
+            if (!src_same)
+                print_source_diff(&a, &b, context);
+        }
+    }
+
+    view_close(&a);
+    view_close(&b);
+    return same ? DIFF_SAME : DIFF_CHANGED;
+}
@@ -0,0 +1,429 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv grep`, which searches the sources of AppVars (and scripts)
+ * in place
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "text.h"
+#include "tipyconv.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define GREP_X86
+#include <immintrin.h>
+#endif
+
+#define GREP_HELP                                                              \
+    "usage: tipyconv grep [OPTIONS] PATTERN <dir or file>...\n"                \
+    "Searches the sources of AppVars and scripts (directories are searched "   \
+    "for .py\n"                                                                \
+    "and .8xv files) for an extended regular expression, without converting "  \
+    "them.\n"                                                                  \
+    "Matching lines are printed as FILE:VAR:LINE:TEXT.\n"                      \
+    "Options:\n"                                                               \
+    "  -F, --fixed-strings: PATTERN is a plain string, not a regular "         \
+    "expression\n"                                                             \
+    "  -i, --ignore-case:   Ignore case\n"                                     \
+    "  -l, --files-with-matches:\n"                                            \
+    "                       Only print the files that match\n"                 \
+    "  -c, --count:         Only print how many lines of each file match\n"    \
+    "  -j, --jobs N:        Number of files to search in parallel (0: all "    \
+    "CPUs,\n"                                                                  \
+    "                       default 0)\n"                                      \
+    "  -h, --help:          Show this help screen"
+
+typedef enum {
+    GREP_LINES = 0,
+    GREP_FILES,
+    GREP_COUNT,
+} Grep_Mode;
+
+typedef struct {
+    char* path;
+    // what the worker printed, written out in the order of the files
+    char* out;
+    usize out_len;
+    usize matches;
+    bool failed;
+    atomic_bool done;
+} Grep_Item;
+
+static struct {
+    Grep_Item* items;
+    usize nitems;
+    usize cap;
+
+    Grep_Mode mode;
+    // the pattern, if it is searched for as it is
+    const char* literal;
+    usize literal_len;
+    regex_t re;
+
+    atomic_size_t next;
+    pthread_mutex_t print_lock;
+    // the first item that is not printed yet
+    usize printed;
+} state = {.print_lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void add_item(const char* path, void* ctx) {
+    (void)ctx;
+    if (state.nitems == state.cap) {
+        state.cap = state.cap ? state.cap * 2 : 64;
+        state.items = realloc(state.items, state.cap * sizeof(Grep_Item));
+        check_alloc(state.items);
+    }
+    Grep_Item* it = &state.items[state.nitems++];
+    *it = (Grep_Item){.path = strdup(path)};
+    check_alloc(it->path);
+}
+
+// === literal search ===
+
+// the first and the last byte of the needle are compared at 32 (AVX2) or 16
+// (SSE2) positions at once, and the rest of it only where both match
+
+#ifdef GREP_X86
+static const char* find_sse2(const char* hay, usize len, const char* needle,
+                             usize n) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    usize i = 0;
+    for (; i + n - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&hay[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&hay[i + n - 1]);
+        unsigned m = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (m) {
+            usize k = i + (usize)__builtin_ctz(m);
+            if (!memcmp(&hay[k + 1], &needle[1], n - 2))
+                return &hay[k];
+            m &= m - 1;
+        }
+    }
+    return memmem(&hay[i], len - i, needle, n);
+}
+
+__attribute__((target("avx2"))) static const char*
+find_avx2(const char* hay, usize len, const char* needle, usize n) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    usize i = 0;
+    for (; i + n - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)&hay[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&hay[i + n - 1]);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (m) {
+            usize k = i + (usize)__builtin_ctz(m);
+            if (!memcmp(&hay[k + 1], &needle[1], n - 2))
+                return &hay[k];
+            m &= m - 1;
+        }
+    }
+    return find_sse2(&hay[i], len - i, needle, n);
+}
+#endif
+
+static const char* find(const char* hay, usize len, const char* needle,
+                        usize n) {
+    if (n == 1)
+        return memchr(hay, needle[0], len);
+#ifdef GREP_X86
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2(hay, len, needle, n);
+    return find_sse2(hay, len, needle, n);
+#else
+    return memmem(hay, len, needle, n);
+#endif
+}
+
+// patterns without any special characters are searched for as they are
+static bool is_literal(const char* pattern) {
+    return pattern[0] && !strpbrk(pattern, "\\^$.[]|()*+?{}");
+}
+
+// finds the next match at or after `pos`, which is the start of a line
+static bool next_match(const char* src, usize len, usize pos, usize* at) {
+    if (state.literal) {
+        const char* p = find(&src[pos], len - pos, state.literal,
+                             state.literal_len);
+        if (!p)
+            return false;
+        *at = (usize)(p - src);
+        return true;
+    }
+
+    regmatch_t m = {.rm_so = (regoff_t)pos, .rm_eo = (regoff_t)len};
+    if (regexec(&state.re, src, 1, &m, REG_STARTEND) != 0)
+        return false;
+    *at = (usize)m.rm_so;
+    return true;
+}
+
+// === search ===
+
+static void print_line(FILE* out, const Grep_Item* it, const char* var_name,
+                       usize line, const char* text, usize len) {
+    fprintf(out, "%s:%s:%zu:", it->path, var_name, line);
+    // in the calculator's character set, most likely
+    if (!text_is_utf8(text, len)) {
+        char* utf8 = malloc(3 * len + 1);
+        check_alloc(utf8);
+        usize utf8_len = text_from_ti(text, len, utf8);
+        fwrite(utf8, 1, utf8_len, out);
+        free(utf8);
+    } else {
+        fwrite(text, 1, len, out);
+    }
+    fputc('\n', out);
+}
+
+static void search(Grep_Item* it, const char* src, usize len,
+                   const char* var_name, FILE* out) {
+    usize pos = 0;
+    usize line = 1;
+    // where lines were counted up to
+    usize counted = 0;
+    usize at;
+    while (pos < len && next_match(src, len, pos, &at)) {
+        const char* nl = memrchr(&src[pos], '\n', at - pos);
+        usize start = nl ? (usize)(nl - src) + 1 : pos;
+        nl = memchr(&src[at], '\n', len - at);
+        usize end = nl ? (usize)(nl - src) : len;
+
+        for (const char* p = &src[counted];
+             (p = memchr(p, '\n', start - (usize)(p - src)));
+             p++)
+            line++;
+        counted = start;
+
+        it->matches++;
+        if (state.mode == GREP_FILES)
+            return;
+        if (state.mode == GREP_LINES)
+            print_line(out, it, var_name, line, &src[start], end - start);
+        pos = end + 1;
+    }
+}
+
+static bool grep_item(Grep_Item* it, FILE* out) {
+    int fd = open(it->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        warn("could not read \"%s\": %s", it->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    usize size = (usize)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        warn("could not map \"%s\": %s", it->path, strerror(errno));
+        return false;
+    }
+
+    char var_name[VAR_NAME_SZ + 1] = {0};
+    const char* src = data;
+    usize len = size;
+    bool ok = true;
+    if (ti_is_appvar(data, size)) {
+        // nothing but the header and the source is touched
+        usize offset;
+        u16 src_len;
+        if (ti_pyfile_locate_src(data, size, &offset, &src_len) &&
+            offset + src_len <= size) {
+            memcpy(var_name, &data[0x3C], VAR_NAME_SZ);
+            src = &data[offset];
+            len = src_len;
+        } else {
+            warn("\"%s\" is not a valid Python AppVar", it->path);
+            ok = false;
+        }
+    } else {
+        get_var_name_from_path(it->path, var_name);
+    }
+
+    if (ok)
+        search(it, src, len, var_name, out);
+    munmap((void*)data, size);
+    return ok;
+}
+
+// writes out what the workers found, in the order of the files
+static void flush_output(void) {
+    pthread_mutex_lock(&state.print_lock);
+    while (state.printed < state.nitems &&
+           atomic_load(&state.items[state.printed].done)) {
+        Grep_Item* it = &state.items[state.printed++];
+        if (it->out_len)
+            fwrite(it->out, 1, it->out_len, stdout);
+        if (state.mode == GREP_FILES && it->matches)
+            printf("%s\n", it->path);
+        else if (state.mode == GREP_COUNT && !it->failed)
+            printf("%s:%zu\n", it->path, it->matches);
+        free(it->out);
+        it->out = NULL;
+    }
+    pthread_mutex_unlock(&state.print_lock);
+}
+
+static void* grep_worker(void* arg) {
+    (void)arg;
+    usize i;
+    while ((i = atomic_fetch_add(&state.next, 1)) < state.nitems) {
+        Grep_Item* it = &state.items[i];
+        FILE* out = open_memstream(&it->out, &it->out_len);
+        check_alloc(out);
+        it->failed = !grep_item(it, out);
+        fclose(out);
+        atomic_store(&it->done, true);
+        flush_output();
+    }
+    return NULL;
+}
+
+// searches every item, on up to `jobs` threads (the calling thread included)
+static void grep_all(usize jobs) {
+    if (jobs > state.nitems)
+        jobs = state.nitems;
+    run_workers(jobs, grep_worker, NULL);
+}
+
+int grep_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"fixed-strings", no_argument, 0, 'F'},
+        {"ignore-case", no_argument, 0, 'i'},
+        {"files-with-matches", no_argument, 0, 'l'},
+        {"count", no_argument, 0, 'c'},
+        {"jobs", required_argument, 0, 'j'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    bool fixed = false;
+    bool icase = false;
+    usize jobs = 0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "Filcj:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'F': {
+                fixed = true;
+            } break;
+            case 'i': {
+                icase = true;
+            } break;
+            case 'l': {
+                state.mode = GREP_FILES;
+            } break;
+            case 'c': {
+                state.mode = GREP_COUNT;
+            } break;
+            case 'j': {
+                char* end;
+                long l = strtol(optarg, &end, 10);
+                if (*end != '\0' || l < 0)
+                    fatal("invalid number of jobs: \"%s\"", optarg);
+                jobs = (usize)l;
+            } break;
+            case 'h': {
+                puts(GREP_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(GREP_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (optind + 2 > argc) {
+        puts(GREP_HELP);
+        return EXIT_FAILURE;
+    }
+    if (jobs == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = n > 0 ? (usize)n : 1;
+    }
+
+    const char* pattern = argv[optind];
+    if (!pattern[0])
+        fatal("the pattern is empty");
+    if (!icase && (fixed || is_literal(pattern))) {
+        state.literal = pattern;
+        state.literal_len = strlen(pattern);
+    } else {
+        // fixed strings that ignore case are matched as regular expressions,
+        // with every character escaped
+        char* escaped = NULL;
+        if (fixed) {
+            escaped = malloc(2 * strlen(pattern) + 1);
+            check_alloc(escaped);
+            char* d = escaped;
+            for (const char* p = pattern; *p; p++) {
+                if (strchr("\\^$.[]|()*+?{}", *p))
+                    *d++ = '\\';
+                *d++ = *p;
+            }
+            *d = '\0';
+        }
+        int flags = REG_EXTENDED | REG_NEWLINE | (icase ? REG_ICASE : 0);
+        int res = regcomp(&state.re, escaped ? escaped : pattern, flags);
+        free(escaped);
+        if (res != 0) {
+            char msg[128];
+            regerror(res, &state.re, msg, sizeof(msg));
+            fatal("invalid pattern \"%s\": %s (-F searches for it as it is)",
+                  pattern, msg);
+        }
+    }
+
+    for (int i = optind + 1; i < argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+            scan_scripts(argv[i], add_item, NULL);
+        else
+            add_item(argv[i], NULL);
+    }
+
+    grep_all(jobs);
+
+    usize matched = 0;
+    for (usize i = 0; i < state.nitems; i++) {
+        matched += state.items[i].matches > 0;
+        free(state.items[i].path);
+    }
+    free(state.items);
+    if (!state.literal)
+        regfree(&state.re);
+    // like grep(1): fails if nothing matched
+    return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
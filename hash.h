@@ -0,0 +1,48 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: stable (platform independent) 64-bit hashing
+ */
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <string.h>
+
+#define HASH_SEED 0xcbf29ce484222325ull
+
+/**
+ * Hashes a buffer with 64-bit FNV-1a. The result only depends on the bytes,
+ * so it can be stored, or compared between machines.
+ *
+ * @param data the buffer
+ * @param len length of the buffer
+ * @param seed HASH_SEED, or the result of a previous call to continue from
+ */
+static inline u64 hash_bytes(const void* data, usize len, u64 seed) {
+    const u8* p = data;
+    u64 h = seed;
+    for (usize i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/**
+ * Hashes a null-terminated string.
+ */
+static inline u64 hash_str(const char* s) {
+    return hash_bytes(s, strlen(s), HASH_SEED);
+}
+
+#endif // _HASH_H
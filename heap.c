@@ -0,0 +1,799 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: static estimate of the Python heap a script needs on the calculator
+ * (`--heap-check`, `--heap-report`)
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap.h"
+#include "json.h"
+#include "lexer.h"
+
+#define GC_BLOCK 16
+// the header of an object: its type, and the length and room of containers
+#define OBJ_SZ 16
+// lists start out with room for this many items
+#define LIST_MIN_ALLOC 4
+// a rough figure for the bytecode and constant tables, per token
+#define CODE_PER_TOKEN 4
+// the state of a call, without its arguments and locals
+#define FRAME_SZ 48
+// literals smaller than this are counted, but not listed
+#define MIN_FINDING 256
+// int literals beyond this are not taken as counts
+#define MAX_COUNT 1000000000000LL
+
+bool heap_report_enabled = false;
+
+static FILE* report_fp;
+static bool report_failed;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* KIND_NAMES[] = {
+    [HEAP_CODE] = "code",
+    [HEAP_LITERAL] = "literals",
+    [HEAP_MATERIALIZED] = "materialized",
+    [HEAP_GROWTH] = "growth",
+    [HEAP_RECURSION] = "recursion",
+};
+
+// names that can come before a literal, which otherwise would be taken for a
+// subscript
+static const char* KEYWORDS[] = {
+    "and",    "or",    "not", "in",  "is",     "if",   "else",
+    "return", "yield", "lambda", "assert", "await", "del",
+};
+
+// a `for` or `while` loop, or a function
+typedef struct {
+    usize width;
+    bool loop;
+    // iterations of a loop, if known
+    usize iters;
+    bool unknown;
+    // the function, -1 for loops
+    isize def;
+} Block;
+
+typedef struct {
+    const char* name;
+    usize len;
+    usize line;
+    usize params;
+    bool recursive;
+} Def;
+
+// a call with an int literal as its first argument, which is taken as the
+// depth if the function is recursive
+typedef struct {
+    const char* name;
+    usize len;
+    usize arg;
+    // the function it is made from, -1 at the top level
+    isize from;
+} Call;
+
+typedef struct {
+    const char* src;
+    Lexer lex;
+    // the logical line being looked at
+    Token* toks;
+    usize ntoks;
+    usize toks_cap;
+    usize ntotal;
+    Block* blocks;
+    usize nblocks;
+    usize blocks_cap;
+    Def* defs;
+    usize ndefs;
+    usize defs_cap;
+    Call* calls;
+    usize ncalls;
+    usize calls_cap;
+    // the line of the statement being looked at, and where it starts
+    usize line;
+    usize line_pos;
+    Heap_Estimate* res;
+    usize findings_cap;
+} Heap;
+
+// how blocks nest around the statement being looked at
+typedef struct {
+    // iterations of the loops around it, within its function
+    usize iters;
+    bool unknown;
+    bool in_loop;
+    isize def;
+} Context;
+
+#define GROW(arr, n, cap, init)                                                \
+    do {                                                                       \
+        if ((n) == (cap)) {                                                    \
+            (cap) = (cap) ? (cap) * 2 : (init);                                \
+            (arr) = realloc((arr), (cap) * sizeof(*(arr)));                    \
+            check_alloc(arr);                                                  \
+        }                                                                      \
+    } while (0)
+
+static usize sat_add(usize a, usize b) {
+    return a + b < a ? (usize)-1 : a + b;
+}
+
+static usize sat_mul(usize a, usize b) {
+    return b && a > (usize)-1 / b ? (usize)-1 : a * b;
+}
+
+static usize gc_size(usize n) {
+    return n > (usize)-1 - GC_BLOCK ? (usize)-1
+                                    : (n + GC_BLOCK - 1) / GC_BLOCK * GC_BLOCK;
+}
+
+static usize str_size(usize n) {
+    return sat_add(gc_size(OBJ_SZ), gc_size(sat_add(n, 1)));
+}
+
+static usize list_size(usize n) {
+    usize room = n < LIST_MIN_ALLOC ? LIST_MIN_ALLOC : n;
+    return sat_add(gc_size(OBJ_SZ), gc_size(sat_mul(4, room)));
+}
+
+// a list that got to `n` items by appending: its room doubles, and the old
+// items are still there while they are copied over
+static usize grown_list_size(usize n) {
+    usize room = LIST_MIN_ALLOC;
+    while (room < n && room < (usize)-1 / 2)
+        room *= 2;
+    return sat_add(list_size(room), gc_size(sat_mul(2, room)));
+}
+
+// dicts and sets, with a key and a value per slot and at most half of the
+// slots used
+static usize map_size(usize n) {
+    return sat_add(gc_size(OBJ_SZ), gc_size(sat_mul(16, n)));
+}
+
+static void add(Heap* h, Heap_Kind kind, usize bytes) {
+    h->res->kinds[kind] = sat_add(h->res->kinds[kind], bytes);
+}
+
+static void add_finding(Heap* h, Heap_Kind kind, const char* what, usize len,
+                        usize count, usize bytes, bool unknown) {
+    add(h, kind, bytes);
+    bool small = kind == HEAP_LITERAL || kind == HEAP_MATERIALIZED;
+    if (small && !unknown && bytes < MIN_FINDING)
+        return;
+
+    Heap_Estimate* res = h->res;
+    GROW(res->findings, res->nfindings, h->findings_cap, 16);
+    Heap_Finding* f = &res->findings[res->nfindings++];
+    *f = (Heap_Finding){
+        .kind = kind,
+        .line = h->line,
+        .count = unknown ? 0 : count,
+        .bytes = bytes,
+        .unknown = unknown,
+    };
+    snprintf(f->what, sizeof(f->what), "%.*s", (int)len, what);
+    if (unknown)
+        res->nunknown++;
+}
+
+static void finding(Heap* h, Heap_Kind kind, const char* what, usize count,
+                    usize bytes, bool unknown) {
+    add_finding(h, kind, what, strlen(what), count, bytes, unknown);
+}
+
+static bool op(const Heap* h, usize i, char c) {
+    return i < h->ntoks && tok_is_op(&h->lex, h->toks[i], c);
+}
+
+static bool word(const Heap* h, usize i, const char* w) {
+    return i < h->ntoks && tok_is(&h->lex, h->toks[i], w);
+}
+
+static bool is_open(const Heap* h, usize i) {
+    return op(h, i, '(') || op(h, i, '[') || op(h, i, '{');
+}
+
+static bool is_close(const Heap* h, usize i) {
+    return op(h, i, ')') || op(h, i, ']') || op(h, i, '}');
+}
+
+// checks if a token ends an operand, so that a bracket after it is a call or
+// a subscript
+static bool ends_operand(const Heap* h, usize i) {
+    Token t = h->toks[i];
+    if (t.kind == TOK_NUMBER || t.kind == TOK_STRING)
+        return true;
+    if (t.kind == TOK_NAME) {
+        for (usize k = 0; k < LENGTH(KEYWORDS); k++) {
+            if (tok_is(&h->lex, t, KEYWORDS[k]))
+                return false;
+        }
+        return true;
+    }
+    return is_close(h, i);
+}
+
+// reads an int literal at `*i`, with an optional minus sign, and moves past
+// it
+static bool int_at(const Heap* h, usize* i, long long* v) {
+    usize j = *i;
+    bool neg = op(h, j, '-');
+    if (neg)
+        j++;
+    if (j >= h->ntoks || h->toks[j].kind != TOK_NUMBER)
+        return false;
+
+    Token t = h->toks[j];
+    char buf[32];
+    usize n = 0;
+    for (usize k = 0; k < t.len; k++) {
+        char c = h->src[t.start + k];
+        if (c == '_')
+            continue;
+        if (n + 1 >= sizeof(buf))
+            return false;
+        buf[n++] = c;
+    }
+    buf[n] = '\0';
+
+    const char* s = buf;
+    int base = 10;
+    if (n > 2 && buf[0] == '0') {
+        char p = buf[1] | 0x20;
+        base = p == 'x' ? 16 : p == 'o' ? 8 : p == 'b' ? 2 : 10;
+        if (base != 10)
+            s += 2;
+    }
+    char* end;
+    errno = 0;
+    long long x = strtoll(s, &end, base);
+    if (*end != '\0' || end == s || errno || x > MAX_COUNT)
+        return false;
+    *v = neg ? -x : x;
+    *i = j + 1;
+    return true;
+}
+
+// the length of `range(...)` at `*i`, if its arguments are int literals.
+// `*i` is moved past it then.
+static bool range_len(const Heap* h, usize* i, usize* n) {
+    usize j = *i;
+    if (!word(h, j, "range") || !op(h, j + 1, '('))
+        return false;
+    j += 2;
+
+    long long a[3];
+    usize na = 0;
+    while (na < 3 && int_at(h, &j, &a[na])) {
+        na++;
+        if (!op(h, j, ','))
+            break;
+        j++;
+    }
+    if (na == 0 || !op(h, j, ')'))
+        return false;
+
+    long long start = na > 1 ? a[0] : 0;
+    long long stop = na > 1 ? a[1] : a[0];
+    long long step = na > 2 ? a[2] : 1;
+    if (step == 0)
+        return false;
+    long long len = step > 0 ? (stop - start + step - 1) / step
+                             : (start - stop - step - 1) / -step;
+    *n = len > 0 ? (usize)len : 0;
+    *i = j + 1;
+    return true;
+}
+
+// finds the bracket that closes the one at `i` and counts the items within.
+// `comp` is set to where the `for` of a comprehension is, 0 if it is none.
+static usize close_of(const Heap* h, usize i, usize* items, usize* comp) {
+    usize depth = 0;
+    usize n = 0;
+    bool any = false;
+    bool trailing = false;
+    *comp = 0;
+    usize j = i;
+    for (; j < h->ntoks; j++) {
+        if (is_open(h, j)) {
+            depth++;
+        } else if (is_close(h, j)) {
+            if (--depth == 0)
+                break;
+        } else if (depth == 1 && op(h, j, ',')) {
+            n++;
+            trailing = true;
+            continue;
+        } else if (depth == 1 && !*comp && word(h, j, "for")) {
+            *comp = j;
+        }
+        if (j > i) {
+            any = true;
+            trailing = false;
+        }
+    }
+    *items = any ? n + !trailing : n;
+    return j;
+}
+
+// the iterations of a comprehension, with the `for` clauses at `j` within
+// the brackets closed at `close`
+static bool comp_iters(const Heap* h, usize j, usize close, usize* n) {
+    usize depth = 0;
+    *n = 1;
+    for (; j < close; j++) {
+        if (is_open(h, j)) {
+            depth++;
+        } else if (is_close(h, j)) {
+            depth--;
+        } else if (depth == 0 && word(h, j, "in")) {
+            usize k = j + 1;
+            usize len;
+            if (!range_len(h, &k, &len))
+                return false;
+            *n = sat_mul(*n, len);
+        }
+    }
+    return true;
+}
+
+static Context context(const Heap* h) {
+    Context c = {.iters = 1, .def = -1};
+    for (usize i = h->nblocks; i-- > 0;) {
+        const Block* b = &h->blocks[i];
+        if (!b->loop) {
+            c.def = b->def;
+            break;
+        }
+        c.in_loop = true;
+        c.unknown |= b->unknown;
+        c.iters = sat_mul(c.iters, b->iters);
+    }
+    return c;
+}
+
+// a list, dict or set literal, or a comprehension, at `i`
+static void note_literal(Heap* h, usize i) {
+    usize items, comp;
+    usize close = close_of(h, i, &items, &comp);
+    bool list = op(h, i, '[');
+
+    if (comp) {
+        usize n;
+        bool known = comp_iters(h, comp, close, &n);
+        usize bytes = 0;
+        if (known)
+            bytes = list ? grown_list_size(n) : map_size(n);
+        finding(h, HEAP_MATERIALIZED, "comprehension", n, bytes, !known);
+        return;
+    }
+
+    // [x] * N and N * [x]
+    long long times;
+    usize k = close + 2;
+    bool repeated = list && op(h, close + 1, '*') && int_at(h, &k, &times);
+    if (list && !repeated && i >= 2 && op(h, i - 1, '*')) {
+        k = i - 2;
+        repeated = int_at(h, &k, &times) && k == i - 1;
+        if (repeated && i >= 3 && ends_operand(h, i - 3))
+            repeated = false;
+    }
+    if (repeated) {
+        usize n = sat_mul(items, times > 0 ? (usize)times : 0);
+        finding(h, HEAP_MATERIALIZED, "[...] * N", n, list_size(n), false);
+        return;
+    }
+
+    finding(h, HEAP_LITERAL, list ? "list literal" : "dict literal", items,
+            list ? list_size(items) : map_size(items), false);
+}
+
+// the length of a string literal, without its prefix and quotes (escapes
+// are taken as they are written)
+static usize str_len(const Heap* h, usize i) {
+    Token t = h->toks[i];
+    const char* s = &h->src[t.start];
+    usize q = 0;
+    while (s[q] != '\'' && s[q] != '"')
+        q++;
+    bool triple = t.len >= q + 6 && s[q + 1] == s[q] && s[q + 2] == s[q];
+    return t.len - q - (triple ? 6 : 2);
+}
+
+static void note_string(Heap* h, usize i) {
+    usize len = str_len(h, i);
+
+    long long times;
+    usize k = i + 2;
+    if (op(h, i + 1, '*') && int_at(h, &k, &times)) {
+        usize n = sat_mul(len, times > 0 ? (usize)times : 0);
+        finding(h, HEAP_MATERIALIZED, "str * N", n, str_size(n), false);
+    } else {
+        finding(h, HEAP_LITERAL, "str literal", len, str_size(len), false);
+    }
+}
+
+static bool is_float(const Heap* h, Token t) {
+    const char* s = &h->src[t.start];
+    if (t.len > 1 && s[0] == '0' && (s[1] | 0x20) == 'x')
+        return false;
+    for (usize k = 0; k < t.len; k++) {
+        char c = s[k] | 0x20;
+        if (s[k] == '.' || c == 'e' || c == 'j')
+            return true;
+    }
+    return false;
+}
+
+// method calls that grow a container, in a loop
+static void note_growth(Heap* h, usize i, const Context* c) {
+    Token m = h->toks[i];
+    const char* name = &h->src[m.start];
+    bool set = word(h, i, "add");
+    usize per = 1;
+    bool unknown = c->unknown;
+    if (word(h, i, "extend")) {
+        usize k = i + 2;
+        usize comp;
+        if (op(h, k, '[')) {
+            close_of(h, k, &per, &comp);
+            unknown |= comp != 0;
+        } else if (!range_len(h, &k, &per)) {
+            unknown = true;
+        }
+    }
+
+    usize n = sat_mul(c->iters, per);
+    usize bytes = 0;
+    if (!unknown)
+        bytes = set ? map_size(n) : grown_list_size(n);
+    add_finding(h, HEAP_GROWTH, name, m.len, n, bytes, unknown);
+}
+
+// `x += [...]` and `x += "..."` in a loop
+static void note_concat(Heap* h, usize i, const Context* c) {
+    usize per = 0;
+    usize comp = 0;
+    bool list = op(h, i, '[');
+    if (list)
+        close_of(h, i, &per, &comp);
+    else
+        per = str_len(h, i);
+
+    bool unknown = c->unknown || comp;
+    usize n = sat_mul(c->iters, per);
+    usize bytes = 0;
+    // a string is copied on every step, so the old one is still there when
+    // the new one is made
+    if (!unknown)
+        bytes = list ? grown_list_size(n) : sat_mul(2, str_size(n));
+    finding(h, HEAP_GROWTH, list ? "+= [...]" : "+= str", n, bytes, unknown);
+}
+
+static void note_call(Heap* h, usize i, const Context* c) {
+    Token t = h->toks[i];
+    const char* name = &h->src[t.start];
+    bool method = i > 0 && op(h, i - 1, '.');
+    bool self = method && i > 1 && word(h, i - 2, "self");
+
+    if (c->def >= 0 && (!method || self)) {
+        Def* d = &h->defs[c->def];
+        if (d->len == t.len && !memcmp(d->name, name, t.len))
+            d->recursive = true;
+    }
+
+    long long arg;
+    usize k = i + 2;
+    if (!method && int_at(h, &k, &arg) && arg > 0 &&
+        (op(h, k, ',') || op(h, k, ')'))) {
+        GROW(h->calls, h->ncalls, h->calls_cap, 16);
+        h->calls[h->ncalls++] = (Call){
+            .name = name,
+            .len = t.len,
+            .arg = (usize)arg,
+            .from = c->def,
+        };
+    }
+}
+
+static void note_name(Heap* h, usize i, const Context* c) {
+    static const char* MATERIALIZE[] = {"list", "tuple", "sorted", "set"};
+    static const char* GROWING[] = {"append", "insert", "extend", "add"};
+
+    if (!op(h, i + 1, '('))
+        return;
+    bool method = i > 0 && op(h, i - 1, '.');
+
+    for (usize k = 0; !method && k < LENGTH(MATERIALIZE); k++) {
+        usize j = i + 2;
+        usize n;
+        if (tok_is(&h->lex, h->toks[i], MATERIALIZE[k]) &&
+            range_len(h, &j, &n)) {
+            bool set = k == 3;
+            const char* what = set ? "set(range())" : "list(range())";
+            finding(h, HEAP_MATERIALIZED, what, n,
+                    set ? map_size(n) : grown_list_size(n), false);
+            return;
+        }
+    }
+
+    long long n;
+    usize j = i + 2;
+    if (!method && (word(h, i, "bytearray") || word(h, i, "bytes")) &&
+        int_at(h, &j, &n) && op(h, j, ')')) {
+        usize len = n > 0 ? (usize)n : 0;
+        finding(h, HEAP_MATERIALIZED, "bytearray(N)", len, str_size(len),
+                false);
+        return;
+    }
+
+    for (usize k = 0; method && c->in_loop && k < LENGTH(GROWING); k++) {
+        if (tok_is(&h->lex, h->toks[i], GROWING[k])) {
+            note_growth(h, i, c);
+            return;
+        }
+    }
+
+    note_call(h, i, c);
+}
+
+// looks at the tokens `from` to `to` of the line
+static void scan(Heap* h, usize from, usize to) {
+    Context c = context(h);
+
+    // docstrings, and other statements that are just a string, are dropped
+    // by the compiler
+    bool just_strings = true;
+    for (usize i = from; i < to && just_strings; i++)
+        just_strings = h->toks[i].kind == TOK_STRING;
+    if (just_strings)
+        return;
+
+    for (usize i = from; i < to; i++) {
+        Token t = h->toks[i];
+        if (t.kind == TOK_STRING) {
+            note_string(h, i);
+        } else if (t.kind == TOK_NUMBER) {
+            if (is_float(h, t))
+                add(h, HEAP_LITERAL, gc_size(OBJ_SZ));
+        } else if ((op(h, i, '[') || op(h, i, '{')) &&
+                   (i == from || !ends_operand(h, i - 1))) {
+            note_literal(h, i);
+        } else if (t.kind == TOK_NAME) {
+            bool stmt = i == from || op(h, i - 1, ';');
+            if (stmt && c.in_loop && op(h, i + 1, '+') && op(h, i + 2, '=') &&
+                (op(h, i + 3, '[') ||
+                 (i + 3 < to && h->toks[i + 3].kind == TOK_STRING)))
+                note_concat(h, i + 3, &c);
+            note_name(h, i, &c);
+        }
+    }
+}
+
+// where the `:` of a compound statement's header is, starting at `i`
+static usize header_end(const Heap* h, usize i) {
+    usize depth = 0;
+    for (; i < h->ntoks; i++) {
+        if (is_open(h, i))
+            depth++;
+        else if (is_close(h, i) && depth > 0)
+            depth--;
+        else if (depth == 0 && op(h, i, ':'))
+            return i;
+    }
+    return h->ntoks;
+}
+
+// opens the block of a `for`, `while` or `def` whose header starts at `k`
+static void push_block(Heap* h, usize k, usize width) {
+    Block b = {.width = width, .loop = true, .iters = 1, .def = -1};
+    if (word(h, k, "while")) {
+        b.unknown = true;
+    } else if (word(h, k, "for")) {
+        usize depth = 0;
+        b.unknown = true;
+        for (usize i = k + 1; i < h->ntoks; i++) {
+            if (is_open(h, i)) {
+                depth++;
+            } else if (is_close(h, i)) {
+                depth--;
+            } else if (depth == 0 && word(h, i, "in")) {
+                usize j = i + 1;
+                b.unknown = !range_len(h, &j, &b.iters) || !op(h, j, ':');
+                break;
+            }
+        }
+        if (b.unknown)
+            b.iters = 1;
+    } else {
+        Token name = h->toks[k + 1];
+        usize params = 0;
+        usize comp;
+        if (op(h, k + 2, '('))
+            close_of(h, k + 2, &params, &comp);
+        GROW(h->defs, h->ndefs, h->defs_cap, 16);
+        h->defs[h->ndefs] = (Def){
+            .name = &h->src[name.start],
+            .len = name.len,
+            .line = h->line,
+            .params = params,
+        };
+        b.loop = false;
+        b.def = (isize)h->ndefs++;
+    }
+
+    GROW(h->blocks, h->nblocks, h->blocks_cap, 16);
+    h->blocks[h->nblocks++] = b;
+}
+
+// reads the tokens of the logical line at `pos`
+static bool read_line(Heap* h, usize pos) {
+    h->lex.pos = pos;
+    h->lex.depth = 0;
+    h->ntoks = 0;
+    for (;;) {
+        Token t = lex_next(&h->lex);
+        if (t.kind == TOK_ERROR)
+            return false;
+        h->ntotal++;
+        if (t.kind == TOK_END || t.kind == TOK_NEWLINE)
+            return true;
+        GROW(h->toks, h->ntoks, h->toks_cap, 64);
+        h->toks[h->ntoks++] = t;
+    }
+}
+
+static bool heap_scan(Heap* h, usize len) {
+    const char* src = h->src;
+    usize pos = 0;
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            pos = p;
+            continue;
+        }
+
+        for (; h->line_pos < p; h->line_pos++) {
+            if (src[h->line_pos] == '\n')
+                h->line++;
+        }
+        if (!read_line(h, p))
+            return false;
+        pos = h->lex.pos;
+
+        while (h->nblocks && h->blocks[h->nblocks - 1].width >= width)
+            h->nblocks--;
+
+        usize k = word(h, 0, "async") ? 1 : 0;
+        bool def = word(h, k, "def") && k + 1 < h->ntoks;
+        if (!def && !word(h, k, "for") && !word(h, k, "while")) {
+            scan(h, 0, h->ntoks);
+            continue;
+        }
+
+        // the header belongs to the block around it, whatever comes after
+        // the `:` to the new one
+        usize colon = header_end(h, k);
+        scan(h, 0, colon);
+        push_block(h, k, width);
+        if (colon < h->ntoks)
+            scan(h, colon + 1, h->ntoks);
+    }
+    return true;
+}
+
+bool heap_estimate(const char* src, usize len, Heap_Estimate* res) {
+    *res = (Heap_Estimate){0};
+    Heap h = {
+        .src = src,
+        .lex = {.src = src, .len = len},
+        .line = 1,
+        .res = res,
+    };
+
+    bool ok = heap_scan(&h, len);
+    if (ok) {
+        add(&h, HEAP_CODE, sat_mul(h.ntotal, CODE_PER_TOKEN));
+
+        for (usize d = 0; d < h.ndefs; d++) {
+            const Def* def = &h.defs[d];
+            if (!def->recursive)
+                continue;
+            // the deepest call from elsewhere, taking every level to go one
+            // down
+            usize depth = 0;
+            for (usize i = 0; i < h.ncalls; i++) {
+                const Call* c = &h.calls[i];
+                if (c->from != (isize)d && c->len == def->len &&
+                    !memcmp(c->name, def->name, def->len) && c->arg > depth)
+                    depth = c->arg;
+            }
+            usize frame = gc_size(FRAME_SZ + 4 * def->params);
+            h.line = def->line;
+            add_finding(&h, HEAP_RECURSION, def->name, def->len, depth,
+                        sat_mul(frame, depth), depth == 0);
+        }
+
+        for (usize k = 0; k < HEAP_NKINDS; k++)
+            res->bytes = sat_add(res->bytes, res->kinds[k]);
+    } else {
+        heap_estimate_free(res);
+    }
+
+    free(h.toks);
+    free(h.blocks);
+    free(h.defs);
+    free(h.calls);
+    return ok;
+}
+
+void heap_estimate_free(Heap_Estimate* res) {
+    free(res->findings);
+    *res = (Heap_Estimate){0};
+}
+
+bool heap_report_open(const char* path) {
+    report_fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!report_fp)
+        return false;
+    heap_report_enabled = true;
+    return true;
+}
+
+void heap_report_record(const char* input, const Heap_Estimate* res,
+                        usize limit) {
+    if (!heap_report_enabled)
+        return;
+
+    pthread_mutex_lock(&report_lock);
+    FILE* fp = report_fp;
+    fputs("{\"input\":", fp);
+    json_write_string(fp, input);
+    fprintf(fp, ",\"bytes\":%zu,\"limit\":%zu,\"fits\":%s", res->bytes, limit,
+            res->bytes <= limit ? "true" : "false");
+    for (usize k = 0; k < HEAP_NKINDS; k++)
+        fprintf(fp, ",\"%s\":%zu", KIND_NAMES[k], res->kinds[k]);
+    fputs(",\"findings\":[", fp);
+    for (usize i = 0; i < res->nfindings; i++) {
+        const Heap_Finding* f = &res->findings[i];
+        fprintf(fp, "%s{\"kind\":\"%s\",\"line\":%zu,\"what\":", i ? "," : "",
+                KIND_NAMES[f->kind], f->line);
+        json_write_string(fp, f->what);
+        fprintf(fp, ",\"count\":%zu,\"bytes\":%zu,\"unknown\":%s}", f->count,
+                f->bytes, f->unknown ? "true" : "false");
+    }
+    fputs("]}\n", fp);
+    if (fflush(fp) != 0)
+        report_failed = true;
+    pthread_mutex_unlock(&report_lock);
+}
+
+bool heap_report_close(void) {
+    if (!heap_report_enabled)
+        return true;
+
+    bool ok = !report_failed && !ferror(report_fp);
+    if (report_fp == stdout)
+        ok = fflush(stdout) == 0 && ok;
+    else
+        ok = fclose(report_fp) == 0 && ok;
+    report_fp = NULL;
+    heap_report_enabled = false;
+    return ok;
+}
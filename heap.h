@@ -0,0 +1,122 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: static estimate of the Python heap a script needs on the calculator
+ * (`--heap-check`, `--heap-report`)
+ */
+
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/*
+ * The estimate is made from the tokens alone, with the object sizes of
+ * MicroPython on a 32-bit target (which the calculator's Python is built on):
+ * small ints are free, everything else takes whole 16 byte GC blocks, and
+ * lists double their room as they grow. It adds up everything the script
+ * creates, as if nothing was ever freed, so it errs on the high side, except
+ * where sizes depend on what the script reads or computes. Those findings
+ * are marked `unknown`.
+ *
+ * `--heap-report` writes one JSON object per line, per script:
+ *
+ *   {"input":"a.py","bytes":5120,"limit":17408,"fits":true,"code":1200,
+ *    "literals":400,"materialized":3520,"growth":0,"recursion":0,
+ *    "findings":[{"kind":"materialized","line":3,"what":"list(range())",
+ *    "count":800,"bytes":3520,"unknown":false}]}
+ */
+
+// roughly the free Python heap of a TI-84 Plus CE Python after starting
+#define HEAP_DEFAULT_LIMIT (17 * 1024)
+
+typedef enum {
+    // the compiled code of the script
+    HEAP_CODE = 0,
+    // string, float and container literals
+    HEAP_LITERAL,
+    // ranges turned into lists, repeated lists and strings, comprehensions
+    HEAP_MATERIALIZED,
+    // containers that are appended to in loops
+    HEAP_GROWTH,
+    // the frames of recursive functions
+    HEAP_RECURSION,
+    HEAP_NKINDS,
+} Heap_Kind;
+
+typedef struct {
+    Heap_Kind kind;
+    usize line;
+    // what was found, e.g. "append" or the name of a recursive function
+    char what[24];
+    // elements, iterations or depth of recursion, 0 if unknown
+    usize count;
+    usize bytes;
+    // the count depends on what the script does at run time
+    bool unknown;
+} Heap_Finding;
+
+typedef struct {
+    usize bytes;
+    usize kinds[HEAP_NKINDS];
+    Heap_Finding* findings;
+    usize nfindings;
+    // findings that are unknown
+    usize nunknown;
+} Heap_Estimate;
+
+/**
+ * Estimates the peak Python heap usage of a script.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param res the estimate, free it with `heap_estimate_free`
+ * @return false if the source could not be tokenized (e.g. an unterminated
+ * string). `res` is left empty then.
+ */
+bool heap_estimate(const char* src, usize len, Heap_Estimate* res);
+
+/**
+ * Frees the findings of an estimate.
+ */
+void heap_estimate_free(Heap_Estimate* res);
+
+// set once before any worker starts, read-only afterwards.
+extern bool heap_report_enabled;
+
+/**
+ * Opens the report stream and enables recording.
+ *
+ * @param path path to the file (truncated if it exists), `-` for stdout
+ * @return false if the file could not be opened (errno is set)
+ */
+bool heap_report_open(const char* path);
+
+/**
+ * Writes the estimate of a script to the report. Safe to call from any
+ * thread.
+ *
+ * @param input path of the script
+ * @param res the estimate
+ * @param limit the heap it should fit in
+ */
+void heap_report_record(const char* input, const Heap_Estimate* res,
+                        usize limit);
+
+/**
+ * Closes the report stream.
+ *
+ * @return false if any record could not be written
+ */
+bool heap_report_close(void);
+
+#endif // _HEAP_H
@@ -0,0 +1,301 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "journal.h"
+
+// records are synced to disk once this many were appended
+#define JOURNAL_SYNC_EVERY 256
+
+typedef struct {
+    char* path;
+    u64 hash;
+    bool ok;
+} Journal_Entry;
+
+bool journal_enabled = false;
+
+static int journal_fd = -1;
+static bool journal_failed = false;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static usize unsynced = 0;
+
+// the loaded records, keyed by input path (open addressing, linear probing)
+static Journal_Entry* table = NULL;
+static usize table_cap = 0;
+static usize table_len = 0;
+
+static Journal_Entry* table_slot(Journal_Entry* t, usize cap,
+                                 const char* path) {
+    usize i = hash_str(path) & (cap - 1);
+    while (t[i].path && strcmp(t[i].path, path))
+        i = (i + 1) & (cap - 1);
+    return &t[i];
+}
+
+static void table_grow(void) {
+    usize cap = table_cap ? table_cap * 2 : 1024;
+    Journal_Entry* t = calloc(cap, sizeof(Journal_Entry));
+    check_alloc(t);
+    for (usize i = 0; i < table_cap; i++) {
+        if (table[i].path)
+            *table_slot(t, cap, table[i].path) = table[i];
+    }
+    free(table);
+    table = t;
+    table_cap = cap;
+}
+
+// takes ownership of `path`. Later records replace earlier ones.
+static void table_put(char* path, u64 hash, bool ok) {
+    if ((table_len + 1) * 2 > table_cap)
+        table_grow();
+
+    Journal_Entry* e = table_slot(table, table_cap, path);
+    if (e->path) {
+        free(path);
+    } else {
+        e->path = path;
+        table_len++;
+    }
+    e->hash = hash;
+    e->ok = ok;
+}
+
+// unescapes a field in place. Returns false on an invalid escape.
+static bool unescape(char* s) {
+    char* out = s;
+    for (; *s; s++) {
+        if (*s != '\\') {
+            *out++ = *s;
+            continue;
+        }
+        switch (*++s) {
+            case 't': *out++ = '\t'; break;
+            case 'n': *out++ = '\n'; break;
+            case '\\': *out++ = '\\'; break;
+            default: return false;
+        }
+    }
+    *out = '\0';
+    return true;
+}
+
+// appends an escaped field. Returns false if it doesn't fit.
+static bool escape(char* buf, usize sz, usize* len, const char* s) {
+    for (; *s; s++) {
+        char esc = 0;
+        if (*s == '\t')
+            esc = 't';
+        else if (*s == '\n')
+            esc = 'n';
+        else if (*s == '\\')
+            esc = '\\';
+
+        if (*len + 2 >= sz)
+            return false;
+        if (esc) {
+            buf[(*len)++] = '\\';
+            buf[(*len)++] = esc;
+        } else {
+            buf[(*len)++] = *s;
+        }
+    }
+    return true;
+}
+
+// parses a record (without its newline) and passes it to `fn`. Returns false
+// if the record is malformed.
+static bool parse_record(char* line, Journal_Fn fn, void* ctx) {
+    char* fields[4];
+    for (usize i = 0; i < 4; i++) {
+        fields[i] = line;
+        char* tab = strchr(line, '\t');
+        if (i < 3) {
+            if (!tab)
+                return false;
+            *tab = '\0';
+            line = tab + 1;
+        }
+    }
+
+    char* end;
+    u64 hash = strtoull(fields[0], &end, 16);
+    if (end - fields[0] != 16 || *end != '\0')
+        return false;
+
+    bool ok;
+    if (!strcmp(fields[1], "ok"))
+        ok = true;
+    else if (!strcmp(fields[1], "error"))
+        ok = false;
+    else
+        return false;
+
+    if (!unescape(fields[2]) || fields[2][0] == '\0' || !unescape(fields[3]))
+        return false;
+
+    fn(fields[2], hash, fields[3], ok, ctx);
+    return true;
+}
+
+// reads the records of a journal. `*torn` is set if the last record is
+// incomplete.
+static bool read_records(const char* path, Journal_Fn fn, void* ctx,
+                         bool* torn) {
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return false;
+
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    usize bad = 0;
+    while ((n = getline(&line, &cap, fp)) > 0) {
+        if (line[n - 1] != '\n') {
+            *torn = true;
+            break;
+        }
+        line[n - 1] = '\0';
+        if (!parse_record(line, fn, ctx))
+            bad++;
+    }
+
+    bool failed = ferror(fp);
+    free(line);
+    fclose(fp);
+    if (bad)
+        warn("ignored %zu malformed record(s) in journal \"%s\"", bad, path);
+    return !failed;
+}
+
+bool journal_read(const char* path, Journal_Fn fn, void* ctx) {
+    bool torn = false;
+    return read_records(path, fn, ctx, &torn);
+}
+
+static void load_record(const char* in_path, u64 hash, const char* out_path,
+                        bool ok, void* ctx) {
+    (void)out_path;
+    (void)ctx;
+    char* path = strdup(in_path);
+    check_alloc(path);
+    table_put(path, hash, ok);
+}
+
+bool journal_open(const char* path) {
+    bool torn = false;
+    if (!read_records(path, load_record, NULL, &torn) && errno != ENOENT)
+        return false;
+
+    journal_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (journal_fd < 0)
+        return false;
+
+    // start on a fresh line, the torn record stays malformed
+    if (torn && write(journal_fd, "\n", 1) != 1) {
+        close(journal_fd);
+        journal_fd = -1;
+        return false;
+    }
+
+    journal_enabled = true;
+    return true;
+}
+
+bool journal_is_done(const char* in_path, u64 hash) {
+    if (!table)
+        return false;
+
+    const Journal_Entry* e = table_slot(table, table_cap, in_path);
+    return e->path && e->ok && e->hash == hash;
+}
+
+// syncs the journal. Must be called with `journal_lock` held.
+static void journal_sync_locked(void) {
+    if (unsynced == 0)
+        return;
+    if (fdatasync(journal_fd) != 0 && !journal_failed) {
+        warn("could not sync the journal: \"%s\"", strerror(errno));
+        journal_failed = true;
+    }
+    unsynced = 0;
+}
+
+usize journal_format(char* buf, usize sz, const char* in_path, u64 hash,
+                     const char* out_path, bool ok) {
+    usize len = (usize)snprintf(buf, sz, "%016llx\t%s\t",
+                                (unsigned long long)hash, ok ? "ok" : "error");
+    if (len >= sz || !escape(buf, sz, &len, in_path))
+        return 0;
+    buf[len++] = '\t';
+    if (!escape(buf, sz, &len, out_path ? out_path : ""))
+        return 0;
+    buf[len++] = '\n';
+    return len;
+}
+
+void journal_record(const char* in_path, u64 hash, const char* out_path,
+                    bool ok) {
+    char line[JOURNAL_LINE_SZ];
+    usize len = journal_format(line, sizeof(line), in_path, hash, out_path, ok);
+    if (len == 0) {
+        warn("path too long for the journal: \"%s\"", in_path);
+        return;
+    }
+
+    pthread_mutex_lock(&journal_lock);
+    // O_APPEND: every record goes out in one piece
+    if (write(journal_fd, line, len) != (ssize_t)len && !journal_failed) {
+        warn("could not write to the journal: \"%s\"", strerror(errno));
+        journal_failed = true;
+    }
+    if (++unsynced >= JOURNAL_SYNC_EVERY)
+        journal_sync_locked();
+    pthread_mutex_unlock(&journal_lock);
+}
+
+void journal_sync(void) {
+    if (!journal_enabled)
+        return;
+    pthread_mutex_lock(&journal_lock);
+    journal_sync_locked();
+    pthread_mutex_unlock(&journal_lock);
+}
+
+bool journal_close(void) {
+    if (!journal_enabled)
+        return true;
+
+    journal_sync();
+    if (close(journal_fd) != 0)
+        journal_failed = true;
+    journal_fd = -1;
+    journal_enabled = false;
+
+    for (usize i = 0; i < table_cap; i++)
+        free(table[i].path);
+    free(table);
+    table = NULL;
+    table_cap = table_len = 0;
+
+    return !journal_failed;
+}
@@ -0,0 +1,102 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: append-only completion journal, for resuming batches (`--journal`)
+ */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <limits.h>
+#include <stdbool.h>
+
+/*
+ * One record per line, with tab separated fields:
+ *
+ *   <input hash, 16 hex digits> <result: ok|error> <input path> <output path>
+ *
+ * Tabs, newlines and backslashes in paths are escaped with a backslash. A
+ * record that was cut short by a crash is ignored when the journal is loaded.
+ */
+
+// set once before any worker starts, read-only afterwards.
+extern bool journal_enabled;
+
+// longest possible record: two escaped paths, the hash and the result
+#define JOURNAL_LINE_SZ (4 * PATH_MAX + 32)
+
+typedef void (*Journal_Fn)(const char* in_path, u64 hash, const char* out_path,
+                           bool ok, void* ctx);
+
+/**
+ * Reads every record of a journal, in order. Malformed records are skipped
+ * (with a warning).
+ *
+ * @param path path to the journal
+ * @param fn called for every record
+ * @param ctx passed to `fn`
+ * @return false if the journal can't be read
+ */
+bool journal_read(const char* path, Journal_Fn fn, void* ctx);
+
+/**
+ * Formats a record, including its newline.
+ *
+ * @param buf the destination
+ * @param sz size of `buf`, JOURNAL_LINE_SZ always suffices
+ * @return length of the record, or 0 if it doesn't fit
+ */
+usize journal_format(char* buf, usize sz, const char* in_path, u64 hash,
+                     const char* out_path, bool ok);
+
+/**
+ * Loads the records of an existing journal (if any), and opens it for
+ * appending.
+ *
+ * @param path path to the journal
+ * @return false if the journal can't be read or opened
+ */
+bool journal_open(const char* path);
+
+/**
+ * Checks whether an input was already converted successfully, from the same
+ * contents.
+ *
+ * @param in_path the input path, as given on the command line
+ * @param hash hash of the input's contents
+ */
+bool journal_is_done(const char* in_path, u64 hash);
+
+/**
+ * Appends a record. Thread safe. Records are synced to disk in batches.
+ *
+ * @param in_path the input path
+ * @param hash hash of the input's contents
+ * @param out_path the output path, may be NULL
+ * @param ok whether the conversion succeeded
+ */
+void journal_record(const char* in_path, u64 hash, const char* out_path,
+                    bool ok);
+
+/**
+ * Syncs all records appended so far to disk.
+ */
+void journal_sync(void);
+
+/**
+ * Syncs and closes the journal.
+ *
+ * @return false if the journal could not be written out
+ */
+bool journal_close(void);
+
+#endif // _JOURNAL_H
@@ -0,0 +1,46 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: JSON output helpers
+ */
+
+#ifndef _JSON_H
+#define _JSON_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdio.h>
+
+/**
+ * Writes a string as a quoted and escaped JSON string.
+ *
+ * @param fp the stream
+ * @param s the string, may be NULL (written as `null`)
+ */
+static inline void json_write_string(FILE* fp, const char* s) {
+    if (!s) {
+        fputs("null", fp);
+        return;
+    }
+
+    fputc('"', fp);
+    for (; *s; s++) {
+        u8 c = (u8)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+#endif // _JSON_H
@@ -0,0 +1,208 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#include <string.h>
+
+#include "hash.h"
+#include "lexer.h"
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool lex_is_word(char c) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           is_digit(c) || (u8)c >= 0x80;
+}
+
+static bool is_quote(char c) {
+    return c == '\'' || c == '"';
+}
+
+static bool is_newline(char c) {
+    return c == '\n' || c == '\r';
+}
+
+// r, u, b, f, and the two letter combinations of r with b and f
+static bool is_prefix(const char* s, usize len) {
+    char a = s[0] | 0x20;
+    if (len == 1)
+        return a == 'r' || a == 'u' || a == 'b' || a == 'f';
+    if (len != 2)
+        return false;
+    char b = s[1] | 0x20;
+    return (a == 'r' && (b == 'b' || b == 'f')) ||
+           ((a == 'b' || a == 'f') && b == 'r');
+}
+
+// skips the string literal whose opening quote is at the current position
+static bool lex_string(Lexer* l) {
+    const char* s = l->src;
+    char q = s[l->pos];
+    bool triple = l->pos + 2 < l->len && s[l->pos + 1] == q &&
+                  s[l->pos + 2] == q;
+    l->pos += triple ? 3 : 1;
+
+    while (l->pos < l->len) {
+        char c = s[l->pos];
+        if (c == '\\') {
+            l->pos += 2;
+            continue;
+        }
+        if (c == q) {
+            if (!triple) {
+                l->pos++;
+                return true;
+            }
+            if (l->pos + 2 < l->len && s[l->pos + 1] == q &&
+                s[l->pos + 2] == q) {
+                l->pos += 3;
+                return true;
+            }
+        } else if (!triple && is_newline(c)) {
+            return false;
+        }
+        l->pos++;
+    }
+    return false;
+}
+
+static void skip_newline(const char* s, usize len, usize* pos) {
+    if (s[(*pos)++] == '\r' && *pos < len && s[*pos] == '\n')
+        (*pos)++;
+}
+
+Token lex_next(Lexer* l) {
+    Token t = {0};
+    const char* s = l->src;
+
+    // whitespace, comments, line continuations and line breaks in brackets
+    while (l->pos < l->len) {
+        char c = s[l->pos];
+        if (c == ' ' || c == '\t' || c == '\f') {
+            l->pos++;
+        } else if (c == '\\' && l->pos + 1 < l->len &&
+                   is_newline(s[l->pos + 1])) {
+            l->pos++;
+            skip_newline(s, l->len, &l->pos);
+        } else if (c == '#') {
+            while (l->pos < l->len && !is_newline(s[l->pos]))
+                l->pos++;
+            continue;
+        } else if (is_newline(c) && l->depth > 0) {
+            skip_newline(s, l->len, &l->pos);
+        } else {
+            break;
+        }
+        t.spaced = true;
+    }
+
+    t.start = l->pos;
+    if (l->pos >= l->len)
+        return t;
+
+    char c = s[l->pos];
+    if (is_newline(c)) {
+        skip_newline(s, l->len, &l->pos);
+        t.kind = TOK_NEWLINE;
+    } else if (is_digit(c) ||
+               (c == '.' && l->pos + 1 < l->len && is_digit(s[l->pos + 1]))) {
+        // an exponent's sign belongs to the number, unless it is hex
+        bool hex = c == '0' && l->pos + 1 < l->len &&
+                   (s[l->pos + 1] | 0x20) == 'x';
+        for (l->pos++; l->pos < l->len; l->pos++) {
+            char d = s[l->pos];
+            bool sign = (d == '+' || d == '-') && !hex &&
+                        (s[l->pos - 1] | 0x20) == 'e';
+            if (!lex_is_word(d) && d != '.' && !sign)
+                break;
+        }
+        t.kind = TOK_NUMBER;
+    } else if (lex_is_word(c)) {
+        while (l->pos < l->len && lex_is_word(s[l->pos]))
+            l->pos++;
+        if (l->pos < l->len && is_quote(s[l->pos]) &&
+            is_prefix(&s[t.start], l->pos - t.start))
+            t.kind = lex_string(l) ? TOK_STRING : TOK_ERROR;
+        else
+            t.kind = TOK_NAME;
+    } else if (is_quote(c)) {
+        t.kind = lex_string(l) ? TOK_STRING : TOK_ERROR;
+    } else {
+        if (c == '(' || c == '[' || c == '{')
+            l->depth++;
+        else if ((c == ')' || c == ']' || c == '}') && l->depth > 0)
+            l->depth--;
+        l->pos++;
+        t.kind = TOK_OP;
+    }
+
+    t.len = l->pos - t.start;
+    return t;
+}
+
+bool tok_is(const Lexer* l, Token t, const char* word) {
+    usize len = strlen(word);
+    return t.kind == TOK_NAME && t.len == len &&
+           !memcmp(&l->src[t.start], word, len);
+}
+
+bool tok_is_op(const Lexer* l, Token t, char op) {
+    return t.kind == TOK_OP && l->src[t.start] == op;
+}
+
+bool tok_is_fstring(const Lexer* l, Token t) {
+    for (usize i = t.start; !is_quote(l->src[i]); i++) {
+        if ((l->src[i] | 0x20) == 'f')
+            return true;
+    }
+    return false;
+}
+
+u64 tok_hash(const Lexer* l, Token t) {
+    return hash_bytes(&l->src[t.start], t.len, HASH_SEED);
+}
+
+// measures the indentation of the line at `pos`, returns where it ends
+usize lex_indent(const char* s, usize len, usize pos, usize* width) {
+    usize w = 0;
+    for (; pos < len; pos++) {
+        if (s[pos] == ' ')
+            w++;
+        else if (s[pos] == '\t')
+            w = (w / 8 + 1) * 8;
+        else if (s[pos] == '\f')
+            w = 0;
+        else
+            break;
+    }
+    *width = w;
+    return pos;
+}
+
+// skips the rest of a line if it is blank or just a comment
+bool lex_skip_blank(const char* s, usize len, usize* pos) {
+    usize p = *pos;
+    if (p < len && s[p] == '#') {
+        while (p < len && !is_newline(s[p]))
+            p++;
+    }
+    if (p < len && !is_newline(s[p]))
+        return false;
+    if (p < len)
+        skip_newline(s, len, &p);
+    *pos = p;
+    return true;
+}
+
+bool tok_continues_stmt(const Lexer* l, Token t) {
+    return tok_is(l, t, "else") || tok_is(l, t, "elif") ||
+           tok_is(l, t, "except") || tok_is(l, t, "finally");
+}
@@ -0,0 +1,110 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: a tokenizer for just as much of Python as the minifier, the splitter
+ * and the bundler need
+ */
+
+#ifndef _LEXER_H
+#define _LEXER_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+typedef enum {
+    TOK_END = 0,
+    TOK_NEWLINE,
+    TOK_NAME,
+    TOK_NUMBER,
+    TOK_STRING,
+    TOK_OP,
+    TOK_ERROR,
+} Tok_Kind;
+
+typedef struct {
+    Tok_Kind kind;
+    usize start;
+    usize len;
+    // whitespace came before it
+    bool spaced;
+} Token;
+
+typedef struct {
+    const char* src;
+    usize len;
+    usize pos;
+    // bracket nesting. Line breaks within brackets are whitespace.
+    usize depth;
+} Lexer;
+
+/**
+ * Reads the next token. Comments, line continuations and line breaks within
+ * brackets are skipped as whitespace.
+ *
+ * @param l the lexer
+ * @return the token, `TOK_END` at the end of the source and `TOK_ERROR` on an
+ * unterminated string
+ */
+Token lex_next(Lexer* l);
+
+/**
+ * Checks if a character can be part of a name or a number.
+ */
+bool lex_is_word(char c);
+
+/**
+ * Measures the indentation of the line at `pos`, with tabs to multiples of 8.
+ *
+ * @param s the source
+ * @param len length of the source
+ * @param pos the start of the line
+ * @param width the width of the indentation
+ * @return where the indentation ends
+ */
+usize lex_indent(const char* s, usize len, usize pos, usize* width);
+
+/**
+ * Skips the rest of a line if it is blank or just a comment.
+ *
+ * @param s the source
+ * @param len length of the source
+ * @param pos where to start, moved to the next line if it was skipped
+ * @return true if the line was skipped
+ */
+bool lex_skip_blank(const char* s, usize len, usize* pos);
+
+/**
+ * Checks if a token is the name `word`.
+ */
+bool tok_is(const Lexer* l, Token t, const char* word);
+
+/**
+ * Checks if a token is the operator (or bracket) `op`.
+ */
+bool tok_is_op(const Lexer* l, Token t, char op);
+
+/**
+ * Checks if a string token is an f-string.
+ */
+bool tok_is_fstring(const Lexer* l, Token t);
+
+/**
+ * Hashes the text of a token, with `hash_bytes`.
+ */
+u64 tok_hash(const Lexer* l, Token t);
+
+/**
+ * Checks if a token starts a clause that continues the compound statement
+ * before it (`else`, `elif`, `except` or `finally`).
+ */
+bool tok_continues_stmt(const Lexer* l, Token t);
+
+#endif // _LEXER_H
@@ -0,0 +1,329 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manifest.h"
+
+// the payload stores the length of the file name in a byte
+#define FILE_NAME_MAX 255
+
+typedef struct {
+    const char* p;
+    const char* end;
+} Json;
+
+static void skip_ws(Json* j) {
+    while (j->p < j->end &&
+           (*j->p == ' ' || *j->p == '\t' || *j->p == '\r' || *j->p == '\n'))
+        j->p++;
+}
+
+static bool expect(Json* j, char c) {
+    skip_ws(j);
+    if (j->p >= j->end || *j->p != c)
+        return false;
+    j->p++;
+    return true;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex4(Json* j, u32* res) {
+    if (j->end - j->p < 4)
+        return false;
+    *res = 0;
+    for (usize i = 0; i < 4; i++) {
+        int d = hex_digit(*j->p++);
+        if (d < 0)
+            return false;
+        *res = (*res << 4) | (u32)d;
+    }
+    return true;
+}
+
+static usize put_utf8(char* out, u32 cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// parses a string into a heap allocated, null-terminated buffer. Strings with
+// escaped null bytes are rejected, they can't be paths or names.
+static char* parse_string(Json* j) {
+    if (!expect(j, '"'))
+        return NULL;
+
+    // escapes never get longer when decoded
+    char* res = malloc((usize)(j->end - j->p) + 1);
+    check_alloc(res);
+    usize len = 0;
+
+    while (j->p < j->end && *j->p != '"') {
+        char c = *j->p++;
+        if ((u8)c < 0x20)
+            goto fail;
+        if (c != '\\') {
+            res[len++] = c;
+            continue;
+        }
+
+        if (j->p >= j->end)
+            goto fail;
+        switch (*j->p++) {
+            case '"': res[len++] = '"'; break;
+            case '\\': res[len++] = '\\'; break;
+            case '/': res[len++] = '/'; break;
+            case 'b': res[len++] = '\b'; break;
+            case 'f': res[len++] = '\f'; break;
+            case 'n': res[len++] = '\n'; break;
+            case 'r': res[len++] = '\r'; break;
+            case 't': res[len++] = '\t'; break;
+            case 'u': {
+                u32 cp;
+                if (!parse_hex4(j, &cp) || cp == 0)
+                    goto fail;
+                // a surrogate pair
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    u32 lo;
+                    if (j->end - j->p < 2 || j->p[0] != '\\' ||
+                        j->p[1] != 'u')
+                        goto fail;
+                    j->p += 2;
+                    if (!parse_hex4(j, &lo) || lo < 0xDC00 || lo >= 0xE000)
+                        goto fail;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                } else if (cp >= 0xDC00 && cp < 0xE000) {
+                    goto fail;
+                }
+                len += put_utf8(&res[len], cp);
+            } break;
+            default: goto fail;
+        }
+    }
+
+    if (!expect(j, '"'))
+        goto fail;
+    res[len] = '\0';
+    return res;
+
+fail:
+    free(res);
+    return NULL;
+}
+
+static bool parse_null(Json* j) {
+    skip_ws(j);
+    if (j->end - j->p < 4 || strncmp(j->p, "null", 4))
+        return false;
+    j->p += 4;
+    return true;
+}
+
+static void entry_free(Manifest_Entry* e) {
+    free(e->input);
+    free(e->output);
+    free(e->var_name);
+    free(e->file_name);
+    free(e->comment);
+}
+
+// parses a JSON object into an entry. Returns an error message on failure.
+static const char* parse_entry(const char* line, usize len, Manifest_Entry* e) {
+    Json j = {line, line + len};
+    *e = (Manifest_Entry){0};
+
+    if (!expect(&j, '{'))
+        return "expected an object";
+
+    skip_ws(&j);
+    bool first = true;
+    while (j.p < j.end && *j.p != '}') {
+        if (!first && !expect(&j, ','))
+            return "expected , or }";
+        first = false;
+
+        char* key = parse_string(&j);
+        if (!key)
+            return "expected a key";
+        if (!expect(&j, ':')) {
+            free(key);
+            return "expected :";
+        }
+
+        char** field = NULL;
+        if (!strcmp(key, "input"))
+            field = &e->input;
+        else if (!strcmp(key, "output"))
+            field = &e->output;
+        else if (!strcmp(key, "var_name"))
+            field = &e->var_name;
+        else if (!strcmp(key, "file_name"))
+            field = &e->file_name;
+        else if (!strcmp(key, "comment"))
+            field = &e->comment;
+        free(key);
+        if (!field)
+            return "unknown key";
+
+        if (parse_null(&j)) {
+            skip_ws(&j);
+            continue;
+        }
+        char* value = parse_string(&j);
+        if (!value)
+            return "expected a string or null";
+        free(*field);
+        *field = value;
+        skip_ws(&j);
+    }
+
+    if (!expect(&j, '}'))
+        return "expected }";
+    skip_ws(&j);
+    if (j.p != j.end)
+        return "trailing data after the object";
+
+    if (!e->input || e->input[0] == '\0')
+        return "missing \"input\"";
+    if (e->file_name && strlen(e->file_name) > FILE_NAME_MAX)
+        return "\"file_name\" is longer than 255 bytes";
+    return NULL;
+}
+
+static void push(Manifest* m, usize* cap, Manifest_Entry e) {
+    if (m->len + 1 > *cap) {
+        *cap = *cap ? *cap * 2 : 256;
+        m->items = realloc(m->items, *cap * sizeof(Manifest_Entry));
+        check_alloc(m->items);
+    }
+    m->items[m->len++] = e;
+}
+
+static char* read_all(const char* path, usize* len) {
+    FILE* fp = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+    if (!fp)
+        return NULL;
+
+    usize cap = 4096;
+    usize n = 0;
+    char* buf = malloc(cap);
+    check_alloc(buf);
+    for (;;) {
+        if (n + 1 >= cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            check_alloc(buf);
+        }
+        usize got = fread(&buf[n], 1, cap - n - 1, fp);
+        n += got;
+        if (got == 0)
+            break;
+    }
+
+    bool failed = ferror(fp);
+    if (fp != stdin)
+        fclose(fp);
+    if (failed) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
+bool manifest_load(const char* path, Manifest* m) {
+    *m = (Manifest){0};
+    usize len;
+    char* data = read_all(path, &len);
+    if (!data) {
+        warn("could not read manifest \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    usize cap = 0;
+    bool ok = true;
+
+    if (memchr(data, '\0', len)) {
+        // null separated paths
+        for (usize i = 0; i < len;) {
+            usize n = strlen(&data[i]);
+            if (n > 0) {
+                Manifest_Entry e = {.input = strdup(&data[i])};
+                check_alloc(e.input);
+                push(m, &cap, e);
+            }
+            i += n + 1;
+        }
+    } else {
+        usize line_no = 0;
+        for (char* line = data; line < data + len;) {
+            char* nl = memchr(line, '\n', (usize)(data + len - line));
+            usize n = nl ? (usize)(nl - line) : (usize)(data + len - line);
+            line_no++;
+
+            Json blank = {line, line + n};
+            skip_ws(&blank);
+            if (blank.p != blank.end) {
+                Manifest_Entry e;
+                const char* err = parse_entry(line, n, &e);
+                if (err) {
+                    warn("%s:%zu: %s", path, line_no, err);
+                    entry_free(&e);
+                    ok = false;
+                } else {
+                    push(m, &cap, e);
+                }
+            }
+            line += n + 1;
+        }
+    }
+
+    free(data);
+    if (!ok)
+        manifest_free(m);
+    return ok;
+}
+
+void manifest_free(Manifest* m) {
+    for (usize i = 0; i < m->len; i++)
+        entry_free(&m->items[i]);
+    free(m->items);
+    *m = (Manifest){0};
+}
@@ -0,0 +1,63 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: job manifests (`--manifest`)
+ */
+
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/*
+ * A manifest is either a list of input paths separated by null bytes (like
+ * the output of `find -print0`), or JSON lines with one object per input:
+ *
+ *   {"input": "a.py", "output": "A.8xv", "var_name": "A",
+ *    "file_name": "a.py", "comment": "built by CI"}
+ *
+ * Only "input" is required. Missing (or null) fields fall back to the command
+ * line options.
+ */
+
+typedef struct {
+    char* input;
+    char* output;
+    char* var_name;
+    // long file name stored in the AppVar
+    char* file_name;
+    // the AppVar's file info comment
+    char* comment;
+} Manifest_Entry;
+
+typedef struct {
+    Manifest_Entry* items;
+    usize len;
+} Manifest;
+
+/**
+ * Loads a manifest. Reports read errors, and every malformed entry.
+ *
+ * @param path path to the manifest, `-` for stdin
+ * @param m the destination
+ * @return false on read errors, or if any entry is malformed
+ */
+bool manifest_load(const char* path, Manifest* m);
+
+/**
+ * Frees a manifest.
+ *
+ * @param m the manifest
+ */
+void manifest_free(Manifest* m);
+
+#endif // _MANIFEST_H
@@ -0,0 +1,277 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "journal.h"
+#include "shard.h"
+
+#define MERGE_HELP                                                             \
+    "usage: tipyconv merge [OPTIONS] <journal>... [-- <input>...]\n"           \
+    "Merges the journals of (sharded) runs, and checks that every input was "  \
+    "converted\n"                                                              \
+    "exactly once. Missing and failed inputs are listed on stdout.\n"          \
+    "Options:\n"                                                               \
+    "  -o, --outfile FILE:  Write the merged journal to FILE\n"                \
+    "  -i, --inputs FILE:   Read the expected inputs from FILE, one per line " \
+    "(- for\n"                                                                 \
+    "                       stdin), in addition to the ones after --\n"        \
+    "  -h, --help:          Show this help screen"
+
+typedef struct {
+    char* in_path;
+    char* out_path;
+    u64 hash;
+    bool ok;
+    // index of the journal it came from
+    usize journal;
+    // position over all journals, later records win
+    usize seq;
+} Merge_Record;
+
+typedef struct {
+    Merge_Record* items;
+    usize len;
+    usize cap;
+    usize journal;
+} Merge_Records;
+
+typedef struct {
+    char** items;
+    usize len;
+    usize cap;
+} Merge_Inputs;
+
+static void add_record(const char* in_path, u64 hash, const char* out_path,
+                       bool ok, void* ctx) {
+    Merge_Records* r = ctx;
+    if (r->len + 1 > r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 1024;
+        r->items = realloc(r->items, r->cap * sizeof(Merge_Record));
+        check_alloc(r->items);
+    }
+
+    Merge_Record* rec = &r->items[r->len];
+    rec->in_path = strdup(in_path);
+    rec->out_path = strdup(out_path);
+    check_alloc(rec->in_path);
+    check_alloc(rec->out_path);
+    rec->hash = hash;
+    rec->ok = ok;
+    rec->journal = r->journal;
+    rec->seq = r->len++;
+}
+
+static void add_input(Merge_Inputs* in, const char* path) {
+    if (in->len + 1 > in->cap) {
+        in->cap = in->cap ? in->cap * 2 : 1024;
+        in->items = realloc(in->items, in->cap * sizeof(char*));
+        check_alloc(in->items);
+    }
+    in->items[in->len] = strdup(path);
+    check_alloc(in->items[in->len]);
+    in->len++;
+}
+
+static bool read_inputs(Merge_Inputs* in, const char* path) {
+    FILE* fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!fp)
+        return false;
+
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, fp)) > 0) {
+        if (line[n - 1] == '\n')
+            line[--n] = '\0';
+        if (n > 0)
+            add_input(in, line);
+    }
+
+    bool failed = ferror(fp);
+    free(line);
+    if (fp != stdin)
+        fclose(fp);
+    return !failed;
+}
+
+static int cmp_records(const void* a, const void* b) {
+    const Merge_Record* ra = a;
+    const Merge_Record* rb = b;
+    int res = strcmp(shard_key(ra->in_path), shard_key(rb->in_path));
+    if (res != 0)
+        return res;
+    return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+static int cmp_inputs(const void* a, const void* b) {
+    return strcmp(shard_key(*(char* const*)a), shard_key(*(char* const*)b));
+}
+
+int merge_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"outfile", required_argument, 0, 'o'},
+        {"inputs", required_argument, 0, 'i'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    const char* out_path = NULL;
+    Merge_Inputs inputs = {0};
+    bool check = false;
+
+    int c;
+    // options come first, so that `--` separates journals from inputs
+    while ((c = getopt_long(argc, argv, "+o:i:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'o': {
+                out_path = optarg;
+            } break;
+            case 'i': {
+                if (!read_inputs(&inputs, optarg))
+                    fatal("could not read inputs from \"%s\": %s", optarg,
+                          strerror(errno));
+                check = true;
+            } break;
+            case 'h': {
+                puts(MERGE_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(MERGE_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    Merge_Records records = {0};
+    usize njournals = 0;
+    int i = optind;
+    for (; i < argc && strcmp(argv[i], "--"); i++, njournals++) {
+        records.journal = njournals;
+        if (!journal_read(argv[i], add_record, &records))
+            fatal("could not read journal \"%s\": %s", argv[i],
+                  strerror(errno));
+    }
+    if (njournals == 0) {
+        puts(MERGE_HELP);
+        return EXIT_FAILURE;
+    }
+    if (i < argc) {
+        check = true;
+        for (i++; i < argc; i++)
+            add_input(&inputs, argv[i]);
+    }
+
+    // group the records by input, the last one of each group wins
+    qsort(records.items, records.len, sizeof(Merge_Record), cmp_records);
+    usize nwinners = 0;
+    usize overlaps = 0;
+    for (usize start = 0; start < records.len;) {
+        usize end = start + 1;
+        bool overlap = false;
+        while (end < records.len && !cmp_inputs(&records.items[start].in_path,
+                                                &records.items[end].in_path)) {
+            if (records.items[end].journal != records.items[start].journal)
+                overlap = true;
+            end++;
+        }
+        if (overlap) {
+            warn("\"%s\" is recorded in more than one journal",
+                 records.items[start].in_path);
+            overlaps++;
+        }
+        for (usize j = start; j < end - 1; j++) {
+            free(records.items[j].in_path);
+            free(records.items[j].out_path);
+        }
+        records.items[nwinners++] = records.items[end - 1];
+        start = end;
+    }
+
+    bool ok = true;
+    if (out_path) {
+        FILE* fp = fopen(out_path, "w");
+        if (!fp)
+            fatal("could not open \"%s\" for writing: %s", out_path,
+                  strerror(errno));
+
+        char line[JOURNAL_LINE_SZ];
+        for (usize j = 0; j < nwinners; j++) {
+            const Merge_Record* r = &records.items[j];
+            usize len = journal_format(line, sizeof(line), r->in_path,
+                                       r->hash, r->out_path, r->ok);
+            fwrite(line, 1, len, fp);
+        }
+        if (fclose(fp) != 0) {
+            warn("could not write \"%s\"", out_path);
+            ok = false;
+        }
+    }
+
+    usize failed = 0;
+    usize missing = 0;
+    usize converted = 0;
+    if (check) {
+        qsort(inputs.items, inputs.len, sizeof(char*), cmp_inputs);
+
+        // walk both sorted lists side by side
+        usize r = 0;
+        for (usize j = 0; j < inputs.len; j++) {
+            if (j > 0 && !cmp_inputs(&inputs.items[j - 1], &inputs.items[j]))
+                continue;
+            while (r < nwinners && cmp_inputs(&records.items[r].in_path,
+                                              &inputs.items[j]) < 0)
+                r++;
+
+            if (r == nwinners ||
+                cmp_inputs(&records.items[r].in_path, &inputs.items[j])) {
+                printf("missing\t%s\n", inputs.items[j]);
+                missing++;
+            } else if (!records.items[r].ok) {
+                printf("failed\t%s\n", inputs.items[j]);
+                failed++;
+            } else {
+                converted++;
+            }
+        }
+    } else {
+        for (usize j = 0; j < nwinners; j++) {
+            if (records.items[j].ok) {
+                converted++;
+            } else {
+                printf("failed\t%s\n", records.items[j].in_path);
+                failed++;
+            }
+        }
+    }
+
+    info("%zu journal(s): %zu converted, %zu failed, %zu missing, %zu in "
+         "more than one journal",
+         njournals, converted, failed, missing, overlaps);
+
+    for (usize j = 0; j < nwinners; j++) {
+        free(records.items[j].in_path);
+        free(records.items[j].out_path);
+    }
+    free(records.items);
+    for (usize j = 0; j < inputs.len; j++)
+        free(inputs.items[j]);
+    free(inputs.items);
+
+    return (ok && failed == 0 && missing == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
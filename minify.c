@@ -0,0 +1,966 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "lexer.h"
+#include "minify.h"
+
+// Python itself allows 100 levels
+#define MAX_INDENT 100
+#define MAX_LOCALS 64
+#define MAX_TARGETS 16
+// distinct names in a function, a power of two
+#define MAX_NAMES 1024
+
+typedef struct {
+    u64 hash;
+    // the new name, none if there is no shorter one
+    char name[2];
+    u8 name_len;
+} Local;
+
+typedef struct {
+    Lexer lex;
+    char* out;
+    usize out_len;
+    usize cap;
+    bool overflow;
+    // widths of the open indentation levels, the first one is 0
+    usize indents[MAX_INDENT];
+    usize nindents;
+    // the last line opened a block
+    bool block_open;
+    bool shorten;
+    // locals of the function being renamed, and the body they are renamed in
+    Local locals[MAX_LOCALS];
+    usize nlocals;
+    usize rename_start;
+    usize rename_end;
+} Minifier;
+
+// names that make a function's locals too hard to follow
+static const char* OPAQUE_NAMES[] = {
+    "def",    "lambda", "class",  "global", "nonlocal", "import",
+    "locals", "vars",   "dir",    "eval",   "exec",
+};
+
+// two letter names that can't be used
+static const char* KEYWORDS[] = {"as", "if", "in", "is", "or"};
+
+// indentation of the next line with any code on it, 0 at the end
+static usize next_indent(const char* s, usize len, usize pos) {
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(s, len, pos, &width);
+        if (!lex_skip_blank(s, len, &p))
+            return width;
+        pos = p;
+    }
+    return 0;
+}
+
+// if the logical line at the lexer is nothing but strings (and so does
+// nothing), returns where the next one starts. Returns 0 otherwise.
+static usize string_stmt_end(const Lexer* lex) {
+    Lexer l = *lex;
+    usize n = 0;
+    Token t;
+    while ((t = lex_next(&l)).kind == TOK_STRING) {
+        // these can call functions
+        if (tok_is_fstring(&l, t))
+            return 0;
+        n++;
+    }
+    if (n == 0 || (t.kind != TOK_NEWLINE && t.kind != TOK_END))
+        return 0;
+    return l.pos;
+}
+
+static void emit(Minifier* m, const char* s, usize len) {
+    if (m->out_len + len > m->cap) {
+        // only on inconsistent indentation, which Python rejects anyway
+        m->overflow = true;
+        return;
+    }
+    memcpy(&m->out[m->out_len], s, len);
+    m->out_len += len;
+}
+
+static bool indent(Minifier* m, usize width) {
+    if (width > m->indents[m->nindents - 1]) {
+        if (m->nindents == MAX_INDENT)
+            return false;
+        m->indents[m->nindents++] = width;
+    } else {
+        while (width < m->indents[m->nindents - 1])
+            m->nindents--;
+    }
+
+    for (usize i = 1; i < m->nindents; i++)
+        emit(m, " ", 1);
+    return true;
+}
+
+// === local names ===
+
+static bool names_add(u64* names, u64 hash) {
+    // 0 marks an empty slot
+    hash += !hash;
+    usize i = hash & (MAX_NAMES - 1);
+    for (usize n = 0; n < MAX_NAMES; n++, i = (i + 1) & (MAX_NAMES - 1)) {
+        if (names[i] == hash)
+            return true;
+        if (!names[i]) {
+            names[i] = hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool names_has(const u64* names, u64 hash) {
+    hash += !hash;
+    usize i = hash & (MAX_NAMES - 1);
+    for (usize n = 0; n < MAX_NAMES && names[i];
+         n++, i = (i + 1) & (MAX_NAMES - 1)) {
+        if (names[i] == hash)
+            return true;
+    }
+    return false;
+}
+
+typedef struct {
+    u64 names[MAX_NAMES];
+    Local locals[MAX_LOCALS];
+    usize nlocals;
+    // original lengths of the locals
+    usize lens[MAX_LOCALS];
+    u64 params[MAX_LOCALS];
+    usize nparams;
+} Scope;
+
+static bool add_local(Scope* sc, const Lexer* l, Token t) {
+    u64 hash = tok_hash(l, t);
+    for (usize i = 0; i < sc->nlocals; i++) {
+        if (sc->locals[i].hash == hash)
+            return true;
+    }
+    if (sc->nlocals == MAX_LOCALS)
+        return false;
+    sc->lens[sc->nlocals] = t.len;
+    sc->locals[sc->nlocals++] = (Local){.hash = hash};
+    return true;
+}
+
+static bool is_opaque(const Lexer* l, Token t) {
+    for (usize i = 0; i < LENGTH(OPAQUE_NAMES); i++) {
+        if (tok_is(l, t, OPAQUE_NAMES[i]))
+            return true;
+    }
+    return false;
+}
+
+// compound statements, whose colon starts a new statement
+static bool is_compound(const Lexer* l, Token t) {
+    static const char* words[] = {"if",   "elif", "else",   "while", "for",
+                                  "with", "try",  "except", "finally"};
+    for (usize i = 0; i < LENGTH(words); i++) {
+        if (tok_is(l, t, words[i]))
+            return true;
+    }
+    return false;
+}
+
+// whether `=` at `t` binds a name, rather than being part of `==`, `<=`,
+// `+=` and the like
+static bool is_assign(const Lexer* l, Token t) {
+    const char* s = l->src;
+    if (t.start + 1 < l->len && s[t.start + 1] == '=')
+        return false;
+    return t.start == 0 || !strchr("=!<>+-*/%&|^@:", s[t.start - 1]);
+}
+
+// finds the names bound by one logical line of a function body. Only what is
+// bound for sure counts: plain (and tuple) assignments, `for` targets and
+// `as` names. Returns false if the function can't be renamed.
+static bool scan_line(Lexer* l, Scope* sc) {
+    Token prev = {0};
+    Token first = {0};
+    Token targets[MAX_TARGETS];
+    usize ntargets = 0;
+    bool in_for = false;
+    bool skip = false;
+    // a name at the top level that may turn out to be bound
+    bool cand = false;
+
+    for (;;) {
+        Token t = lex_next(l);
+        if (t.kind == TOK_ERROR)
+            return false;
+        if (t.kind == TOK_NEWLINE || t.kind == TOK_END)
+            return true;
+        if (t.kind == TOK_STRING && tok_is_fstring(l, t))
+            return false;
+        if (!first.kind)
+            first = t;
+
+        bool top = l->depth == 0;
+        if (t.kind == TOK_NAME) {
+            if (is_opaque(l, t) || !names_add(sc->names, tok_hash(l, t)))
+                return false;
+            if (!skip && top && tok_is(l, prev, "as") &&
+                !add_local(sc, l, t))
+                return false;
+            if (in_for && tok_is(l, t, "in")) {
+                if (cand && !add_local(sc, l, prev))
+                    return false;
+                in_for = false;
+            } else if (tok_is(l, t, "for") && first.start == t.start) {
+                in_for = true;
+            }
+        } else if (t.kind == TOK_OP && top && !skip) {
+            char c = l->src[t.start];
+            if (c == '=' && is_assign(l, t)) {
+                if (cand && !add_local(sc, l, prev))
+                    return false;
+                for (usize i = 0; i < ntargets; i++) {
+                    if (!add_local(sc, l, targets[i]))
+                        return false;
+                }
+                ntargets = 0;
+            } else if (c == ',' && cand) {
+                if (in_for) {
+                    if (!add_local(sc, l, prev))
+                        return false;
+                } else if (ntargets < MAX_TARGETS) {
+                    targets[ntargets++] = prev;
+                }
+            } else if (c == ':') {
+                // annotations are left alone, a compound statement's body is
+                // a new statement
+                if (is_compound(l, first))
+                    first = (Token){0};
+                else
+                    skip = true;
+                ntargets = 0;
+            } else if (c == ';') {
+                first = (Token){0};
+                ntargets = 0;
+                skip = false;
+            }
+        }
+
+        cand = t.kind == TOK_NAME && top && !tok_is_op(l, prev, '.');
+        prev = t;
+    }
+}
+
+// the `n`th short name: a to Z, then two characters
+static usize short_name(usize n, char* dest) {
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    if (n < 52) {
+        dest[0] = chars[n];
+        return 1;
+    }
+    n -= 52;
+    if (n >= 52 * 63)
+        return 0;
+    dest[0] = chars[n / 63];
+    dest[1] = chars[n % 63];
+    return 2;
+}
+
+static bool is_keyword(const char* name, usize len) {
+    for (usize i = 0; i < LENGTH(KEYWORDS); i++) {
+        if (len == 2 && !memcmp(name, KEYWORDS[i], 2))
+            return true;
+    }
+    return false;
+}
+
+// picks shorter names for the locals of the function whose `def` is at the
+// lexer. Leaves the function alone if it can't be renamed safely.
+static void scan_function(Minifier* m, usize width) {
+    Lexer l = m->lex;
+    Scope sc = {0};
+
+    // parameters are the names right after `(`, `,`, `*` and `**`. They are
+    // never renamed, since they can be passed by keyword.
+    Token t = lex_next(&l);
+    if (tok_is(&l, t, "async"))
+        t = lex_next(&l);
+    Token prev = t;
+    bool param = false;
+    while ((t = lex_next(&l)).kind != TOK_NEWLINE) {
+        if (t.kind == TOK_END || t.kind == TOK_ERROR)
+            return;
+        if (t.kind == TOK_NAME) {
+            u64 hash = tok_hash(&l, t);
+            if (!names_add(sc.names, hash))
+                return;
+            if (param && l.depth == 1) {
+                if (sc.nparams == MAX_LOCALS)
+                    return;
+                sc.params[sc.nparams++] = hash;
+            }
+        }
+        param = l.depth == 1 &&
+                (tok_is_op(&l, t, '(') || tok_is_op(&l, t, ',') ||
+                 tok_is_op(&l, t, '*'));
+        prev = t;
+    }
+    // the body is on the same line
+    if (!tok_is_op(&l, prev, ':'))
+        return;
+
+    usize body_start = l.pos;
+    usize body_end = l.len;
+    usize pos = body_start;
+    while (pos < l.len) {
+        usize w;
+        usize p = lex_indent(l.src, l.len, pos, &w);
+        if (lex_skip_blank(l.src, l.len, &p)) {
+            pos = p;
+            continue;
+        }
+        if (w <= width) {
+            body_end = pos;
+            break;
+        }
+        l.pos = p;
+        l.depth = 0;
+        if (!scan_line(&l, &sc))
+            return;
+        pos = l.pos;
+    }
+
+    usize n = 0;
+    m->nlocals = 0;
+    for (usize i = 0; i < sc.nlocals; i++) {
+        Local* local = &sc.locals[i];
+        bool is_param = false;
+        for (usize j = 0; j < sc.nparams; j++)
+            is_param |= sc.params[j] == local->hash;
+        if (is_param)
+            continue;
+
+        char name[2];
+        usize len;
+        while ((len = short_name(n, name)) && len < sc.lens[i]) {
+            n++;
+            if (!is_keyword(name, len) &&
+                !names_has(sc.names, hash_bytes(name, len, HASH_SEED))) {
+                memcpy(local->name, name, len);
+                local->name_len = (u8)len;
+                break;
+            }
+        }
+        m->locals[m->nlocals++] = *local;
+    }
+    m->rename_start = body_start;
+    m->rename_end = body_end;
+}
+
+// the new name of a local, if the name at `t` is one
+static void rename_local(Minifier* m, Token prev, Token t, const char** s,
+                         usize* len) {
+    const Lexer* l = &m->lex;
+    if (t.start < m->rename_start || t.start >= m->rename_end)
+        return;
+    // attributes
+    if (tok_is_op(l, prev, '.'))
+        return;
+    // keyword arguments
+    if (l->depth > 0) {
+        Lexer peek = *l;
+        Token next = lex_next(&peek);
+        if (tok_is_op(l, next, '=') && is_assign(l, next))
+            return;
+    }
+
+    u64 hash = tok_hash(l, t);
+    for (usize i = 0; i < m->nlocals; i++) {
+        if (m->locals[i].hash == hash && m->locals[i].name_len) {
+            *s = m->locals[i].name;
+            *len = m->locals[i].name_len;
+            return;
+        }
+    }
+}
+
+// whether two tokens would run together without a space
+static bool needs_space(const Lexer* l, Token prev, Token t) {
+    char c = l->src[t.start];
+    // `"" "a"` is not `"""a"`
+    if (prev.kind == TOK_STRING)
+        return t.kind == TOK_STRING;
+    if (prev.kind != TOK_NAME && prev.kind != TOK_NUMBER)
+        return false;
+    // `1 .real` is not `1.real`
+    return lex_is_word(c) || t.kind == TOK_NUMBER ||
+           (prev.kind == TOK_NUMBER && c == '.');
+}
+
+static bool emit_line(Minifier* m) {
+    Token prev = {0};
+    Token t;
+    for (;;) {
+        t = lex_next(&m->lex);
+        if (t.kind == TOK_ERROR)
+            return false;
+        if (t.kind == TOK_NEWLINE || t.kind == TOK_END)
+            break;
+
+        const char* s = &m->lex.src[t.start];
+        usize len = t.len;
+        if (t.kind == TOK_NAME && m->nlocals)
+            rename_local(m, prev, t, &s, &len);
+        if (t.spaced && needs_space(&m->lex, prev, t))
+            emit(m, " ", 1);
+        emit(m, s, len);
+        prev = t;
+    }
+
+    m->block_open = tok_is_op(&m->lex, prev, ':');
+    // the last line may not end in one
+    if (t.kind == TOK_NEWLINE)
+        emit(m, "\n", 1);
+    return !m->overflow;
+}
+
+static bool starts_def(const Lexer* lex) {
+    Lexer l = *lex;
+    Token t = lex_next(&l);
+    if (tok_is(&l, t, "async"))
+        t = lex_next(&l);
+    return tok_is(&l, t, "def");
+}
+
+bool minify(const char* src, usize len, char* dest, usize* dest_len,
+            bool shorten_names) {
+    Minifier m = {
+        .lex = {.src = src, .len = len},
+        .out = dest,
+        .cap = len,
+        .nindents = 1,
+        .shorten = shorten_names,
+    };
+
+    usize pos = 0;
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            pos = p;
+            continue;
+        }
+
+        m.lex.pos = p;
+        m.lex.depth = 0;
+        if (m.nlocals && p >= m.rename_end)
+            m.nlocals = 0;
+
+        // a lone string does nothing, unless it is all there is in a block
+        usize end = string_stmt_end(&m.lex);
+        if (end && !(m.block_open && next_indent(src, len, end) <=
+                                         m.indents[m.nindents - 1])) {
+            pos = end;
+            continue;
+        }
+
+        if (!indent(&m, width))
+            return false;
+        if (m.shorten && !m.nlocals && starts_def(&m.lex))
+            scan_function(&m, width);
+        if (!emit_line(&m))
+            return false;
+        pos = m.lex.pos;
+    }
+
+    *dest_len = m.out_len;
+    return true;
+}
+
+// === splitting ===
+
+usize split_points(const char* src, usize len, usize max, usize** ends) {
+    Lexer lex = {.src = src, .len = len};
+    usize* res = NULL;
+    usize n = 0;
+    usize cap = 0;
+    // the chunk being filled, where its last top-level statement starts and
+    // where the line before that ended
+    usize start = 0;
+    usize cut = 0;
+    usize last_end = 0;
+    bool decorated = false;
+
+    usize pos = 0;
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            pos = p;
+            continue;
+        }
+
+        lex.pos = p;
+        lex.depth = 0;
+        Token t = lex_next(&lex);
+        if (width == 0) {
+            // blank lines and comments before it go with it, and can't
+            // push the chunk before it over
+            if (!decorated && !tok_continues_stmt(&lex, t))
+                cut = last_end;
+            decorated = tok_is_op(&lex, t, '@');
+        }
+        while (t.kind != TOK_NEWLINE && t.kind != TOK_END) {
+            if (t.kind == TOK_ERROR)
+                goto fail;
+            t = lex_next(&lex);
+        }
+        pos = lex.pos;
+
+        // what came before the statement fits, as the chunk did before it
+        while (pos - start > max) {
+            if (cut <= start)
+                goto fail;
+            if (n == cap) {
+                cap = cap ? cap * 2 : 8;
+                res = realloc(res, cap * sizeof(usize));
+                check_alloc(res);
+            }
+            res[n++] = start = cut;
+        }
+        last_end = pos;
+    }
+
+    if (n == cap) {
+        res = realloc(res, (cap + 1) * sizeof(usize));
+        check_alloc(res);
+    }
+    res[n++] = len;
+    *ends = res;
+    return n;
+
+fail:
+    free(res);
+    return 0;
+}
+
+// === checking a split ===
+
+// names that are never bound by a statement
+static const char* PY_KEYWORDS[] = {
+    "False",  "None",   "True",    "and",      "as",       "assert", "async",
+    "await",  "break",  "class",   "continue", "def",      "del",    "elif",
+    "else",   "except", "finally", "for",      "from",     "global", "if",
+    "import", "in",     "is",      "lambda",   "nonlocal", "not",    "or",
+    "pass",   "raise",  "return",  "try",      "while",    "with",   "yield",
+};
+
+typedef enum {
+    // bound at the top level of the part
+    NAME_BOUND,
+    // bound in a function, which makes it a local there
+    NAME_LOCAL,
+    // used while the part runs
+    NAME_USED,
+    // used in a function, which may run after later parts have
+    NAME_USED_LATER,
+    // named by a `global` statement
+    NAME_GLOBAL,
+} Name_Use;
+
+// where a line is: outside of any function or class, in a class or in a
+// function
+typedef enum {
+    AT_TOP,
+    AT_CLASS,
+    AT_DEF,
+} Line_At;
+
+typedef struct {
+    u64 hash;
+    usize start;
+    usize len;
+    usize part;
+    // the top-level function it is in, 0 if none
+    usize scope;
+    Name_Use use;
+    // may be the target of the assignment being read
+    bool target;
+    // bound by an augmented assignment, which uses it first
+    bool reads;
+} Part_Name;
+
+typedef struct {
+    Lexer lex;
+    Part_Name* names;
+    usize nnames;
+    usize cap;
+    usize part;
+    usize scope;
+    usize nscopes;
+} Split_Check;
+
+static Part_Name* add_name(Split_Check* c, usize start, usize len,
+                           Name_Use use) {
+    if (c->nnames == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 1024;
+        c->names = realloc(c->names, c->cap * sizeof(Part_Name));
+        check_alloc(c->names);
+    }
+    Part_Name* n = &c->names[c->nnames++];
+    *n = (Part_Name){
+        .hash = hash_bytes(&c->lex.src[start], len, HASH_SEED),
+        .start = start,
+        .len = len,
+        .part = c->part,
+        .scope = c->scope,
+        .use = use,
+    };
+    return n;
+}
+
+static bool is_py_keyword(const Lexer* l, Token t) {
+    for (usize i = 0; i < LENGTH(PY_KEYWORDS); i++) {
+        if (tok_is(l, t, PY_KEYWORDS[i]))
+            return true;
+    }
+    return false;
+}
+
+// whether `t` is the name added last
+static bool is_last_name(const Split_Check* c, Token t) {
+    return t.kind == TOK_NAME && c->nnames &&
+           c->names[c->nnames - 1].start == t.start;
+}
+
+// adds every word in an f-string as used, which includes those in its
+// replacement fields
+static void add_fstring_names(Split_Check* c, Token t, Name_Use use) {
+    const char* s = c->lex.src;
+    usize end = t.start + t.len;
+    for (usize i = t.start; i < end;) {
+        if (!lex_is_word(s[i])) {
+            i++;
+            continue;
+        }
+        usize w = i;
+        while (i < end && lex_is_word(s[i]))
+            i++;
+        if (s[w] < '0' || s[w] > '9')
+            add_name(c, w, i - w, use);
+    }
+}
+
+// whether `=` at `t` binds a name, like `is_assign`, or rebinds it, like
+// `+=` does
+static bool is_rebind(const Lexer* l, Token t) {
+    const char* s = l->src;
+    if (t.start + 1 < l->len && s[t.start + 1] == '=')
+        return false;
+    if (t.start == 0)
+        return true;
+    // `<<=` and `>>=`, but not `<=` and `>=`
+    char c = s[t.start - 1];
+    if (c == '<' || c == '>')
+        return t.start >= 2 && s[t.start - 2] == c;
+    return !strchr("=!:", c);
+}
+
+// what a binding at `at` makes of a name
+static Name_Use binding(Line_At at) {
+    switch (at) {
+        case AT_TOP:
+            return NAME_BOUND;
+        case AT_DEF:
+            return NAME_LOCAL;
+        default:
+            return NAME_USED;
+    }
+}
+
+// marks the targets read since `from` as bound, and as used first if the
+// assignment is augmented
+static void bind_targets(Split_Check* c, usize from, Line_At at,
+                         bool augmented) {
+    for (usize i = from; i < c->nnames; i++) {
+        if (c->names[i].target) {
+            c->names[i].use = binding(at);
+            c->names[i].reads = augmented;
+        }
+        c->names[i].target = false;
+    }
+}
+
+// reads the names of a logical line. Assignments, imports, `for` targets,
+// `as` names and definitions bind names, and function parameters are locals
+// of their function. Returns true if the line opens a function, which is a
+// scope of its own at the top level and in classes.
+static bool scan_part_line(Split_Check* c, Line_At at, bool* opens_class) {
+    Lexer* l = &c->lex;
+    Token prev = {0};
+    Token first = {0};
+    Name_Use use = at == AT_DEF ? NAME_USED_LATER : NAME_USED;
+    bool opens_def = false;
+    // the statement being read, and where its targets start
+    bool from = false;
+    bool import = false;
+    bool global = false;
+    bool annotated = false;
+    bool in_for = false;
+    bool params = false;
+    bool bind_next = false;
+    usize targets = c->nnames;
+
+    Token t;
+    while ((t = lex_next(l)).kind != TOK_NEWLINE && t.kind != TOK_END &&
+           t.kind != TOK_ERROR) {
+        if (!first.kind && !tok_is(l, t, "async")) {
+            first = t;
+            from = tok_is(l, t, "from");
+            import = tok_is(l, t, "import");
+            global = at == AT_DEF && tok_is(l, t, "global");
+            annotated = false;
+            targets = c->nnames;
+        }
+
+        if (t.kind == TOK_STRING && tok_is_fstring(l, t)) {
+            add_fstring_names(c, t, use);
+        } else if (tok_is_op(l, t, ';')) {
+            if (import)
+                bind_targets(c, targets, at, false);
+            first = (Token){0};
+            in_for = false;
+        } else if (tok_is_op(l, t, ':') && l->src[t.start + 1] == '=') {
+            // `x := ...`
+            if (is_last_name(c, prev))
+                c->names[c->nnames - 1].use = binding(at);
+        } else if (tok_is_op(l, t, ':') && l->depth == 0 && !params) {
+            // a block on the same line, or an annotation
+            if (is_compound(l, first) || tok_is(l, first, "def") ||
+                tok_is(l, first, "class"))
+                first = (Token){0};
+            else if (use == NAME_USED || at == AT_DEF)
+                annotated = true;
+        } else if (tok_is_op(l, t, '=')) {
+            if (l->depth == 0 && is_rebind(l, t)) {
+                bind_targets(c, targets, at, !is_assign(l, t));
+                targets = c->nnames;
+                annotated = false;
+            }
+        } else if (params && tok_is_op(l, t, ')') && l->depth == 0) {
+            params = false;
+        } else if (t.kind == TOK_OP) {
+            // attributes and items are not bound, their object is changed
+            if ((tok_is_op(l, t, '.') || tok_is_op(l, t, '[') ||
+                 tok_is_op(l, t, '(')) &&
+                is_last_name(c, prev))
+                c->names[c->nnames - 1].target = false;
+        } else if (tok_is(l, t, "def") || tok_is(l, t, "class")) {
+            Token name = lex_next(l);
+            if (name.kind == TOK_NAME)
+                add_name(c, name.start, name.len, binding(at));
+            if (tok_is(l, t, "class")) {
+                *opens_class = true;
+            } else if (at != AT_DEF) {
+                // the rest of the line is the function's
+                c->scope = ++c->nscopes;
+                use = NAME_USED_LATER;
+                at = AT_DEF;
+                opens_def = true;
+            }
+            params = tok_is(l, t, "def");
+            t = name;
+        } else if (t.kind == TOK_NAME && is_py_keyword(l, t)) {
+            if (tok_is(l, t, "as") && import && is_last_name(c, prev))
+                c->names[c->nnames - 1].target = false;
+            else if (tok_is(l, t, "as"))
+                bind_next = true;
+            else if (tok_is(l, t, "lambda"))
+                use = NAME_USED_LATER;
+            if (tok_is(l, t, "for")) {
+                in_for = true;
+                targets = c->nnames;
+            } else if (tok_is(l, t, "import")) {
+                import = true;
+                from = false;
+                targets = c->nnames;
+            } else if (tok_is(l, t, "in") && in_for) {
+                bind_targets(c, targets, at, false);
+                in_for = false;
+            }
+        } else if (t.kind == TOK_NAME && !tok_is_op(l, prev, '.') && !from) {
+            Part_Name* n = add_name(c, t.start, t.len, use);
+            if (global)
+                n->use = NAME_GLOBAL;
+            if (params) {
+                // the parameters are the names right after `(`, `,`, `*`
+                // and `**`
+                n->target = l->depth == 1 &&
+                            (tok_is_op(l, prev, '(') ||
+                             tok_is_op(l, prev, ',') ||
+                             tok_is_op(l, prev, '*'));
+                if (n->target)
+                    n->use = NAME_LOCAL;
+                n->target = false;
+            } else {
+                n->target = !annotated && (use == NAME_USED || at == AT_DEF);
+            }
+            if (bind_next)
+                n->use = binding(at);
+            bind_next = false;
+        }
+        prev = t;
+    }
+
+    if (import)
+        bind_targets(c, targets, at, false);
+    return opens_def;
+}
+
+// orders names by hash, and each name by function and where it is
+static int cmp_part_names(const void* a, const void* b) {
+    const Part_Name* na = a;
+    const Part_Name* nb = b;
+    if (na->hash != nb->hash)
+        return na->hash < nb->hash ? -1 : 1;
+    if (na->scope != nb->scope)
+        return na->scope < nb->scope ? -1 : 1;
+    return (na->start > nb->start) - (na->start < nb->start);
+}
+
+// whether a top-level statement of `part` binds the name before `n`. Its uses
+// outside of functions come first.
+static bool bound_in(const Part_Name* names, usize n, usize part) {
+    for (usize i = 0; i < n && names[i].scope == 0; i++) {
+        if (names[i].use == NAME_BOUND && names[i].part == part)
+            return true;
+    }
+    return false;
+}
+
+// checks one name, whose uses are sorted by function and then by where they
+// are. `hidden` names are left out by star imports.
+static const char* check_name(const Part_Name* names, usize n, bool hidden) {
+    usize used_later = SIZE_MAX;
+    usize first = SIZE_MAX;
+    usize last = 0;
+    usize first_bound = SIZE_MAX;
+    usize bound = 0;
+    bool is_bound = false;
+    bool global = false;
+    bool unseen = false;
+
+    for (usize i = 0; i < n;) {
+        // a function that binds it (and doesn't declare it global) only
+        // ever uses its own local
+        bool local = false;
+        bool declared = false;
+        usize j = i;
+        for (; j < n && names[j].scope == names[i].scope; j++) {
+            local = local || names[j].use == NAME_LOCAL;
+            declared = declared || names[j].use == NAME_GLOBAL;
+        }
+        for (; i < j; i++) {
+            const Part_Name* pn = &names[i];
+            bool used = pn->use == NAME_USED || pn->reads ||
+                        (pn->use == NAME_USED_LATER && (!local || declared));
+            if (used && pn->use == NAME_USED_LATER && pn->part < used_later)
+                used_later = pn->part;
+            if (hidden && used && pn->part > first_bound &&
+                !bound_in(names, pn->scope ? n : i, pn->part))
+                unseen = true;
+            if (pn->use == NAME_BOUND) {
+                is_bound = true;
+                bound = pn->part > bound ? pn->part : bound;
+                first_bound = pn->part < first_bound ? pn->part : first_bound;
+            }
+            first = pn->part < first ? pn->part : first;
+            last = pn->part > last ? pn->part : last;
+        }
+        global = global || declared;
+    }
+
+    if (global && first != last)
+        return "is declared global and used in more than one part";
+    if (is_bound && used_later < bound)
+        return "is used in a function before the part that binds it";
+    if (unseen)
+        return "starts with `_`, which `import *` doesn't pass on to later "
+               "parts";
+    return NULL;
+}
+
+const char* split_check(const char* src, usize len, const usize* ends,
+                        usize n, const char** name, usize* name_len) {
+    Split_Check c = {.lex = {.src = src, .len = len}};
+    // the function and the class the line is in, by their indentation
+    bool in_def = false;
+    bool in_class = false;
+    usize def_width = 0;
+    usize class_width = 0;
+
+    usize pos = 0;
+    while (pos < len) {
+        usize width;
+        usize p = lex_indent(src, len, pos, &width);
+        if (lex_skip_blank(src, len, &p)) {
+            pos = p;
+            continue;
+        }
+        while (c.part + 1 < n && pos >= ends[c.part])
+            c.part++;
+        if (in_def && width <= def_width)
+            in_def = false;
+        if (in_class && width <= class_width)
+            in_class = false;
+        if (!in_def)
+            c.scope = 0;
+
+        c.lex.pos = p;
+        c.lex.depth = 0;
+        Line_At at = in_def ? AT_DEF : in_class ? AT_CLASS : AT_TOP;
+        bool opens_class = false;
+        if (scan_part_line(&c, at, &opens_class) && !in_def) {
+            in_def = true;
+            def_width = width;
+        }
+        if (opens_class && !in_def && !in_class) {
+            in_class = true;
+            class_width = width;
+        }
+        pos = c.lex.pos;
+    }
+
+    qsort(c.names, c.nnames, sizeof(Part_Name), cmp_part_names);
+    const char* why = NULL;
+    for (usize i = 0; i < c.nnames && !why;) {
+        usize j = i;
+        while (j < c.nnames && c.names[j].hash == c.names[i].hash)
+            j++;
+        why = check_name(&c.names[i], j - i, src[c.names[i].start] == '_');
+        if (why) {
+            *name = &src[c.names[i].start];
+            *name_len = c.names[i].len;
+        }
+        i = j;
+    }
+
+    free(c.names);
+    return why;
+}
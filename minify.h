@@ -0,0 +1,79 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: Python source minifier, to save RAM and load time on the calculator,
+ * and splitter, for sources too large for one AppVar
+ */
+
+#ifndef _MINIFY_H
+#define _MINIFY_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/**
+ * Minifies Python source: comments, docstrings (and any other statement that
+ * is just a string), blank lines, trailing whitespace and whitespace between
+ * tokens are dropped, and indentation is cut down to one space per level.
+ *
+ * With `shorten_names`, the local variables of functions are renamed to
+ * shorter names. Functions whose locals can't be told apart safely (nested
+ * functions and classes, `global`, `import`, f-strings, `locals()` and the
+ * like) are left alone.
+ *
+ * Makes no allocations. The result is never longer than the source.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param dest buffer of at least `len` bytes, must not overlap `src`
+ * @param dest_len length of the result
+ * @param shorten_names whether to rename local variables
+ * @return false if the source could not be tokenized (e.g. an unterminated
+ * string). `dest` is left undefined then.
+ */
+bool minify(const char* src, usize len, char* dest, usize* dest_len,
+            bool shorten_names);
+
+/**
+ * Finds where to cut Python source into chunks of at most `max` bytes. Chunks
+ * end between top-level statements: decorators stay with what they decorate,
+ * and `else`, `except` and the like with the statement they belong to. Each
+ * chunk is as large as it can be.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param max the largest a chunk may be
+ * @param ends where each chunk ends, malloc'ed. The last one is `len`.
+ * @return the number of chunks, or 0 if a top-level statement is larger than
+ * `max` or the source could not be tokenized
+ */
+usize split_points(const char* src, usize len, usize max, usize** ends);
+
+/**
+ * Checks that Python source cut into chunks still does what it did, once
+ * every chunk is a module that star-imports the one before it. A function
+ * only sees the names of its own chunk and the ones before it, as they were
+ * when its chunk ran, a `global` statement only binds a name of its own chunk
+ * and names that start with `_` are not imported.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param ends where each chunk ends, from `split_points`
+ * @param n the number of chunks
+ * @param name the name whose meaning would change, if any
+ * @param name_len length of `name`
+ * @return NULL if the chunks do what the source did, how `name` would change
+ * otherwise
+ */
+const char* split_check(const char* src, usize len, const usize* ends,
+                        usize n, const char** name, usize* name_len);
+
+#endif // _MINIFY_H
@@ -0,0 +1,599 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv mount`, a read-only FUSE view of a directory with AppVars
+ * shown as Python source (and optionally the other way around)
+ */
+#define _GNU_SOURCE
+
+#ifdef HAVE_FUSE
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "tipyconv.h"
+
+#define MOUNT_HELP                                                             \
+    "usage: tipyconv mount [OPTIONS] <source dir> <mountpoint>\n"              \
+    "Mounts a read-only view of the source directory, where every AppVar is "  \
+    "also\n"                                                                   \
+    "shown as a .py file. Files are converted when they are read.\n"           \
+    "Options:\n"                                                               \
+    "  -b, --both:          Show .py files as .8xv AppVars as well\n"          \
+    "  -c, --cache MB:      Keep up to MB MiB of converted AppVars in memory " \
+    "(default\n"                                                               \
+    "                       64)\n"                                             \
+    "  -f, --foreground:    Do not daemonize\n"                                \
+    "  -o OPTIONS:          Pass mount options on to FUSE\n"                   \
+    "  -h, --help:          Show this help screen"
+
+#ifdef HAVE_FUSE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "names.h"
+
+#define CACHE_BUCKETS 1024
+
+// what backs a path in the mount
+typedef enum {
+    // the file itself
+    NODE_PLAIN = 0,
+    // an AppVar, shown as its source
+    NODE_SOURCE,
+    // a Python file, shown as an AppVar
+    NODE_APPVAR,
+} Node_Kind;
+
+// a converted AppVar, keyed by the path, mtime and size of its source. Entries
+// that are open are never evicted.
+typedef struct Cache_Entry {
+    char* key;
+    u64 hash;
+    char* data;
+    usize len;
+    usize refs;
+    // hash chain
+    struct Cache_Entry* next;
+    // recency list, most recently used first
+    struct Cache_Entry* newer;
+    struct Cache_Entry* older;
+} Cache_Entry;
+
+typedef struct {
+    Cache_Entry* buckets[CACHE_BUCKETS];
+    Cache_Entry* newest;
+    Cache_Entry* oldest;
+    usize bytes;
+    usize cap;
+    pthread_mutex_t lock;
+} Cache;
+
+typedef struct {
+    Node_Kind kind;
+    int fd;
+    // where the source starts within an AppVar
+    usize offset;
+    usize len;
+    Cache_Entry* entry;
+} Mount_File;
+
+static struct {
+    int src_fd;
+    bool both;
+    Cache cache;
+} state;
+
+static const char* appvar_exts[] = {".8xv", ".8Xv", ".8XV"};
+
+static void cache_unlink(Cache* c, Cache_Entry* e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        c->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        c->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void cache_push(Cache* c, Cache_Entry* e) {
+    e->older = c->newest;
+    e->newer = NULL;
+    if (c->newest)
+        c->newest->newer = e;
+    else
+        c->oldest = e;
+    c->newest = e;
+}
+
+static void entry_free(Cache_Entry* e) {
+    free(e->key);
+    free(e->data);
+    free(e);
+}
+
+// drops unused entries, oldest first, until the cache fits. Must hold the lock.
+static void cache_evict(Cache* c) {
+    Cache_Entry* e = c->oldest;
+    while (e && c->bytes > c->cap) {
+        Cache_Entry* newer = e->newer;
+        if (e->refs == 0) {
+            Cache_Entry** link = &c->buckets[e->hash % CACHE_BUCKETS];
+            while (*link != e)
+                link = &(*link)->next;
+            *link = e->next;
+            cache_unlink(c, e);
+            c->bytes -= e->len;
+            entry_free(e);
+        }
+        e = newer;
+    }
+}
+
+static Cache_Entry* cache_get(Cache* c, const char* key) {
+    u64 hash = hash_str(key);
+    pthread_mutex_lock(&c->lock);
+    Cache_Entry* e = c->buckets[hash % CACHE_BUCKETS];
+    while (e && (e->hash != hash || strcmp(e->key, key)))
+        e = e->next;
+    if (e) {
+        e->refs++;
+        cache_unlink(c, e);
+        cache_push(c, e);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return e;
+}
+
+// takes over `data`. Returns the entry for `key`, which is a different one if
+// another thread converted the same file first.
+static Cache_Entry* cache_put(Cache* c, const char* key, char* data,
+                              usize len) {
+    u64 hash = hash_str(key);
+    pthread_mutex_lock(&c->lock);
+    Cache_Entry** bucket = &c->buckets[hash % CACHE_BUCKETS];
+    Cache_Entry* e = *bucket;
+    while (e && (e->hash != hash || strcmp(e->key, key)))
+        e = e->next;
+    if (e) {
+        e->refs++;
+        pthread_mutex_unlock(&c->lock);
+        free(data);
+        return e;
+    }
+
+    e = calloc(1, sizeof(Cache_Entry));
+    check_alloc(e);
+    e->key = strdup(key);
+    check_alloc(e->key);
+    e->hash = hash;
+    e->data = data;
+    e->len = len;
+    e->refs = 1;
+    e->next = *bucket;
+    *bucket = e;
+    cache_push(c, e);
+    c->bytes += len;
+    cache_evict(c);
+    pthread_mutex_unlock(&c->lock);
+    return e;
+}
+
+static void cache_release(Cache* c, Cache_Entry* e) {
+    pthread_mutex_lock(&c->lock);
+    e->refs--;
+    cache_evict(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static bool has_ext(const char* path, usize len, const char* ext) {
+    usize ext_len = strlen(ext);
+    // a bare ".py" is a hidden file, not an extension
+    return len > ext_len && path[len - ext_len - 1] != '/' &&
+           !strcasecmp(&path[len - ext_len], ext);
+}
+
+// finds the file that backs `path` (as passed by FUSE), relative to the
+// source directory. Real files always win over converted ones.
+static Node_Kind resolve(const char* path, char* src) {
+    const char* rel = path[1] ? &path[1] : ".";
+    usize len = strlen(rel);
+    if (len + 5 > PATH_MAX) {
+        // too long to map, fails as it is
+        snprintf(src, PATH_MAX, "%s", rel);
+        return NODE_PLAIN;
+    }
+    memcpy(src, rel, len + 1);
+
+    struct stat st;
+    if (fstatat(state.src_fd, src, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        return NODE_PLAIN;
+
+    if (has_ext(src, len, ".py")) {
+        for (usize i = 0; i < LENGTH(appvar_exts); i++) {
+            strcpy(&src[len - 3], appvar_exts[i]);
+            if (fstatat(state.src_fd, src, &st, 0) == 0 && S_ISREG(st.st_mode))
+                return NODE_SOURCE;
+        }
+    } else if (state.both && has_ext(src, len, ".8xv")) {
+        strcpy(&src[len - 4], ".py");
+        if (fstatat(state.src_fd, src, &st, 0) == 0 && S_ISREG(st.st_mode))
+            return NODE_APPVAR;
+    }
+
+    memcpy(src, rel, len + 1);
+    return NODE_PLAIN;
+}
+
+// locates the source in an open AppVar, reading nothing but its header
+static int read_header(int fd, usize* offset, usize* len) {
+    char header[TI_HEADER_SZ];
+    ssize_t n = pread(fd, header, sizeof(header), 0);
+    if (n < 0)
+        return -errno;
+
+    u16 src_len;
+    if (!ti_pyfile_locate_src(header, (usize)n, offset, &src_len))
+        return -EIO;
+    *len = src_len;
+    return 0;
+}
+
+// converts a Python file into an AppVar, or takes it from the cache
+static int load_appvar(const char* src, int fd, const struct stat* st,
+                       Cache_Entry** dest) {
+    char key[PATH_MAX + 64];
+    snprintf(key, sizeof(key), "%s:%lld.%09ld:%lld", src,
+             (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+             (long long)st->st_size);
+    if ((*dest = cache_get(&state.cache, key)))
+        return 0;
+
+    if (st->st_size > TI_MAX_SRC_SZ)
+        return -EFBIG;
+    usize len = (usize)st->st_size;
+    char* data = malloc(len + 1);
+    check_alloc(data);
+    usize got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, &data[got], len - got, (off_t)got);
+        if (n <= 0) {
+            // truncated under us: convert what is there
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        got += (usize)n;
+    }
+    data[got] = '\0';
+
+    char var_name[VAR_NAME_SZ + 1];
+    const char* base = strrchr(src, '/');
+    base = base ? base + 1 : src;
+    name_sanitize(base, strlen(base) - 3, var_name);
+
+    Ti_PyFile f = ti_pyfile_new_with_metadata_full(data, (u16)got, NULL, 0,
+                                                   NULL, var_name);
+    char* appvar;
+    usize appvar_len = ti_pyfile_dump(&f, &appvar);
+    ti_pyfile_free(&f);
+    free(data);
+
+    *dest = cache_put(&state.cache, key, appvar, appvar_len);
+    return 0;
+}
+
+static int mount_getattr(const char* path, struct stat* st,
+                         struct fuse_file_info* fi) {
+    (void)fi;
+    char src[PATH_MAX];
+    Node_Kind kind = resolve(path, src);
+    int flags = kind == NODE_PLAIN ? AT_SYMLINK_NOFOLLOW : 0;
+    if (fstatat(state.src_fd, src, st, flags) < 0)
+        return -errno;
+    st->st_mode &= ~(mode_t)(S_IWUSR | S_IWGRP | S_IWOTH);
+
+    switch (kind) {
+        case NODE_PLAIN: {
+        } break;
+        case NODE_SOURCE: {
+            int fd = openat(state.src_fd, src, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return -errno;
+            usize offset, len;
+            int res = read_header(fd, &offset, &len);
+            close(fd);
+            if (res < 0)
+                return res;
+            st->st_size = (off_t)len;
+        } break;
+        case NODE_APPVAR: {
+            if (st->st_size > TI_MAX_SRC_SZ)
+                return -EFBIG;
+            st->st_size = (off_t)ti_pyfile_dump_size((usize)st->st_size, 0);
+        } break;
+    }
+    if (kind != NODE_PLAIN)
+        st->st_blocks = (st->st_size + 511) / 512;
+    return 0;
+}
+
+static int mount_readlink(const char* path, char* buf, size_t size) {
+    const char* rel = path[1] ? &path[1] : ".";
+    ssize_t n = readlinkat(state.src_fd, rel, buf, size - 1);
+    if (n < 0)
+        return -errno;
+    buf[n] = '\0';
+    return 0;
+}
+
+// lists `name` with its extension swapped, unless a real file has that name
+static void fill_mapped(int dirfd, const char* name, usize stem_len,
+                        const char* ext, void* buf, fuse_fill_dir_t filler) {
+    char mapped[NAME_MAX + 1];
+    if (stem_len + strlen(ext) > NAME_MAX)
+        return;
+    memcpy(mapped, name, stem_len);
+    strcpy(&mapped[stem_len], ext);
+
+    struct stat st;
+    if (fstatat(dirfd, mapped, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        return;
+    filler(buf, mapped, NULL, 0, 0);
+}
+
+static int mount_readdir(const char* path, void* buf, fuse_fill_dir_t filler,
+                         off_t off, struct fuse_file_info* fi,
+                         enum fuse_readdir_flags flags) {
+    (void)off, (void)fi, (void)flags;
+    const char* rel = path[1] ? &path[1] : ".";
+    int fd = openat(state.src_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+        if (filler(buf, ent->d_name, NULL, 0, 0))
+            break;
+        if (ent->d_type != DT_REG && ent->d_type != DT_LNK &&
+            ent->d_type != DT_UNKNOWN)
+            continue;
+
+        usize len = strlen(ent->d_name);
+        if (has_ext(ent->d_name, len, ".8xv"))
+            fill_mapped(fd, ent->d_name, len - 4, ".py", buf, filler);
+        else if (state.both && has_ext(ent->d_name, len, ".py"))
+            fill_mapped(fd, ent->d_name, len - 3, ".8xv", buf, filler);
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+static int mount_open(const char* path, struct fuse_file_info* fi) {
+    if ((fi->flags & O_ACCMODE) != O_RDONLY)
+        return -EROFS;
+
+    char src[PATH_MAX];
+    Node_Kind kind = resolve(path, src);
+    int fd = openat(state.src_fd, src, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    Mount_File* f = calloc(1, sizeof(Mount_File));
+    check_alloc(f);
+    f->kind = kind;
+    f->fd = fd;
+
+    int res = 0;
+    switch (kind) {
+        case NODE_PLAIN: {
+        } break;
+        case NODE_SOURCE: {
+            // served straight from the AppVar, nothing is converted
+            res = read_header(fd, &f->offset, &f->len);
+        } break;
+        case NODE_APPVAR: {
+            struct stat st;
+            if (fstat(fd, &st) < 0)
+                res = -errno;
+            else
+                res = load_appvar(src, fd, &st, &f->entry);
+            // the buffer is all we need
+            close(fd);
+            f->fd = -1;
+        } break;
+    }
+
+    if (res < 0) {
+        if (f->fd >= 0)
+            close(f->fd);
+        free(f);
+        return res;
+    }
+
+    // contents only change with the source file, which the kernel checks
+    fi->keep_cache = kind != NODE_PLAIN;
+    fi->fh = (u64)(uintptr_t)f;
+    return 0;
+}
+
+static int mount_read(const char* path, char* buf, size_t size, off_t off,
+                      struct fuse_file_info* fi) {
+    (void)path;
+    Mount_File* f = (Mount_File*)(uintptr_t)fi->fh;
+
+    if (f->kind == NODE_APPVAR) {
+        Cache_Entry* e = f->entry;
+        if ((usize)off >= e->len)
+            return 0;
+        if (size > e->len - (usize)off)
+            size = e->len - (usize)off;
+        memcpy(buf, &e->data[off], size);
+        return (int)size;
+    }
+
+    if (f->kind == NODE_SOURCE) {
+        if ((usize)off >= f->len)
+            return 0;
+        if (size > f->len - (usize)off)
+            size = f->len - (usize)off;
+        off += (off_t)f->offset;
+    }
+
+    ssize_t n = pread(f->fd, buf, size, off);
+    return n < 0 ? -errno : (int)n;
+}
+
+static int mount_release(const char* path, struct fuse_file_info* fi) {
+    (void)path;
+    Mount_File* f = (Mount_File*)(uintptr_t)fi->fh;
+    if (f->entry)
+        cache_release(&state.cache, f->entry);
+    if (f->fd >= 0)
+        close(f->fd);
+    free(f);
+    return 0;
+}
+
+static const struct fuse_operations mount_ops = {
+    .getattr = mount_getattr,
+    .readlink = mount_readlink,
+    .readdir = mount_readdir,
+    .open = mount_open,
+    .read = mount_read,
+    .release = mount_release,
+};
+
+int mount_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"both", no_argument, 0, 'b'},
+        {"cache", required_argument, 0, 'c'},
+        {"foreground", no_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    bool foreground = false;
+    const char* fuse_opts = NULL;
+    usize cache_mb = 64;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "bc:fo:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'b': {
+                state.both = true;
+            } break;
+            case 'c': {
+                char* end;
+                unsigned long long mb = strtoull(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || mb > SIZE_MAX >> 20) {
+                    warn("invalid cache size \"%s\"", optarg);
+                    return EXIT_FAILURE;
+                }
+                cache_mb = (usize)mb;
+            } break;
+            case 'f': {
+                foreground = true;
+            } break;
+            case 'o': {
+                fuse_opts = optarg;
+            } break;
+            case 'h': {
+                puts(MOUNT_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(MOUNT_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (argc - optind != 2) {
+        puts(MOUNT_HELP);
+        return EXIT_FAILURE;
+    }
+
+    const char* src_dir = argv[optind];
+    state.src_fd = open(src_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.src_fd < 0)
+        fatal("could not open source directory \"%s\": %s", src_dir,
+              strerror(errno));
+    state.cache.cap = cache_mb << 20;
+    pthread_mutex_init(&state.cache.lock, NULL);
+
+    // the source directory is opened before daemonizing, which changes to /
+    char* fuse_argv[8];
+    int fuse_argc = 0;
+    fuse_argv[fuse_argc++] = argv[0];
+    fuse_argv[fuse_argc++] = argv[optind + 1];
+    fuse_argv[fuse_argc++] = "-o";
+    fuse_argv[fuse_argc++] = "ro,default_permissions,fsname=tipyconv";
+    if (fuse_opts) {
+        fuse_argv[fuse_argc++] = "-o";
+        fuse_argv[fuse_argc++] = (char*)fuse_opts;
+    }
+    if (foreground)
+        fuse_argv[fuse_argc++] = "-f";
+    fuse_argv[fuse_argc] = NULL;
+
+    int res = fuse_main(fuse_argc, fuse_argv, &mount_ops, NULL);
+
+    // unmounted: nothing is open anymore
+    for (usize i = 0; i < CACHE_BUCKETS; i++) {
+        Cache_Entry* e = state.cache.buckets[i];
+        while (e) {
+            Cache_Entry* next = e->next;
+            entry_free(e);
+            e = next;
+        }
+    }
+    pthread_mutex_destroy(&state.cache.lock);
+    close(state.src_fd);
+    return res;
+}
+
+#else // HAVE_FUSE
+
+int mount_main(int argc, char** argv) {
+    if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) {
+        puts(MOUNT_HELP);
+        return EXIT_SUCCESS;
+    }
+    warn("tipyconv was built without FUSE support (install libfuse3 and "
+         "rebuild)");
+    return EXIT_FAILURE;
+}
+
+#endif // HAVE_FUSE
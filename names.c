@@ -0,0 +1,156 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "names.h"
+
+#define NAME_FALLBACK "PYFILE"
+
+// packs a name into a key. Names don't contain null bytes, so no name packs
+// to 0, which marks empty slots.
+static u64 name_key(const char* name) {
+    u64 key = 0;
+    for (usize i = 0; i < NAME_MAX_LEN && name[i]; i++)
+        key |= (u64)(u8)name[i] << (8 * i);
+    return key;
+}
+
+static usize key_slot(u64 key, usize cap) {
+    // a 64-bit finalizer (from MurmurHash3), names share long prefixes
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return (usize)key & (cap - 1);
+}
+
+Name_Set name_set_new(usize expected) {
+    usize cap = 64;
+    while (cap < expected * 2)
+        cap *= 2;
+
+    Name_Set s = {.cap = cap};
+    s.items = calloc(cap, sizeof(Name_Entry));
+    check_alloc(s.items);
+    return s;
+}
+
+void name_set_free(Name_Set* s) {
+    free(s->items);
+    *s = (Name_Set){0};
+}
+
+static Name_Entry* find(Name_Set* s, u64 key) {
+    usize i = key_slot(key, s->cap);
+    while (s->items[i].key && s->items[i].key != key)
+        i = (i + 1) & (s->cap - 1);
+    return &s->items[i];
+}
+
+static void grow(Name_Set* s) {
+    Name_Set bigger = {.cap = s->cap * 2, .len = s->len};
+    bigger.items = calloc(bigger.cap, sizeof(Name_Entry));
+    check_alloc(bigger.items);
+
+    for (usize i = 0; i < s->cap; i++) {
+        if (s->items[i].key)
+            *find(&bigger, s->items[i].key) = s->items[i];
+    }
+    free(s->items);
+    *s = bigger;
+}
+
+// finds the entry of a name, adding it if it's new
+static Name_Entry* insert(Name_Set* s, u64 key, bool* added) {
+    // keep the load factor under 1/2
+    if ((s->len + 1) * 2 > s->cap)
+        grow(s);
+
+    Name_Entry* e = find(s, key);
+    *added = e->key == 0;
+    if (*added) {
+        e->key = key;
+        e->next = 1;
+        s->len++;
+    }
+    return e;
+}
+
+bool name_set_claim(Name_Set* s, const char* name) {
+    bool added;
+    insert(s, name_key(name), &added);
+    return added;
+}
+
+void name_set_allocate(Name_Set* s, const char* want, char* dest) {
+    bool added;
+    Name_Entry* e = insert(s, name_key(want), &added);
+    usize want_len = strnlen(want, NAME_MAX_LEN);
+    memcpy(dest, want, want_len);
+    dest[want_len] = '\0';
+    if (added)
+        return;
+
+    // candidates may have been taken by other names, keep counting
+    for (;;) {
+        char suffix[16];
+        int n = snprintf(suffix, sizeof(suffix), "%u", e->next++);
+        usize keep = want_len;
+        if (keep + (usize)n > NAME_MAX_LEN)
+            keep = NAME_MAX_LEN - (usize)n;
+
+        memcpy(dest, want, keep);
+        memcpy(&dest[keep], suffix, (usize)n + 1);
+        // `e` moves if the table grows
+        u64 base = e->key;
+        if (name_set_claim(s, dest))
+            return;
+        e = find(s, base);
+    }
+}
+
+static bool is_upper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool name_valid(const char* name) {
+    usize len = strlen(name);
+    if (len == 0 || len > NAME_MAX_LEN || !is_upper(name[0]))
+        return false;
+    for (usize i = 1; i < len; i++) {
+        if (!is_upper(name[i]) && !is_digit(name[i]))
+            return false;
+    }
+    return true;
+}
+
+void name_sanitize(const char* src, usize len, char* dest) {
+    usize n = 0;
+    for (usize i = 0; i < len && n < NAME_MAX_LEN; i++) {
+        char c = src[i];
+        if (c >= 'a' && c <= 'z')
+            c = (char)(c - 'a' + 'A');
+        // names start with a letter
+        if (is_upper(c) || (n > 0 && is_digit(c)))
+            dest[n++] = c;
+    }
+    dest[n] = '\0';
+
+    if (n == 0)
+        strcpy(dest, NAME_FALLBACK);
+}
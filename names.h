@@ -0,0 +1,97 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: allocation of unique variable names for batches
+ */
+
+#ifndef _NAMES_H
+#define _NAMES_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+// longest variable name, without the null terminator
+#define NAME_MAX_LEN 8
+
+/*
+ * A set of the variable names taken so far. Names are at most 8 bytes long,
+ * so each one is packed into a single u64 key. Every name also remembers the
+ * next suffix to try when it is wanted again, so handing out `SORTING1`,
+ * `SORTING2`, ... for the same name stays O(1) per name.
+ */
+
+typedef struct {
+    u64 key;
+    // next suffix for names derived from this one
+    u32 next;
+} Name_Entry;
+
+typedef struct {
+    Name_Entry* items;
+    usize cap;
+    usize len;
+} Name_Set;
+
+/**
+ * Creates an empty set.
+ *
+ * @param expected number of names that will be added, or 0
+ */
+Name_Set name_set_new(usize expected);
+
+/**
+ * Frees a set.
+ *
+ * @param s the set
+ */
+void name_set_free(Name_Set* s);
+
+/**
+ * Takes a name, if it is still free.
+ *
+ * @param s the set
+ * @param name the name, at most `NAME_MAX_LEN` bytes are used
+ * @return false if the name was already taken
+ */
+bool name_set_claim(Name_Set* s, const char* name);
+
+/**
+ * Takes `want` if it is free, otherwise the first free name made from it by
+ * replacing its end with a number (`SORTINGB`, then `SORTING1`, `SORTING2`,
+ * ... `SORTIN10`). The same sequence of calls always gives the same names.
+ *
+ * @param s the set
+ * @param want the wanted name, at most `NAME_MAX_LEN` bytes are used
+ * @param dest the name that was taken, `NAME_MAX_LEN + 1` bytes
+ */
+void name_set_allocate(Name_Set* s, const char* want, char* dest);
+
+/**
+ * Checks a variable name against the calculator's rules: 1 to 8 upper case
+ * letters and digits, starting with a letter.
+ *
+ * @param name the name
+ */
+bool name_valid(const char* name);
+
+/**
+ * Makes a valid variable name out of arbitrary text: letters are upper cased,
+ * anything else that isn't allowed is dropped, and the result is cut down to
+ * `NAME_MAX_LEN`.
+ *
+ * @param src the text
+ * @param len length of the text
+ * @param dest the name, `NAME_MAX_LEN + 1` bytes. `PYFILE` if nothing of the
+ * text could be used.
+ */
+void name_sanitize(const char* src, usize len, char* dest);
+
+#endif // _NAMES_H
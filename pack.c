@@ -0,0 +1,875 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv pack`, `unpack` and `get`, a single file archive of scripts
+ * and AppVars with an index that is read in place
+ */
+#define _GNU_SOURCE
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "tipyconv.h"
+
+#define PACK_HELP                                                              \
+    "usage: tipyconv pack [OPTIONS] -o ARCHIVE <file or dir>...\n"             \
+    "Packs scripts and AppVars (directories are searched for .py and .8xv "    \
+    "files)\n"                                                                 \
+    "into one archive, that `tipyconv get' reads single entries from.\n"       \
+    "Options:\n"                                                               \
+    "  -o, --output ARCHIVE: The archive to write\n"                           \
+    "  -z, --zstd[=LEVEL]:   Compress the archive with zstd (level 1 to 22, "  \
+    "default 3)\n"                                                             \
+    "  -h, --help:           Show this help screen"
+
+#define UNPACK_HELP                                                            \
+    "usage: tipyconv unpack [OPTIONS] ARCHIVE\n"                               \
+    "Restores every entry of an archive made by `tipyconv pack' to its "       \
+    "path.\n"                                                                  \
+    "Options:\n"                                                               \
+    "  -d, --dir DIR:        Restore into DIR (default: the current "          \
+    "directory)\n"                                                             \
+    "  -h, --help:           Show this help screen"
+
+#define GET_HELP                                                               \
+    "usage: tipyconv get [OPTIONS] ARCHIVE NAME\n"                             \
+    "Extracts one entry of an archive made by `tipyconv pack', by its path "   \
+    "or its\n"                                                                 \
+    "variable name. The source is written to stdout by default.\n"             \
+    "Options:\n"                                                               \
+    "  -o, --output FILE:    Write to FILE instead, as an AppVar if it ends "  \
+    "in .8xv\n"                                                                \
+    "  -h, --help:           Show this help screen"
+
+/*
+ * The archive is a header, the blocks and the index:
+ *
+ *   header   "TIPYPACK", the version, the flags and where the tables are
+ *   blocks   the records of the entries (file info, file name and source),
+ *            back to back. A block holds about `PACK_BLOCK_SZ` of them, and
+ *            is compressed on its own with --zstd.
+ *   blocks   table: offset, stored and raw length of each block
+ *   entries  table, sorted by path, which makes it the index of paths as well
+ *   names    (variable name, entry) pairs, sorted by name
+ *   strings  the paths, null terminated
+ *
+ * Numbers are little endian and the tables start at multiples of 8, so that
+ * they can be used in place once the archive is mapped. An entry never spans
+ * blocks, so getting one is a lookup in either index and one block read.
+ */
+
+#define PACK_MAGIC    "TIPYPACK"
+#define PACK_VERSION  1
+#define PACK_BLOCK_SZ (64 * 1024)
+// the blocks are compressed with zstd
+#define PACK_ZSTD 0x1
+// the entry is an AppVar, not a script
+#define PACK_APPVAR 0x1
+
+#define PACK_ZSTD_LEVEL 3
+
+typedef struct {
+    char magic[8];
+    u32 version;
+    u32 flags;
+    u64 nentries;
+    u64 nblocks;
+    // offsets of the tables
+    u64 blocks;
+    u64 entries;
+    u64 names;
+    u64 strings;
+    u64 strings_len;
+} Pack_Header;
+
+typedef struct {
+    u64 offset;
+    u32 len;
+    // a block that is as long as its raw length is stored as is
+    u32 raw_len;
+} Pack_Block;
+
+// the fields of a `Ti_PyFile`, and where its record is
+typedef struct {
+    char var_name[VAR_NAME_SZ];
+    u32 block;
+    // of the record, within the uncompressed block
+    u32 offset;
+    // of the path, within the strings
+    u32 path;
+    u16 src_len;
+    u8 file_name_len;
+    u8 flags;
+} Pack_Entry;
+
+typedef struct {
+    char var_name[VAR_NAME_SZ];
+    u32 entry;
+} Pack_Name;
+
+_Static_assert(sizeof(Pack_Header) == 72, "Pack_Header is not packed");
+_Static_assert(sizeof(Pack_Block) == 16, "Pack_Block is not packed");
+_Static_assert(sizeof(Pack_Entry) == 24, "Pack_Entry is not packed");
+_Static_assert(sizeof(Pack_Name) == 12, "Pack_Name is not packed");
+
+// the path an input is stored under: relative, without a leading `./`
+static const char* stored_path(const char* path) {
+    for (;;) {
+        if (path[0] == '/')
+            path++;
+        else if (path[0] == '.' && path[1] == '/')
+            path += 2;
+        else
+            return path;
+    }
+}
+
+static int cmp_paths(const void* a, const void* b) {
+    return strcmp(stored_path(*(char* const*)a), stored_path(*(char* const*)b));
+}
+
+// === pack ===
+
+typedef struct {
+    char** paths;
+    usize len;
+    usize cap;
+} Pack_Inputs;
+
+static void add_input(const char* path, void* ctx) {
+    Pack_Inputs* in = ctx;
+    if (in->len == in->cap) {
+        in->cap = in->cap ? in->cap * 2 : 64;
+        in->paths = realloc(in->paths, in->cap * sizeof(char*));
+        check_alloc(in->paths);
+    }
+    in->paths[in->len] = strdup(path);
+    check_alloc(in->paths[in->len]);
+    in->len++;
+}
+
+typedef struct {
+    FILE* fp;
+    // where the next write goes
+    u64 off;
+    int level;
+
+    char* block;
+    usize block_len;
+    Pack_Block* blocks;
+    usize nblocks;
+    usize blocks_cap;
+
+    Pack_Entry* entries;
+    usize nentries;
+    char* strings;
+    usize strings_len;
+    usize strings_cap;
+} Pack_Writer;
+
+static bool put(Pack_Writer* w, const void* data, usize len) {
+    if (len && fwrite(data, 1, len, w->fp) != len)
+        return false;
+    w->off += len;
+    return true;
+}
+
+// pads the archive to a multiple of 8
+static bool put_align(Pack_Writer* w) {
+    static const char zeros[8] = {0};
+    return put(w, zeros, (8 - w->off % 8) % 8);
+}
+
+static bool flush_block(Pack_Writer* w) {
+    if (w->block_len == 0)
+        return true;
+
+    const char* data = w->block;
+    usize len = w->block_len;
+#ifdef HAVE_ZSTD
+    char* compressed = NULL;
+    if (w->level) {
+        usize bound = ZSTD_compressBound(w->block_len);
+        compressed = malloc(bound);
+        check_alloc(compressed);
+        usize res = ZSTD_compress(compressed, bound, w->block, w->block_len,
+                                  w->level);
+        if (ZSTD_isError(res)) {
+            warn("could not compress a block: %s", ZSTD_getErrorName(res));
+            free(compressed);
+            return false;
+        }
+        // what does not compress is left as is
+        if (res < w->block_len) {
+            data = compressed;
+            len = res;
+        }
+    }
+#endif
+
+    if (w->nblocks == w->blocks_cap) {
+        w->blocks_cap = w->blocks_cap ? w->blocks_cap * 2 : 16;
+        w->blocks = realloc(w->blocks, w->blocks_cap * sizeof(Pack_Block));
+        check_alloc(w->blocks);
+    }
+    w->blocks[w->nblocks++] = (Pack_Block){
+        .offset = htole64(w->off),
+        .len = htole32((u32)len),
+        .raw_len = htole32((u32)w->block_len),
+    };
+    bool ok = put(w, data, len);
+#ifdef HAVE_ZSTD
+    free(compressed);
+#endif
+    w->block_len = 0;
+    return ok;
+}
+
+// appends the record of a file to the current block, and its entry
+static bool put_file(Pack_Writer* w, const Ti_PyFile* f, const char* path,
+                     u8 flags) {
+    usize len = FILE_INFO_SZ + f->file_name_len + f->src_len;
+    if (w->block_len + len > PACK_BLOCK_SZ && !flush_block(w))
+        return false;
+    // a record larger than a block gets one of its own
+    if (w->block_len + len > PACK_BLOCK_SZ) {
+        w->block = realloc(w->block, len);
+        check_alloc(w->block);
+    }
+
+    Pack_Entry* e = &w->entries[w->nentries++];
+    memcpy(e->var_name, f->var_name, VAR_NAME_SZ);
+    e->block = htole32((u32)w->nblocks);
+    e->offset = htole32((u32)w->block_len);
+    e->path = htole32((u32)w->strings_len);
+    e->src_len = htole16(f->src_len);
+    e->file_name_len = f->file_name_len;
+    e->flags = flags;
+
+    char* rec = &w->block[w->block_len];
+    memcpy(rec, f->file_info, FILE_INFO_SZ);
+    if (f->file_name_len)
+        memcpy(&rec[FILE_INFO_SZ], f->file_name, f->file_name_len);
+    memcpy(&rec[FILE_INFO_SZ + f->file_name_len], f->src, f->src_len);
+    w->block_len += len;
+
+    usize path_len = strlen(path) + 1;
+    while (w->strings_len + path_len > w->strings_cap) {
+        w->strings_cap = w->strings_cap ? w->strings_cap * 2 : 4096;
+        w->strings = realloc(w->strings, w->strings_cap);
+        check_alloc(w->strings);
+    }
+    memcpy(&w->strings[w->strings_len], path, path_len);
+    w->strings_len += path_len;
+    return true;
+}
+
+// reads an input into a `Ti_PyFile`. `canonical` is cleared for AppVars that
+// `ti_pyfile_dump` would not write the same way.
+static bool load_input(const char* path, Ti_PyFile* f, u8* flags,
+                       bool* canonical) {
+    usize len;
+    char* data = read_input(path, &len);
+    if (!data) {
+        warn("could not read \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    *canonical = true;
+    if (ti_is_appvar(data, len)) {
+        usize off;
+        u16 src_len;
+        *f = ti_pyfile_new_invalid();
+        // the parser trusts the sizes in the header
+        if (ti_pyfile_checksum_valid(data, len) &&
+            ti_pyfile_locate_src(data, len, &off, &src_len) &&
+            off + src_len + 2 <= len)
+            *f = ti_pyfile_parse(data, NULL);
+        if (!ti_pyfile_valid(f)) {
+            warn("\"%s\" is not a valid Python AppVar", path);
+            free(data);
+            return false;
+        }
+
+        char* dump;
+        usize dump_len = ti_pyfile_dump(f, &dump);
+        *canonical = dump_len == len && !memcmp(dump, data, len);
+        free(dump);
+        *flags = PACK_APPVAR;
+    } else {
+        if (len > TI_MAX_SRC_SZ) {
+            warn("\"%s\" is too large for an AppVar, convert it with --split",
+                 path);
+            free(data);
+            return false;
+        }
+        char var_name[VAR_NAME_SZ + 1];
+        get_var_name_from_path(path, var_name);
+        *f = ti_pyfile_new_with_metadata_full(data, (u16)len, NULL, 0, NULL,
+                                              var_name);
+        *flags = 0;
+    }
+    free(data);
+    return true;
+}
+
+static int cmp_names(const void* a, const void* b) {
+    const Pack_Name* na = a;
+    const Pack_Name* nb = b;
+    int res = memcmp(na->var_name, nb->var_name, VAR_NAME_SZ);
+    if (res)
+        return res;
+    return le32toh(na->entry) < le32toh(nb->entry) ? -1 : 1;
+}
+
+// writes the tables and the header, after the blocks
+static bool finish(Pack_Writer* w) {
+    if (!flush_block(w) || !put_align(w))
+        return false;
+
+    Pack_Header h = {
+        .version = htole32(PACK_VERSION),
+        .flags = htole32(w->level ? PACK_ZSTD : 0),
+        .nentries = htole64(w->nentries),
+        .nblocks = htole64(w->nblocks),
+    };
+    memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+
+    h.blocks = htole64(w->off);
+    if (!put(w, w->blocks, w->nblocks * sizeof(Pack_Block)) || !put_align(w))
+        return false;
+    h.entries = htole64(w->off);
+    if (!put(w, w->entries, w->nentries * sizeof(Pack_Entry)) ||
+        !put_align(w))
+        return false;
+
+    Pack_Name* names = calloc(w->nentries + 1, sizeof(Pack_Name));
+    check_alloc(names);
+    for (usize i = 0; i < w->nentries; i++) {
+        memcpy(names[i].var_name, w->entries[i].var_name, VAR_NAME_SZ);
+        names[i].entry = htole32((u32)i);
+    }
+    qsort(names, w->nentries, sizeof(Pack_Name), cmp_names);
+    usize shared = 0;
+    for (usize i = 1; i < w->nentries; i++) {
+        if (!memcmp(names[i].var_name, names[i - 1].var_name, VAR_NAME_SZ))
+            shared++;
+    }
+    if (shared)
+        warn("%zu entries share their variable name with another, `tipyconv "
+             "get' finds the first of them by path",
+             shared);
+
+    h.names = htole64(w->off);
+    bool ok = put(w, names, w->nentries * sizeof(Pack_Name)) && put_align(w);
+    free(names);
+    if (!ok)
+        return false;
+
+    h.strings = htole64(w->off);
+    h.strings_len = htole64(w->strings_len);
+    if (!put(w, w->strings, w->strings_len))
+        return false;
+
+    return fseek(w->fp, 0, SEEK_SET) == 0 &&
+           fwrite(&h, sizeof(h), 1, w->fp) == 1;
+}
+
+int pack_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"output", required_argument, 0, 'o'},
+        {"zstd", optional_argument, 0, 'z'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    const char* out_path = NULL;
+    int level = 0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "o:z::h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'o': {
+                out_path = optarg;
+            } break;
+            case 'z': {
+#ifdef HAVE_ZSTD
+                level = PACK_ZSTD_LEVEL;
+                if (optarg) {
+                    char* end;
+                    long l = strtol(optarg, &end, 10);
+                    if (*end || l < 1 || l > ZSTD_maxCLevel())
+                        fatal("invalid zstd level: \"%s\"", optarg);
+                    level = (int)l;
+                }
+#else
+                fatal("tipyconv was built without zstd support (install "
+                      "libzstd and rebuild)");
+#endif
+            } break;
+            case 'h': {
+                puts(PACK_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(PACK_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (!out_path || optind >= argc) {
+        puts(PACK_HELP);
+        return EXIT_FAILURE;
+    }
+
+    Pack_Inputs in = {0};
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+            scan_scripts(argv[i], add_input, &in);
+        else
+            add_input(argv[i], &in);
+    }
+    qsort(in.paths, in.len, sizeof(char*), cmp_paths);
+
+    Pack_Writer w = {
+        .level = level,
+        .block = malloc(PACK_BLOCK_SZ),
+        .entries = calloc(in.len + 1, sizeof(Pack_Entry)),
+    };
+    check_alloc(w.block);
+    check_alloc(w.entries);
+
+    w.fp = fopen(out_path, "wb");
+    if (!w.fp)
+        fatal("could not open \"%s\" for writing: %s", out_path,
+              strerror(errno));
+
+    // the header is written last, once the tables are
+    bool ok = put(&w, &(Pack_Header){0}, sizeof(Pack_Header));
+    usize failed = 0;
+    usize rewritten = 0;
+    for (usize i = 0; ok && i < in.len; i++) {
+        const char* path = stored_path(in.paths[i]);
+        if (i > 0 && !strcmp(path, stored_path(in.paths[i - 1]))) {
+            warn("\"%s\" was given more than once", in.paths[i]);
+            continue;
+        }
+
+        Ti_PyFile f;
+        u8 flags;
+        bool canonical;
+        if (!load_input(in.paths[i], &f, &flags, &canonical)) {
+            failed++;
+            continue;
+        }
+        rewritten += !canonical;
+        ok = put_file(&w, &f, path, flags);
+        ti_pyfile_free(&f);
+    }
+    ok = ok && finish(&w);
+    if (fclose(w.fp) != 0)
+        ok = false;
+
+    if (!ok) {
+        warn("could not write \"%s\": %s", out_path, strerror(errno));
+        unlink(out_path);
+    } else {
+        if (rewritten)
+            warn("%zu AppVar(s) will be unpacked with a canonical header",
+                 rewritten);
+        info("packed %zu file(s) into \"%s\" (%zu bytes, %zu block(s))",
+             w.nentries, out_path, (usize)w.off, w.nblocks);
+    }
+
+    for (usize i = 0; i < in.len; i++)
+        free(in.paths[i]);
+    free(in.paths);
+    free(w.block);
+    free(w.blocks);
+    free(w.entries);
+    free(w.strings);
+    return ok && failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// === reading ===
+
+typedef struct {
+    const char* path;
+    const char* data;
+    usize len;
+    bool zstd;
+    usize nentries;
+    usize nblocks;
+    const Pack_Block* blocks;
+    const Pack_Entry* entries;
+    const Pack_Name* names;
+    const char* strings;
+    usize strings_len;
+
+    // the last block that was decompressed
+    char* cache;
+    usize cached;
+} Pack_Archive;
+
+// checks that a table of `n` elements of `sz` bytes at `off` is in the archive
+static bool table_valid(const Pack_Archive* a, u64 off, u64 n, usize sz) {
+    return off % 8 == 0 && off <= a->len && n <= (a->len - off) / sz;
+}
+
+static bool archive_open(Pack_Archive* a, const char* path) {
+    *a = (Pack_Archive){.path = path, .cached = SIZE_MAX};
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        warn("could not open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Pack_Header)) {
+        warn("\"%s\" is not an archive made by `tipyconv pack'", path);
+        close(fd);
+        return false;
+    }
+    a->len = (usize)st.st_size;
+    void* map = mmap(NULL, a->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        warn("could not map \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+    a->data = map;
+
+    const Pack_Header* h = map;
+    u64 nentries = le64toh(h->nentries);
+    u64 nblocks = le64toh(h->nblocks);
+    u64 strings = le64toh(h->strings);
+    u64 strings_len = le64toh(h->strings_len);
+    u32 flags = le32toh(h->flags);
+    if (memcmp(h->magic, PACK_MAGIC, 8) != 0 ||
+        le32toh(h->version) != PACK_VERSION || (flags & ~PACK_ZSTD) ||
+        !table_valid(a, le64toh(h->blocks), nblocks, sizeof(Pack_Block)) ||
+        !table_valid(a, le64toh(h->entries), nentries, sizeof(Pack_Entry)) ||
+        !table_valid(a, le64toh(h->names), nentries, sizeof(Pack_Name)) ||
+        strings > a->len || strings_len > a->len - strings ||
+        (strings_len && a->data[strings + strings_len - 1] != '\0')) {
+        warn("\"%s\" is not an archive made by `tipyconv pack', or it is "
+             "damaged",
+             path);
+        munmap(map, a->len);
+        return false;
+    }
+
+    a->zstd = flags & PACK_ZSTD;
+#ifndef HAVE_ZSTD
+    if (a->zstd) {
+        warn("\"%s\" is compressed, but tipyconv was built without zstd "
+             "support (install libzstd and rebuild)",
+             path);
+        munmap(map, a->len);
+        return false;
+    }
+#endif
+    a->nentries = nentries;
+    a->nblocks = nblocks;
+    a->blocks = (const Pack_Block*)&a->data[le64toh(h->blocks)];
+    a->entries = (const Pack_Entry*)&a->data[le64toh(h->entries)];
+    a->names = (const Pack_Name*)&a->data[le64toh(h->names)];
+    a->strings = &a->data[strings];
+    a->strings_len = strings_len;
+    return true;
+}
+
+static void archive_close(Pack_Archive* a) {
+    free(a->cache);
+    munmap((void*)a->data, a->len);
+}
+
+static const char* entry_path(const Pack_Archive* a, const Pack_Entry* e) {
+    u32 off = le32toh(e->path);
+    return off < a->strings_len ? &a->strings[off] : NULL;
+}
+
+// reads a block, from the mapping if it is stored as is
+static const char* read_block(Pack_Archive* a, usize i, usize* raw_len) {
+    const Pack_Block* b = &a->blocks[i];
+    u64 off = le64toh(b->offset);
+    u32 len = le32toh(b->len);
+    *raw_len = le32toh(b->raw_len);
+    if (off > a->len || len > a->len - off)
+        return NULL;
+    if (len == *raw_len)
+        return &a->data[off];
+
+#ifdef HAVE_ZSTD
+    if (a->cached == i)
+        return a->cache;
+    a->cache = realloc(a->cache, *raw_len + 1);
+    check_alloc(a->cache);
+    a->cached = SIZE_MAX;
+    usize res = ZSTD_decompress(a->cache, *raw_len, &a->data[off], len);
+    if (ZSTD_isError(res) || res != *raw_len)
+        return NULL;
+    a->cached = i;
+    return a->cache;
+#else
+    return NULL;
+#endif
+}
+
+// rebuilds the file of an entry
+static bool entry_load(Pack_Archive* a, const Pack_Entry* e, Ti_PyFile* f) {
+    u32 block = le32toh(e->block);
+    u32 off = le32toh(e->offset);
+    u16 src_len = le16toh(e->src_len);
+    usize raw_len;
+    const char* data = NULL;
+    if (block < a->nblocks)
+        data = read_block(a, block, &raw_len);
+    if (!data || off > raw_len ||
+        (usize)FILE_INFO_SZ + e->file_name_len + src_len > raw_len - off)
+        return false;
+
+    const char* rec = &data[off];
+    const char* file_name = e->file_name_len ? &rec[FILE_INFO_SZ] : NULL;
+    *f = ti_pyfile_new_with_metadata_full(
+        &rec[FILE_INFO_SZ + e->file_name_len], src_len, file_name,
+        e->file_name_len, NULL, NULL);
+    memcpy(f->file_info, rec, FILE_INFO_SZ);
+    memcpy(f->var_name, e->var_name, VAR_NAME_SZ);
+    return true;
+}
+
+// writes an entry as an AppVar, or as its source
+static bool write_entry(Ti_PyFile* f, const char* path, bool appvar) {
+    char* appvar_data = NULL;
+    const char* data = f->src;
+    usize len = f->src_len;
+    if (appvar) {
+        len = ti_pyfile_dump(f, &appvar_data);
+        data = appvar_data;
+    }
+
+    FILE* fp = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+    if (!fp) {
+        warn("could not open \"%s\" for writing: %s", path, strerror(errno));
+        free(appvar_data);
+        return false;
+    }
+    bool ok = fwrite(data, 1, len, fp) == len;
+    if (fp == stdout ? fflush(fp) != 0 : fclose(fp) != 0)
+        ok = false;
+    if (!ok)
+        warn("could not write \"%s\"", path);
+    free(appvar_data);
+    return ok;
+}
+
+// creates the directories above a path
+static bool make_parents(char* path) {
+    for (char* p = strchr(path, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *p = '/';
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// paths that would end up outside of the directory that is unpacked into
+static bool path_safe(const char* path) {
+    if (path[0] == '\0' || path[0] == '/')
+        return false;
+    for (const char* p = path;; p++) {
+        if (!strncmp(p, "..", 2) && (p[2] == '/' || p[2] == '\0'))
+            return false;
+        p = strchr(p, '/');
+        if (!p)
+            return true;
+    }
+}
+
+int unpack_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"dir", required_argument, 0, 'd'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    const char* dir = ".";
+
+    int c;
+    while ((c = getopt_long(argc, argv, "d:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'd': {
+                dir = optarg;
+            } break;
+            case 'h': {
+                puts(UNPACK_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(UNPACK_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        puts(UNPACK_HELP);
+        return EXIT_FAILURE;
+    }
+
+    Pack_Archive a;
+    if (!archive_open(&a, argv[optind]))
+        return EXIT_FAILURE;
+
+    usize failed = 0;
+    for (usize i = 0; i < a.nentries; i++) {
+        const Pack_Entry* e = &a.entries[i];
+        const char* path = entry_path(&a, e);
+        if (!path || !path_safe(path)) {
+            warn("entry %zu of \"%s\" has an invalid path", i, a.path);
+            failed++;
+            continue;
+        }
+
+        usize len = strlen(dir) + strlen(path) + 2;
+        char* out = malloc(len);
+        check_alloc(out);
+        snprintf(out, len, "%s/%s", dir, path);
+
+        Ti_PyFile f = ti_pyfile_new_invalid();
+        if (!entry_load(&a, e, &f)) {
+            warn("\"%s\" is damaged in \"%s\"", path, a.path);
+            failed++;
+        } else if (!make_parents(out)) {
+            warn("could not create the directories of \"%s\": %s", out,
+                 strerror(errno));
+            failed++;
+        } else if (!write_entry(&f, out, e->flags & PACK_APPVAR)) {
+            failed++;
+        }
+        ti_pyfile_free(&f);
+        free(out);
+    }
+
+    info("unpacked %zu of %zu file(s) into \"%s\"", a.nentries - failed,
+         a.nentries, dir);
+    archive_close(&a);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// looks an entry up by its path, then by its variable name
+static const Pack_Entry* archive_find(const Pack_Archive* a,
+                                      const char* name) {
+    const char* path = stored_path(name);
+    usize lo = 0;
+    usize hi = a->nentries;
+    while (lo < hi) {
+        usize mid = lo + (hi - lo) / 2;
+        const char* other = entry_path(a, &a->entries[mid]);
+        int res = other ? strcmp(path, other) : -1;
+        if (res == 0)
+            return &a->entries[mid];
+        if (res < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    if (strlen(name) > VAR_NAME_SZ)
+        return NULL;
+    char key[VAR_NAME_SZ] = {0};
+    memcpy(key, name, strlen(name));
+    // the first of the entries with that name
+    lo = 0;
+    hi = a->nentries;
+    while (lo < hi) {
+        usize mid = lo + (hi - lo) / 2;
+        if (memcmp(a->names[mid].var_name, key, VAR_NAME_SZ) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == a->nentries ||
+        memcmp(a->names[lo].var_name, key, VAR_NAME_SZ) != 0)
+        return NULL;
+    u32 entry = le32toh(a->names[lo].entry);
+    return entry < a->nentries ? &a->entries[entry] : NULL;
+}
+
+int get_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    const char* out_path = "-";
+
+    int c;
+    while ((c = getopt_long(argc, argv, "o:h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'o': {
+                out_path = optarg;
+            } break;
+            case 'h': {
+                puts(GET_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(GET_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        puts(GET_HELP);
+        return EXIT_FAILURE;
+    }
+
+    Pack_Archive a;
+    if (!archive_open(&a, argv[optind]))
+        return EXIT_FAILURE;
+
+    const char* name = argv[optind + 1];
+    const Pack_Entry* e = archive_find(&a, name);
+    bool ok = false;
+    Ti_PyFile f;
+    if (!e) {
+        warn("\"%s\" is not in \"%s\"", name, a.path);
+    } else if (!entry_load(&a, e, &f)) {
+        warn("\"%s\" is damaged in \"%s\"", name, a.path);
+    } else {
+        ok = write_entry(&f, out_path, has_ext(out_path, ".8xv"));
+        ti_pyfile_free(&f);
+    }
+
+    archive_close(&a);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,299 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: `tipyconv plan`, which works out the memory a set of scripts takes on
+ * the calculator and packs them into sets that fit on one
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "commands.h"
+#include "minify.h"
+#include "tipyconv.h"
+
+#define PLAN_HELP                                                              \
+    "usage: tipyconv plan [OPTIONS] --ram BYTES <filename>...\n"               \
+    "Works out how much memory each script (or AppVar) takes on the "          \
+    "calculator, and\n"                                                        \
+    "packs them into sets that each fit on one calculator. What doesn't fit "  \
+    "into RAM\n"                                                               \
+    "goes to the archive.\n"                                                   \
+    "Options:\n"                                                               \
+    "  -r, --ram BYTES:     Free RAM of a calculator (K, M and G suffixes "    \
+    "work)\n"                                                                  \
+    "  -a, --archive BYTES: Free archive of a calculator (default: none)\n"    \
+    "  -m, --minify[=names]:\n"                                                \
+    "                       Plan for minified sources (see tipyconv --help)\n" \
+    "  -h, --help:          Show this help screen"
+
+// the entry of a variable in the variable allocation table: type, T2, version,
+// a 24-bit address, the name length and the name. It stays in RAM when the
+// variable is archived.
+#define VAT_ENTRY_SZ 7
+// before an archived variable's data: a flag, a 16-bit size and a copy of its
+// VAT entry
+#define ARCHIVE_HEADER_SZ (3 + VAT_ENTRY_SZ)
+
+typedef struct {
+    const char* path;
+    char var_name[VAR_NAME_SZ + 1];
+    usize src_len;
+    // of the .8xv file
+    usize file_len;
+    // in RAM: the data and the VAT entry
+    usize ram;
+    // in the archive, and what it still takes of RAM then
+    usize archive;
+    usize vat;
+    // the set it was put in, from 1. 0 if it fits in none.
+    usize set;
+    bool archived;
+} Plan_Item;
+
+typedef struct {
+    usize ram;
+    usize archive;
+} Plan_Set;
+
+// works out the footprint of an input. Returns false if it can't be read.
+static bool measure(Plan_Item* it, bool min, bool min_names) {
+    usize len;
+    char* data = read_input(it->path, &len);
+    if (!data) {
+        warn("could not read \"%s\": %s", it->path, strerror(errno));
+        return false;
+    }
+
+    u8 file_name_len = 0;
+    if (ti_is_appvar(data, len)) {
+        Ti_PyFile f = ti_pyfile_new_invalid();
+        // the parser trusts the header's sizes, so they must fit in the data
+        usize offset;
+        u16 src_len;
+        if (ti_pyfile_locate_src(data, len, &offset, &src_len) &&
+            offset + src_len + 2 <= len && ti_pyfile_checksum_valid(data, len))
+            f = ti_pyfile_parse(data, NULL);
+        if (!ti_pyfile_valid(&f)) {
+            warn("\"%s\" is not a valid Python AppVar", it->path);
+            free(data);
+            return false;
+        }
+        strncpy(it->var_name, f.var_name, VAR_NAME_SZ);
+        it->src_len = f.src_len;
+        file_name_len = f.file_name_len;
+        ti_pyfile_free(&f);
+    } else {
+        get_var_name_from_path(it->path, it->var_name);
+        it->src_len = len;
+        if (min) {
+            char* minified = malloc(len + 1);
+            check_alloc(minified);
+            if (!minify(data, len, minified, &it->src_len, min_names)) {
+                warn("could not minify \"%s\", planning for it as is",
+                     it->path);
+                it->src_len = len;
+            }
+            free(minified);
+        }
+    }
+    free(data);
+
+    if (it->src_len + (file_name_len ? file_name_len + 2 : 0) >
+        TI_MAX_SRC_SZ) {
+        warn("\"%s\" is too large for an AppVar, convert it with --split",
+             it->path);
+        return false;
+    }
+
+    usize data_len = ti_pyfile_data_size(it->src_len, file_name_len);
+    usize name_len = strlen(it->var_name);
+    it->file_len = ti_pyfile_dump_size(it->src_len, file_name_len);
+    it->ram = data_len + VAT_ENTRY_SZ + name_len;
+    it->archive = data_len + ARCHIVE_HEADER_SZ + name_len;
+    it->vat = VAT_ENTRY_SZ + name_len;
+    return true;
+}
+
+static int cmp_items(const void* a, const void* b) {
+    const Plan_Item* ia = a;
+    const Plan_Item* ib = b;
+    if (ia->ram != ib->ram)
+        return ia->ram > ib->ram ? -1 : 1;
+    return strcmp(ia->path, ib->path);
+}
+
+static int cmp_placed(const void* a, const void* b) {
+    const Plan_Item* ia = a;
+    const Plan_Item* ib = b;
+    if (ia->set != ib->set)
+        return ia->set < ib->set ? -1 : 1;
+    if (ia->archived != ib->archived)
+        return ia->archived ? 1 : -1;
+    return strcmp(ia->path, ib->path);
+}
+
+// first fit decreasing: the largest scripts go first, into the RAM of the
+// first set with room, then into its archive. A set is only added once
+// neither fits anywhere.
+static usize pack(Plan_Item* items, usize n, usize ram, usize archive,
+                  Plan_Set** sets) {
+    Plan_Set* res = calloc(n + 1, sizeof(Plan_Set));
+    check_alloc(res);
+    usize nsets = 0;
+
+    qsort(items, n, sizeof(Plan_Item), cmp_items);
+    for (usize i = 0; i < n; i++) {
+        Plan_Item* it = &items[i];
+        if (it->ram > ram && (it->archive > archive || it->vat > ram))
+            continue;
+
+        for (usize s = 0; !it->set && s < nsets; s++) {
+            if (res[s].ram + it->ram <= ram) {
+                res[s].ram += it->ram;
+                it->set = s + 1;
+            }
+        }
+        for (usize s = 0; !it->set && s < nsets; s++) {
+            if (res[s].archive + it->archive <= archive &&
+                res[s].ram + it->vat <= ram) {
+                res[s].archive += it->archive;
+                res[s].ram += it->vat;
+                it->set = s + 1;
+                it->archived = true;
+            }
+        }
+        if (!it->set) {
+            Plan_Set* s = &res[nsets++];
+            it->set = nsets;
+            it->archived = it->ram > ram;
+            s->ram = it->archived ? it->vat : it->ram;
+            s->archive = it->archived ? it->archive : 0;
+        }
+    }
+
+    *sets = res;
+    return nsets;
+}
+
+int plan_main(int argc, char** argv) {
+    static const struct option opts[] = {
+        {"ram", required_argument, 0, 'r'},
+        {"archive", required_argument, 0, 'a'},
+        {"minify", optional_argument, 0, 'm'},
+        {"help", no_argument, 0, 'h'},
+        {0},
+    };
+
+    usize ram = 0;
+    usize archive = 0;
+    bool min = false;
+    bool min_names = false;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "r:a:m::h", opts, NULL)) != -1) {
+        switch (c) {
+            case 'r': {
+                if (!parse_size(optarg, &ram))
+                    fatal("invalid size: \"%s\"", optarg);
+            } break;
+            case 'a': {
+                if (!parse_size(optarg, &archive))
+                    fatal("invalid size: \"%s\"", optarg);
+            } break;
+            case 'm': {
+                min = true;
+                if (optarg && !strcasecmp(optarg, "names"))
+                    min_names = true;
+                else if (optarg)
+                    fatal("unknown minify option: \"%s\"", optarg);
+            } break;
+            case 'h': {
+                puts(PLAN_HELP);
+                return EXIT_SUCCESS;
+            } break;
+            default: {
+                puts(PLAN_HELP);
+                return EXIT_FAILURE;
+            } break;
+        }
+    }
+
+    if (ram == 0 || optind >= argc) {
+        puts(PLAN_HELP);
+        return EXIT_FAILURE;
+    }
+
+    usize n = (usize)(argc - optind);
+    Plan_Item* items = calloc(n, sizeof(Plan_Item));
+    check_alloc(items);
+    usize nitems = 0;
+    usize failed = 0;
+    for (usize i = 0; i < n; i++) {
+        Plan_Item* it = &items[nitems];
+        it->path = argv[optind + i];
+        if (measure(it, min, min_names))
+            nitems++;
+        else
+            failed++;
+    }
+
+    Plan_Set* sets;
+    usize nsets = pack(items, nitems, ram, archive, &sets);
+    qsort(items, nitems, sizeof(Plan_Item), cmp_placed);
+
+    printf("%-8s  %8s  %8s  %8s  %8s  %s\n", "VAR", "SOURCE", "APPVAR", "RAM",
+           "ARCHIVE", "FILE");
+    usize unplaced = 0;
+    for (usize i = 0; i < nitems; i++) {
+        const Plan_Item* it = &items[i];
+        if (!it->set) {
+            unplaced++;
+            continue;
+        }
+        printf("%-8s  %8zu  %8zu  %8zu  %8zu  %s\n", it->var_name,
+               it->src_len, it->file_len, it->ram, it->archive, it->path);
+    }
+
+    for (usize s = 0; s < nsets; s++) {
+        printf("\nset %zu: %zu of %zu bytes of RAM, %zu of %zu bytes of "
+               "archive\n",
+               s + 1, sets[s].ram, ram, sets[s].archive, archive);
+        for (usize i = 0; i < nitems; i++) {
+            const Plan_Item* it = &items[i];
+            if (it->set == s + 1)
+                printf("  %-8s  %-7s  %s\n", it->var_name,
+                       it->archived ? "archive" : "RAM", it->path);
+        }
+    }
+
+    // these sort first, with set 0
+    for (usize i = 0; i < nitems && !items[i].set; i++)
+        warn("\"%s\" does not fit on a calculator (%zu bytes of RAM, %zu "
+             "archived)",
+             items[i].path, items[i].ram, items[i].archive);
+
+    if (unplaced + failed == 0 && nsets <= 1)
+        info("everything fits on one calculator");
+    else if (unplaced + failed == 0)
+        info("%zu calculators are needed", nsets);
+    else
+        info("%zu of %zu file(s) could not be planned for", unplaced + failed,
+             n);
+
+    free(sets);
+    free(items);
+    return unplaced + failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
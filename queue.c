@@ -0,0 +1,259 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
+
+#include "queue.h"
+
+Queue queue_new(usize cap) {
+    Queue q = {.cap = cap};
+    q.items = calloc(cap, sizeof(void*));
+    check_alloc(q.items);
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.not_empty, NULL);
+    pthread_cond_init(&q.not_full, NULL);
+    return q;
+}
+
+bool queue_push(Queue* q, void* item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->len == q->cap && !q->closed)
+        pthread_cond_wait(&q->not_full, &q->lock);
+
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return false;
+    }
+
+    q->items[(q->head + q->len) % q->cap] = item;
+    q->len++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+void* queue_pop(Queue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->len == 0 && !q->closed)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+
+    void* item = NULL;
+    if (q->len > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->len--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+void queue_close(Queue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void queue_free(Queue* q) {
+    free(q->items);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+// === futexes ===
+
+#ifdef __linux__
+
+// sleeps until `word` is woken, unless it no longer holds `val`
+static void futex_wait(atomic_uint* word, unsigned val) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint* word, int n) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#else
+
+// no futexes: waiting degrades to polling
+static void futex_wait(atomic_uint* word, unsigned val) {
+    (void)word, (void)val;
+    sched_yield();
+}
+
+static void futex_wake(atomic_uint* word, int n) {
+    (void)word, (void)n;
+}
+#endif
+
+// sleeps on `word` while it still holds `seen`
+static void wait_on(atomic_uint* word, atomic_uint* waiters, unsigned seen) {
+    atomic_fetch_add(waiters, 1);
+    futex_wait(word, seen);
+    atomic_fetch_sub(waiters, 1);
+}
+
+// bumps `word` and wakes up to `n` threads sleeping on it
+static void wake_on(atomic_uint* word, atomic_uint* waiters, int n) {
+    atomic_fetch_add(word, 1);
+    if (atomic_load(waiters) > 0)
+        futex_wake(word, n);
+}
+
+// === lock-free queue ===
+
+void lf_queue_init(Lf_Queue* q, usize cap) {
+    usize n = 2;
+    while (n < cap)
+        n *= 2;
+
+    q->cells = calloc(n, sizeof(Lf_Cell));
+    check_alloc(q->cells);
+    q->mask = n - 1;
+    for (usize i = 0; i < n; i++)
+        atomic_init(&q->cells[i].seq, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->pushes, 0);
+    atomic_init(&q->pops, 0);
+    atomic_init(&q->push_waiters, 0);
+    atomic_init(&q->pop_waiters, 0);
+    atomic_init(&q->closed, false);
+}
+
+static bool try_push(Lf_Queue* q, void* item) {
+    usize pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        Lf_Cell* c = &q->cells[pos & q->mask];
+        usize seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                c->item = item;
+                atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // full: the cell still holds an item from the previous lap
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+static bool try_pop(Lf_Queue* q, void** item) {
+    usize pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        Lf_Cell* c = &q->cells[pos & q->mask];
+        usize seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *item = c->item;
+                // hand the cell to the producer of the next lap
+                atomic_store_explicit(&c->seq, pos + q->mask + 1,
+                                      memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // empty
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+bool lf_queue_push(Lf_Queue* q, void* item) {
+    for (;;) {
+        unsigned seen = atomic_load(&q->pops);
+        if (atomic_load(&q->closed))
+            return false;
+        if (try_push(q, item)) {
+            wake_on(&q->pushes, &q->pop_waiters, 1);
+            return true;
+        }
+        wait_on(&q->pops, &q->push_waiters, seen);
+    }
+}
+
+void* lf_queue_pop(Lf_Queue* q) {
+    for (;;) {
+        unsigned seen = atomic_load(&q->pushes);
+        bool closed = atomic_load(&q->closed);
+        void* item;
+        if (try_pop(q, &item)) {
+            wake_on(&q->pops, &q->push_waiters, 1);
+            return item;
+        }
+        // nothing can be pushed anymore, and we have seen it empty since
+        if (closed)
+            return NULL;
+        wait_on(&q->pushes, &q->pop_waiters, seen);
+    }
+}
+
+void lf_queue_close(Lf_Queue* q) {
+    atomic_store(&q->closed, true);
+    wake_on(&q->pushes, &q->pop_waiters, INT_MAX);
+    wake_on(&q->pops, &q->push_waiters, INT_MAX);
+}
+
+void lf_queue_free(Lf_Queue* q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+// === byte budget ===
+
+void budget_init(Budget* b, usize cap) {
+    b->cap = cap;
+    atomic_init(&b->used, 0);
+    atomic_init(&b->releases, 0);
+    atomic_init(&b->waiters, 0);
+}
+
+void budget_acquire(Budget* b, usize n) {
+    for (;;) {
+        unsigned seen = atomic_load(&b->releases);
+        usize used = atomic_load(&b->used);
+        while (used == 0 || used + n <= b->cap) {
+            if (atomic_compare_exchange_weak(&b->used, &used, used + n))
+                return;
+        }
+        wait_on(&b->releases, &b->waiters, seen);
+    }
+}
+
+void budget_add(Budget* b, usize n) {
+    atomic_fetch_add(&b->used, n);
+}
+
+void budget_release(Budget* b, usize n) {
+    atomic_fetch_sub(&b->used, n);
+    wake_on(&b->releases, &b->waiters, INT_MAX);
+}
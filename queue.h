@@ -0,0 +1,179 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: bounded queues and a byte budget, used to connect pipeline stages
+ */
+
+#ifndef _QUEUE_H
+#define _QUEUE_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+typedef struct {
+    void** items;
+    usize cap;
+    usize head;
+    usize len;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} Queue;
+
+/**
+ * Creates a new queue.
+ *
+ * @param cap maximum number of items in the queue
+ */
+Queue queue_new(usize cap);
+
+/**
+ * Pushes an item, blocking while the queue is full.
+ *
+ * @param q the queue
+ * @param item the item, must not be NULL
+ * @return false if the queue was closed
+ */
+bool queue_push(Queue* q, void* item);
+
+/**
+ * Pops an item, blocking while the queue is empty.
+ *
+ * @param q the queue
+ * @return the item, or NULL once the queue is closed and drained
+ */
+void* queue_pop(Queue* q);
+
+/**
+ * Closes the queue. Pending items can still be popped, further pushes fail.
+ *
+ * @param q the queue
+ */
+void queue_close(Queue* q);
+
+/**
+ * Frees the queue. Items still in it are not freed.
+ *
+ * @param q the queue
+ */
+void queue_free(Queue* q);
+
+// === lock-free queue ===
+//
+// a bounded multi-producer, multi-consumer queue (Dmitry Vyukov's): every
+// cell carries a sequence number that tells producers and consumers whose
+// turn it is, so pushes and pops are a single compare-and-swap when they don't
+// have to wait. Waiting threads sleep on a futex instead of spinning.
+
+typedef struct {
+    atomic_size_t seq;
+    void* item;
+} Lf_Cell;
+
+typedef struct {
+    Lf_Cell* cells;
+    usize mask;
+    // producers and consumers write to different cache lines
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    // bumped after every push and pop, waiters sleep on them
+    _Alignas(64) atomic_uint pushes;
+    atomic_uint pops;
+    atomic_uint push_waiters;
+    atomic_uint pop_waiters;
+    atomic_bool closed;
+} Lf_Queue;
+
+/**
+ * Creates a new lock-free queue.
+ *
+ * @param q the queue
+ * @param cap maximum number of items, rounded up to a power of two
+ */
+void lf_queue_init(Lf_Queue* q, usize cap);
+
+/**
+ * Pushes an item, sleeping while the queue is full.
+ *
+ * @param q the queue
+ * @param item the item, must not be NULL
+ * @return false if the queue was closed
+ */
+bool lf_queue_push(Lf_Queue* q, void* item);
+
+/**
+ * Pops an item, sleeping while the queue is empty.
+ *
+ * @param q the queue
+ * @return the item, or NULL once the queue is closed and drained
+ */
+void* lf_queue_pop(Lf_Queue* q);
+
+/**
+ * Closes the queue. Pending items can still be popped, further pushes fail.
+ * Must only be called once every producer is done pushing.
+ *
+ * @param q the queue
+ */
+void lf_queue_close(Lf_Queue* q);
+
+/**
+ * Frees the queue. Items still in it are not freed.
+ *
+ * @param q the queue
+ */
+void lf_queue_free(Lf_Queue* q);
+
+// === byte budget ===
+//
+// caps the number of bytes held by a pipeline at once. Only the first stage
+// waits for room, later stages account for what they allocate without waiting,
+// so that the pipeline can always drain.
+
+typedef struct {
+    usize cap;
+    atomic_size_t used;
+    // bumped on every release, waiters sleep on it
+    atomic_uint releases;
+    atomic_uint waiters;
+} Budget;
+
+/**
+ * Creates a budget.
+ *
+ * @param b the budget
+ * @param cap the number of bytes that may be in use at once
+ */
+void budget_init(Budget* b, usize cap);
+
+/**
+ * Takes `n` bytes, sleeping until they fit. Always succeeds if nothing is in
+ * use, so that an item larger than the whole budget can still pass.
+ *
+ * @param b the budget
+ * @param n the number of bytes
+ */
+void budget_acquire(Budget* b, usize n);
+
+/**
+ * Takes `n` bytes without waiting, even if that goes over the cap.
+ */
+void budget_add(Budget* b, usize n);
+
+/**
+ * Gives back `n` bytes.
+ */
+void budget_release(Budget* b, usize n);
+
+#endif // _QUEUE_H
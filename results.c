@@ -0,0 +1,78 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json.h"
+#include "results.h"
+
+bool results_enabled = false;
+
+static FILE* results_fp;
+static bool results_failed;
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* STATUS_NAMES[] = {
+    [RESULT_OK] = "ok",
+    [RESULT_ERROR] = "error",
+    [RESULT_SKIPPED] = "skipped",
+};
+
+bool results_open(const char* path) {
+    results_fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!results_fp)
+        return false;
+    results_enabled = true;
+    return true;
+}
+
+void results_record(const Result* res) {
+    if (!results_enabled)
+        return;
+
+    pthread_mutex_lock(&results_lock);
+    FILE* fp = results_fp;
+    fputs("{\"input\":", fp);
+    json_write_string(fp, res->input);
+    fputs(",\"output\":", fp);
+    json_write_string(fp, res->output);
+    fprintf(fp, ",\"status\":\"%s\",\"in_bytes\":%llu,\"out_bytes\":%llu",
+            STATUS_NAMES[res->status], (unsigned long long)res->in_bytes,
+            (unsigned long long)res->out_bytes);
+    if (res->checksum < 0)
+        fputs(",\"checksum\":null", fp);
+    else
+        fprintf(fp, ",\"checksum\":%d", res->checksum);
+    fprintf(fp,
+            ",\"read_us\":%.1f,\"convert_us\":%.1f,\"write_us\":%.1f,"
+            "\"total_us\":%.1f}\n",
+            (double)res->read_ns / 1e3, (double)res->convert_ns / 1e3,
+            (double)res->write_ns / 1e3, (double)res->total_ns / 1e3);
+    // whoever consumes the stream sees every input as soon as it's done
+    if (fflush(fp) != 0)
+        results_failed = true;
+    pthread_mutex_unlock(&results_lock);
+}
+
+bool results_close(void) {
+    if (!results_enabled)
+        return true;
+
+    bool ok = !results_failed && !ferror(results_fp);
+    if (results_fp == stdout)
+        ok = fflush(stdout) == 0 && ok;
+    else
+        ok = fclose(results_fp) == 0 && ok;
+    results_fp = NULL;
+    results_enabled = false;
+    return ok;
+}
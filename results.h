@@ -0,0 +1,79 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: per-input result records (`--results`)
+ */
+
+#ifndef _RESULTS_H
+#define _RESULTS_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/*
+ * One JSON object per line, written as soon as an input is done (so not
+ * necessarily in input order):
+ *
+ *   {"input":"a.py","output":"A.8xv","status":"ok","in_bytes":120,
+ *    "out_bytes":199,"checksum":12345,"read_us":10.2,"convert_us":3.1,
+ *    "write_us":40.7,"total_us":55.0}
+ *
+ * `checksum` is the checksum of the AppVar side of the conversion, `null` if
+ * there is none (e.g. on errors). `output` is `null` if nothing was written.
+ */
+
+typedef enum {
+    RESULT_OK = 0,
+    RESULT_ERROR,
+    // already converted according to the journal
+    RESULT_SKIPPED,
+} Result_Status;
+
+typedef struct {
+    const char* input;
+    const char* output;
+    Result_Status status;
+    u64 in_bytes;
+    u64 out_bytes;
+    // -1 if there is none
+    int checksum;
+    u64 read_ns;
+    u64 convert_ns;
+    u64 write_ns;
+    u64 total_ns;
+} Result;
+
+// set once before any worker starts, read-only afterwards.
+extern bool results_enabled;
+
+/**
+ * Opens the result stream and enables recording.
+ *
+ * @param path path to the file (truncated if it exists), `-` for stdout
+ * @return false if the file could not be opened (errno is set)
+ */
+bool results_open(const char* path);
+
+/**
+ * Writes the record of an input. Safe to call from any thread.
+ *
+ * @param res the result
+ */
+void results_record(const Result* res);
+
+/**
+ * Closes the result stream.
+ *
+ * @return false if any record could not be written
+ */
+bool results_close(void);
+
+#endif // _RESULTS_H
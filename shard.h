@@ -0,0 +1,41 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: deterministic assignment of inputs to shards (`--shard`)
+ */
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include "3rdparty/include/a_common.h"
+#include "hash.h"
+
+/**
+ * The part of a path that identifies an input across machines: the path
+ * without any leading `./`.
+ */
+static inline const char* shard_key(const char* path) {
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+        while (*path == '/')
+            path++;
+    }
+    return path;
+}
+
+/**
+ * The shard (out of `n`) that an input belongs to. Only depends on the path,
+ * so independent processes agree on it without talking to each other.
+ */
+static inline usize shard_of(const char* path, usize n) {
+    return (usize)(hash_str(shard_key(path)) % n);
+}
+
+#endif // _SHARD_H
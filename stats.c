@@ -0,0 +1,208 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+// every thread owns one of these, and only ever writes to its own. They are
+// linked together (with a lock-free push) so that the report can find them
+// after the workers have been joined.
+typedef struct Stats_Thread {
+    u64 phase_ns[STATS_NPHASES];
+    u64 bytes_in;
+    u64 bytes_out;
+    u64 allocs;
+    u64 files;
+    u64 failed;
+    // per-file conversion times, for percentiles
+    u64* file_ns;
+    usize file_ns_len;
+    usize file_ns_cap;
+    struct Stats_Thread* next;
+} Stats_Thread;
+
+static const char* PHASE_NAMES[STATS_NPHASES] = {
+    [STATS_READ] = "read",         [STATS_PARSE] = "parse",
+    [STATS_CHECKSUM] = "checksum", [STATS_DUMP] = "dump",
+    [STATS_WRITE] = "write",       [STATS_SYNC] = "fsync",
+};
+
+bool stats_enabled = false;
+
+static _Atomic(Stats_Thread*) threads = NULL;
+static _Thread_local Stats_Thread* local = NULL;
+
+static Stats_Thread* stats_local(void) {
+    if (local)
+        return local;
+
+    local = calloc(1, sizeof(Stats_Thread));
+    check_alloc(local);
+
+    Stats_Thread* head = atomic_load_explicit(&threads, memory_order_relaxed);
+    do {
+        local->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &threads, &head, local, memory_order_release, memory_order_relaxed));
+
+    return local;
+}
+
+void _stats_add_phase(Stats_Phase phase, u64 ns) {
+    stats_local()->phase_ns[phase] += ns;
+}
+
+const char* stats_phase_name(Stats_Phase phase) {
+    return PHASE_NAMES[phase];
+}
+
+void _stats_add_bytes(u64 in, u64 out) {
+    Stats_Thread* t = stats_local();
+    t->bytes_in += in;
+    t->bytes_out += out;
+}
+
+void _stats_add_allocs(u64 n) {
+    stats_local()->allocs += n;
+}
+
+void stats_file_done(u64 start, bool ok) {
+    if (!stats_enabled)
+        return;
+
+    Stats_Thread* t = stats_local();
+    t->files++;
+    if (!ok)
+        t->failed++;
+
+    if (t->file_ns_len + 1 > t->file_ns_cap) {
+        t->file_ns_cap = t->file_ns_cap ? t->file_ns_cap * 2 : 64;
+        t->file_ns = realloc(t->file_ns, t->file_ns_cap * sizeof(u64));
+        check_alloc(t->file_ns);
+    }
+    t->file_ns[t->file_ns_len++] = stats_now() - start;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    u64 x = *(const u64*)a;
+    u64 y = *(const u64*)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of a sorted array
+static u64 percentile(const u64* sorted, usize len, u32 p) {
+    if (len == 0)
+        return 0;
+    usize rank = (len * p + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    return sorted[rank - 1];
+}
+
+static double ms(u64 ns) {
+    return (double)ns / 1e6;
+}
+
+void stats_report(FILE* fp, Stats_Format fmt, u64 wall_ns) {
+    Stats_Thread total = {0};
+    usize nthreads = 0;
+
+    Stats_Thread* t = atomic_load_explicit(&threads, memory_order_acquire);
+    for (; t; t = t->next) {
+        for (usize i = 0; i < STATS_NPHASES; i++)
+            total.phase_ns[i] += t->phase_ns[i];
+        total.bytes_in += t->bytes_in;
+        total.bytes_out += t->bytes_out;
+        total.allocs += t->allocs;
+        total.files += t->files;
+        total.failed += t->failed;
+        total.file_ns_len += t->file_ns_len;
+        nthreads++;
+    }
+
+    u64* lat = calloc(total.file_ns_len + 1, sizeof(u64));
+    check_alloc(lat);
+    usize n = 0;
+    for (t = atomic_load_explicit(&threads, memory_order_acquire); t;
+         t = t->next) {
+        memcpy(&lat[n], t->file_ns, t->file_ns_len * sizeof(u64));
+        n += t->file_ns_len;
+    }
+    qsort(lat, n, sizeof(u64), cmp_u64);
+
+    u64 p50 = percentile(lat, n, 50);
+    u64 p90 = percentile(lat, n, 90);
+    u64 p99 = percentile(lat, n, 99);
+    u64 max = n ? lat[n - 1] : 0;
+    double secs = (double)wall_ns / 1e9;
+    double fps = secs > 0 ? (double)total.files / secs : 0;
+
+    u64 busy_ns = 0;
+    for (usize i = 0; i < STATS_NPHASES; i++)
+        busy_ns += total.phase_ns[i];
+
+    if (fmt == STATS_FMT_JSON) {
+        fprintf(fp,
+                "{\"files\":%llu,\"failed\":%llu,\"threads\":%zu,"
+                "\"wall_ns\":%llu,\"files_per_sec\":%.1f,"
+                "\"bytes_in\":%llu,\"bytes_out\":%llu,\"allocs\":%llu,"
+                "\"phases_ns\":{",
+                (unsigned long long)total.files,
+                (unsigned long long)total.failed, nthreads,
+                (unsigned long long)wall_ns, fps,
+                (unsigned long long)total.bytes_in,
+                (unsigned long long)total.bytes_out,
+                (unsigned long long)total.allocs);
+        for (usize i = 0; i < STATS_NPHASES; i++)
+            fprintf(fp, "%s\"%s\":%llu", i ? "," : "", PHASE_NAMES[i],
+                    (unsigned long long)total.phase_ns[i]);
+        fprintf(fp,
+                "},\"file_ns\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+                "\"max\":%llu}}\n",
+                (unsigned long long)p50, (unsigned long long)p90,
+                (unsigned long long)p99, (unsigned long long)max);
+    } else {
+        fprintf(fp, "%llu files (%llu failed) in %.3f ms, %.1f files/s\n",
+                (unsigned long long)total.files,
+                (unsigned long long)total.failed, ms(wall_ns), fps);
+        for (usize i = 0; i < STATS_NPHASES; i++) {
+            double pct =
+                busy_ns ? 100.0 * (double)total.phase_ns[i] / busy_ns : 0;
+            fprintf(fp, "  %-10s %10.3f ms  %5.1f%%\n", PHASE_NAMES[i],
+                    ms(total.phase_ns[i]), pct);
+        }
+        fprintf(fp, "  bytes in: %llu, bytes out: %llu, allocations: %llu\n",
+                (unsigned long long)total.bytes_in,
+                (unsigned long long)total.bytes_out,
+                (unsigned long long)total.allocs);
+        fprintf(fp,
+                "  per file: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, "
+                "max %.3f ms\n",
+                ms(p50), ms(p90), ms(p99), ms(max));
+    }
+
+    free(lat);
+}
+
+void stats_free(void) {
+    Stats_Thread* t = atomic_exchange(&threads, NULL);
+    while (t) {
+        Stats_Thread* next = t->next;
+        free(t->file_ns);
+        free(t);
+        t = next;
+    }
+    local = NULL;
+}
@@ -0,0 +1,120 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: per-phase timing and throughput counters (`--stats`)
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum {
+    STATS_READ = 0,
+    STATS_PARSE,
+    STATS_CHECKSUM,
+    STATS_DUMP,
+    STATS_WRITE,
+    STATS_SYNC,
+    STATS_NPHASES,
+} Stats_Phase;
+
+typedef enum {
+    STATS_FMT_TEXT = 0,
+    STATS_FMT_JSON = 1,
+} Stats_Format;
+
+// set once before any worker starts, read-only afterwards.
+extern bool stats_enabled;
+
+/**
+ * Gets a monotonic timestamp in nanoseconds.
+ */
+static inline u64 stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+/**
+ * Starts timing a phase. Returns 0 (and does not touch the clock) if stats
+ * are disabled.
+ */
+static inline u64 stats_begin(void) {
+    return stats_enabled ? stats_now() : 0;
+}
+
+void _stats_add_phase(Stats_Phase phase, u64 ns);
+
+/**
+ * Gets the human readable name of a phase.
+ */
+const char* stats_phase_name(Stats_Phase phase);
+
+/**
+ * Stops timing a phase started with `stats_begin`, and adds the elapsed time
+ * to the calling thread's counters.
+ *
+ * @param phase the phase
+ * @param start value returned by `stats_begin`
+ */
+static inline void stats_end(Stats_Phase phase, u64 start) {
+    if (stats_enabled)
+        _stats_add_phase(phase, stats_now() - start);
+}
+
+void _stats_add_bytes(u64 in, u64 out);
+void _stats_add_allocs(u64 n);
+
+/**
+ * Counts bytes read and written by the calling thread.
+ */
+static inline void stats_bytes(u64 in, u64 out) {
+    if (stats_enabled)
+        _stats_add_bytes(in, out);
+}
+
+/**
+ * Counts heap allocations made by the calling thread.
+ */
+static inline void stats_allocs(u64 n) {
+    if (stats_enabled)
+        _stats_add_allocs(n);
+}
+
+/**
+ * Records one finished file and its total conversion time.
+ *
+ * @param start value returned by `stats_begin` when the file was started
+ * @param ok whether the conversion succeeded
+ */
+void stats_file_done(u64 start, bool ok);
+
+/**
+ * Prints the aggregate of all threads' counters. Must only be called once
+ * every worker has finished.
+ *
+ * @param fp stream to print to
+ * @param fmt output format
+ * @param wall_ns wall clock time of the whole run
+ */
+void stats_report(FILE* fp, Stats_Format fmt, u64 wall_ns);
+
+/**
+ * Frees all per-thread counters. Must only be called once every worker has
+ * finished.
+ */
+void stats_free(void);
+
+#endif // _STATS_H
@@ -0,0 +1,337 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tar.h"
+
+#define BLOCK_SZ 512
+
+// ustar header field offsets and sizes
+#define H_NAME       0
+#define H_NAME_SZ    100
+#define H_MODE       100
+#define H_UID        108
+#define H_GID        116
+#define H_SIZE       124
+#define H_MTIME      136
+#define H_CHKSUM     148
+#define H_TYPEFLAG   156
+#define H_MAGIC      257
+#define H_VERSION    263
+#define H_PREFIX     345
+#define H_PREFIX_SZ  155
+
+static u64 parse_number(const u8* field, usize len) {
+    // GNU base-256 encoding for large values
+    if (field[0] & 0x80) {
+        u64 res = field[0] & 0x7f;
+        for (usize i = 1; i < len; i++)
+            res = (res << 8) | field[i];
+        return res;
+    }
+
+    u64 res = 0;
+    usize i = 0;
+    while (i < len && field[i] == ' ')
+        i++;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+        res = (res << 3) | (u64)(field[i] - '0');
+    return res;
+}
+
+static u32 header_checksum(const u8* header) {
+    u32 sum = 0;
+    for (usize i = 0; i < BLOCK_SZ; i++) {
+        // the checksum field itself counts as spaces
+        if (i >= H_CHKSUM && i < H_CHKSUM + 8)
+            sum += ' ';
+        else
+            sum += header[i];
+    }
+    return sum;
+}
+
+static bool block_is_zero(const u8* block) {
+    for (usize i = 0; i < BLOCK_SZ; i++) {
+        if (block[i])
+            return false;
+    }
+    return true;
+}
+
+static usize padding(usize len) {
+    return (BLOCK_SZ - len % BLOCK_SZ) % BLOCK_SZ;
+}
+
+// whether `len` bytes of data and their padding can still follow in the
+// stream. Only known for regular files; pipes are caught by `read_data`.
+static bool fits_in_stream(FILE* fp, u64 len) {
+    struct stat st;
+    off_t pos = ftello(fp);
+    if (pos < 0 || fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))
+        return true;
+    u64 left = st.st_size > pos ? (u64)(st.st_size - pos) : 0;
+    return len <= left;
+}
+
+// reads the data of an entry, and the padding after it. The buffer grows with
+// the data that actually arrives, so a corrupt size runs into the end of the
+// stream instead of a huge allocation.
+static char* read_data(FILE* fp, usize len) {
+    usize cap = len < 65536 ? len : 65536;
+    char* data = malloc(cap + 1);
+    check_alloc(data);
+
+    usize got = 0;
+    while (got < len) {
+        if (got == cap) {
+            cap = (len - cap < cap) ? len : cap * 2;
+            data = realloc(data, cap + 1);
+            check_alloc(data);
+        }
+        usize n = fread(&data[got], 1, cap - got, fp);
+        if (n == 0) {
+            free(data);
+            return NULL;
+        }
+        got += n;
+    }
+    data[len] = '\0';
+
+    usize pad = padding(len);
+    u8 scratch[BLOCK_SZ];
+    if (pad && fread(scratch, 1, pad, fp) != pad) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// skips the data of an entry, and the padding after it
+static bool skip_data(FILE* fp, usize len) {
+    usize left = len + padding(len);
+    u8 scratch[BLOCK_SZ];
+    while (left) {
+        usize n = left < BLOCK_SZ ? left : BLOCK_SZ;
+        if (fread(scratch, 1, n, fp) != n)
+            return false;
+        left -= n;
+    }
+    return true;
+}
+
+// finds the `path` record in a pax extended header. Records are
+// "<length> <key>=<value>\n", the length counting the whole record. The data
+// comes from the archive, so the length is parsed by hand and anything that
+// doesn't fit in `len` ends the search.
+static char* pax_path(const char* data, usize len) {
+    usize i = 0;
+    while (i < len) {
+        usize rec_len = 0;
+        usize j = i;
+        while (j < len && data[j] >= '0' && data[j] <= '9' && rec_len <= len)
+            rec_len = rec_len * 10 + (usize)(data[j++] - '0');
+        // the record has to reach past its length and the space
+        if (j == i || j >= len || data[j] != ' ' || rec_len > len - i ||
+            rec_len <= j + 1 - i)
+            break;
+
+        const char* kv = &data[j + 1];
+        const char* rec_end = &data[i + rec_len - 1]; // the newline
+        if (rec_end - kv >= 5 && !strncmp(kv, "path=", 5)) {
+            usize n = rec_end - (kv + 5);
+            char* res = calloc(n + 1, 1);
+            check_alloc(res);
+            memcpy(res, kv + 5, n);
+            return res;
+        }
+        i += rec_len;
+    }
+    return NULL;
+}
+
+Tar_Result tar_read_entry(FILE* fp, Tar_Entry* entry,
+                          bool (*want)(const char* name)) {
+    char* long_name = NULL;
+    u8 header[BLOCK_SZ];
+
+    for (;;) {
+        usize got = fread(header, 1, BLOCK_SZ, fp);
+        // a missing end-of-archive marker is tolerated
+        if (got == 0 && feof(fp))
+            goto end;
+        if (got != BLOCK_SZ)
+            goto error;
+        if (block_is_zero(header))
+            goto end;
+
+        u32 expected = (u32)parse_number(&header[H_CHKSUM], 8);
+        if (header_checksum(header) != expected)
+            goto error;
+
+        u64 size = parse_number(&header[H_SIZE], 12);
+        if (size > SIZE_MAX - BLOCK_SZ || !fits_in_stream(fp, size))
+            goto error;
+        usize len = (usize)size;
+        char type = (char)header[H_TYPEFLAG];
+
+        if (type == 'L' || type == 'x') {
+            char* data = read_data(fp, len);
+            if (!data)
+                goto error;
+            free(long_name);
+            long_name = (type == 'L') ? data : pax_path(data, len);
+            if (type == 'x')
+                free(data);
+            continue;
+        }
+
+        // skip anything that isn't a regular file
+        if (type != '0' && type != '\0' && type != '7') {
+            if (!skip_data(fp, len))
+                goto error;
+            free(long_name);
+            long_name = NULL;
+            continue;
+        }
+
+        if (long_name) {
+            entry->name = long_name;
+            long_name = NULL;
+        } else {
+            char name[H_PREFIX_SZ + 1 + H_NAME_SZ + 1] = {0};
+            if (!memcmp(&header[H_MAGIC], "ustar", 5) && header[H_PREFIX]) {
+                strncpy(name, (char*)&header[H_PREFIX], H_PREFIX_SZ);
+                strcat(name, "/");
+            }
+            strncat(name, (char*)&header[H_NAME], H_NAME_SZ);
+            entry->name = strdup(name);
+            check_alloc(entry->name);
+        }
+
+        entry->data = NULL;
+        if (want && !want(entry->name)) {
+            if (!skip_data(fp, len)) {
+                free(entry->name);
+                goto error;
+            }
+        } else {
+            entry->data = read_data(fp, len);
+            if (!entry->data) {
+                free(entry->name);
+                goto error;
+            }
+        }
+        entry->len = len;
+        entry->mtime = parse_number(&header[H_MTIME], 12);
+        return TAR_OK;
+    }
+
+end:
+    free(long_name);
+    return TAR_END;
+
+error:
+    free(long_name);
+    return TAR_ERROR;
+}
+
+static void write_octal(u8* field, usize len, u64 value) {
+    // len - 1 digits and a null terminator
+    snprintf((char*)field, len, "%0*llo", (int)(len - 1),
+             (unsigned long long)value);
+}
+
+static bool write_header(FILE* fp, const char* name, char type, usize len,
+                         u64 mtime) {
+    u8 header[BLOCK_SZ] = {0};
+    usize name_len = strlen(name);
+
+    if (name_len <= H_NAME_SZ) {
+        memcpy(&header[H_NAME], name, name_len);
+    } else {
+        // split at a slash into prefix and name. The caller falls back to a
+        // GNU long name if this is impossible.
+        const char* slash = name + name_len - H_NAME_SZ - 1;
+        while (*slash && *slash != '/')
+            slash++;
+        usize prefix_len = slash - name;
+        if (!*slash || prefix_len > H_PREFIX_SZ) {
+            memcpy(&header[H_NAME], name, H_NAME_SZ);
+        } else {
+            memcpy(&header[H_PREFIX], name, prefix_len);
+            memcpy(&header[H_NAME], slash + 1, name_len - prefix_len - 1);
+        }
+    }
+
+    write_octal(&header[H_MODE], 8, 0644);
+    write_octal(&header[H_UID], 8, 0);
+    write_octal(&header[H_GID], 8, 0);
+    write_octal(&header[H_SIZE], 12, len);
+    write_octal(&header[H_MTIME], 12, mtime);
+    header[H_TYPEFLAG] = (u8)type;
+    memcpy(&header[H_MAGIC], "ustar", 6);
+    memcpy(&header[H_VERSION], "00", 2);
+
+    u32 sum = header_checksum(header);
+    snprintf((char*)&header[H_CHKSUM], 8, "%06o", sum);
+    header[H_CHKSUM + 7] = ' ';
+
+    return fwrite(header, 1, BLOCK_SZ, fp) == BLOCK_SZ;
+}
+
+static bool write_data(FILE* fp, const char* data, usize len) {
+    static const u8 zeros[BLOCK_SZ] = {0};
+    usize pad = (BLOCK_SZ - len % BLOCK_SZ) % BLOCK_SZ;
+    return fwrite(data, 1, len, fp) == len &&
+           fwrite(zeros, 1, pad, fp) == pad;
+}
+
+// whether a name fits the name (and prefix) fields
+static bool name_fits(const char* name) {
+    usize len = strlen(name);
+    if (len <= H_NAME_SZ)
+        return true;
+
+    const char* slash = name + len - H_NAME_SZ - 1;
+    while (*slash && *slash != '/')
+        slash++;
+    return *slash && (usize)(slash - name) <= H_PREFIX_SZ;
+}
+
+bool tar_write_entry(FILE* fp, const Tar_Entry* entry) {
+    if (!name_fits(entry->name)) {
+        usize len = strlen(entry->name) + 1;
+        if (!write_header(fp, "././@LongLink", 'L', len, 0) ||
+            !write_data(fp, entry->name, len))
+            return false;
+    }
+
+    return write_header(fp, entry->name, '0', entry->len, entry->mtime) &&
+           write_data(fp, entry->data, entry->len);
+}
+
+bool tar_write_end(FILE* fp) {
+    static const u8 zeros[BLOCK_SZ * 2] = {0};
+    return fwrite(zeros, 1, sizeof(zeros), fp) == sizeof(zeros);
+}
+
+void tar_entry_free(Tar_Entry* entry) {
+    free(entry->name);
+    free(entry->data);
+    entry->name = NULL;
+    entry->data = NULL;
+}
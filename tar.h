@@ -0,0 +1,79 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: streaming tar (ustar) reader and writer
+ */
+
+#ifndef _TAR_H
+#define _TAR_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+    // path within the archive (null terminated)
+    char* name;
+    // file contents (null terminated)
+    char* data;
+    usize len;
+    // modification time, in seconds since the epoch
+    u64 mtime;
+} Tar_Entry;
+
+typedef enum {
+    TAR_OK = 0,
+    TAR_END = 1,
+    TAR_ERROR = 2,
+} Tar_Result;
+
+/**
+ * Reads the next regular file from a tar stream. Directories, links and other
+ * special entries are skipped. GNU long names and pax `path` records are
+ * supported. Entries whose size doesn't fit in the rest of the stream are
+ * malformed.
+ *
+ * @param fp the stream, positioned at a header
+ * @param entry the entry, only valid if TAR_OK is returned
+ * @param want decides by name whether the data of a file is read. If it
+ * returns false, the data is skipped and `entry->data` is NULL. May be NULL
+ * to read every file.
+ * @return TAR_OK on success, TAR_END at the end of the archive, TAR_ERROR on
+ * a malformed archive or a read error
+ */
+Tar_Result tar_read_entry(FILE* fp, Tar_Entry* entry,
+                          bool (*want)(const char* name));
+
+/**
+ * Writes a regular file to a tar stream.
+ *
+ * @param fp the stream
+ * @param entry the entry
+ * @return true on success
+ */
+bool tar_write_entry(FILE* fp, const Tar_Entry* entry);
+
+/**
+ * Writes the end-of-archive marker.
+ *
+ * @param fp the stream
+ * @return true on success
+ */
+bool tar_write_end(FILE* fp);
+
+/**
+ * Frees an entry.
+ *
+ * @param entry the entry
+ */
+void tar_entry_free(Tar_Entry* entry);
+
+#endif // _TAR_H
@@ -0,0 +1,263 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: text normalization, and transcoding between UTF-8 and the
+ * calculator's character set (`--normalize`)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define TEXT_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    u32 cp;
+    // in the calculator's character set, never longer than the code point in
+    // UTF-8
+    const char* ti;
+} Ti_Char;
+
+// by code point
+static const Ti_Char TO_TI[] = {
+    {0x00A0, " "},    {0x00A1, "\xBA"}, {0x00A8, "\xB8"}, {0x00AB, "\""},
+    {0x00B0, "\xD4"}, {0x00B2, "\xD3"}, {0x00B3, "\xD5"}, {0x00B4, "\xB6"},
+    {0x00B5, "\xC3"}, {0x00BB, "\""},   {0x00BF, "\xB9"}, {0x00C0, "\x8B"},
+    {0x00C1, "\x8A"}, {0x00C2, "\x8C"}, {0x00C4, "\x8D"}, {0x00C7, "\xB2"},
+    {0x00C8, "\x93"}, {0x00C9, "\x92"}, {0x00CA, "\x94"}, {0x00CB, "\x95"},
+    {0x00CC, "\x9B"}, {0x00CD, "\x9A"}, {0x00CE, "\x9C"}, {0x00CF, "\x9D"},
+    {0x00D1, "\xB4"}, {0x00D2, "\xA3"}, {0x00D3, "\xA2"}, {0x00D4, "\xA4"},
+    {0x00D6, "\xA5"}, {0x00D7, "*"},    {0x00D9, "\xAB"}, {0x00DA, "\xAA"},
+    {0x00DB, "\xAC"}, {0x00DC, "\xAD"}, {0x00E0, "\x8F"}, {0x00E1, "\x8E"},
+    {0x00E2, "\x90"}, {0x00E4, "\x91"}, {0x00E7, "\xB3"}, {0x00E8, "\x97"},
+    {0x00E9, "\x96"}, {0x00EA, "\x98"}, {0x00EB, "\x99"}, {0x00EC, "\x9F"},
+    {0x00ED, "\x9E"}, {0x00EE, "\xA0"}, {0x00EF, "\xA1"}, {0x00F1, "\xB5"},
+    {0x00F2, "\xA7"}, {0x00F3, "\xA6"}, {0x00F4, "\xA8"}, {0x00F6, "\xA9"},
+    {0x00F7, "/"},    {0x00F9, "\xAF"}, {0x00FA, "\xAE"}, {0x00FB, "\xB0"},
+    {0x00FC, "\xB1"}, {0x0233, "\xCC"}, {0x02E3, "\xCD"}, {0x0394, "\xBE"},
+    {0x03A3, "\xC6"}, {0x03A9, "\xCA"}, {0x03B1, "\xBB"}, {0x03B2, "\xBC"},
+    {0x03B3, "\xBD"}, {0x03B4, "\xBF"}, {0x03B5, "\xC0"}, {0x03BB, "\xC2"},
+    {0x03BC, "\xC3"}, {0x03C0, "\xC4"}, {0x03C1, "\xC5"}, {0x03C3, "\xC7"},
+    {0x03C4, "\xC8"}, {0x03C6, "\xC9"}, {0x2009, " "},    {0x200B, ""},
+    {0x2010, "-"},    {0x2011, "-"},    {0x2012, "-"},    {0x2013, "-"},
+    {0x2014, "-"},    {0x2015, "-"},    {0x2018, "'"},    {0x2019, "'"},
+    {0x201A, "'"},    {0x201C, "\""},   {0x201D, "\""},   {0x201E, "\""},
+    {0x2026, "..."},  {0x202F, " "},    {0x2032, "'"},    {0x2033, "\""},
+    {0x2080, "\x80"}, {0x2081, "\x81"}, {0x2082, "\x82"}, {0x2083, "\x83"},
+    {0x2084, "\x84"}, {0x2085, "\x85"}, {0x2086, "\x86"}, {0x2087, "\x87"},
+    {0x2088, "\x88"}, {0x2089, "\x89"}, {0x2192, "->"},   {0x2212, "-"},
+    {0x2215, "\xD1"}, {0x2260, "!="},   {0x2264, "<="},   {0x2265, ">="},
+    {0x25A0, "\xD0"}, {0x25C0, "\xCF"}, {0xFEFF, ""},
+};
+
+// the glyphs of the TI font from 0x80 on, in UTF-8
+static const char* FROM_TI[] = {
+    /* 0x80 */ "₀", "₁", "₂", "₃", "₄", "₅", "₆", "₇",
+    /* 0x88 */ "₈", "₉", "Á", "À", "Â", "Ä", "á", "à",
+    /* 0x90 */ "â", "ä", "É", "È", "Ê", "Ë", "é", "è",
+    /* 0x98 */ "ê", "ë", "Í", "Ì", "Î", "Ï", "í", "ì",
+    /* 0xa0 */ "î", "ï", "Ó", "Ò", "Ô", "Ö", "ó", "ò",
+    /* 0xa8 */ "ô", "ö", "Ú", "Ù", "Û", "Ü", "ú", "ù",
+    /* 0xb0 */ "û", "ü", "Ç", "ç", "Ñ", "ñ", "´", "`",
+    /* 0xb8 */ "¨", "¿", "¡", "α", "β", "γ", "Δ", "δ",
+    /* 0xc0 */ "ε", "[", "λ", "μ", "π", "ρ", "Σ", "σ",
+    /* 0xc8 */ "τ", "φ", "Ω", "x̄", "ȳ", "ˣ", "…", "◀",
+    /* 0xd0 */ "■", "∕", "‐", "²", "°", "³",
+};
+
+// copies the bytes at the start of `s` that are ASCII (and not `stop`) to `d`
+// (unless it is NULL), and returns how many there are. Up to a block of the
+// bytes after them may be copied as well.
+static usize copy_ascii_scalar(const u8* s, u8* d, usize len, u8 stop) {
+    usize i = 0;
+    for (; i < len && s[i] < 0x80 && s[i] != stop; i++) {
+        if (d)
+            d[i] = s[i];
+    }
+    return i;
+}
+
+#ifdef TEXT_X86
+static usize copy_ascii_sse2(const u8* s, u8* d, usize len, u8 stop) {
+    const __m128i vstop = _mm_set1_epi8((char)stop);
+    usize i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        if (d)
+            _mm_storeu_si128((__m128i*)&d[i], v);
+        // the sign bits are the non-ASCII bytes
+        int m = _mm_movemask_epi8(v) |
+                _mm_movemask_epi8(_mm_cmpeq_epi8(v, vstop));
+        if (m)
+            return i + (usize)__builtin_ctz((unsigned)m);
+    }
+    return i + copy_ascii_scalar(&s[i], d ? &d[i] : NULL, len - i, stop);
+}
+
+__attribute__((target("avx2"))) static usize
+copy_ascii_avx2(const u8* s, u8* d, usize len, u8 stop) {
+    const __m256i vstop = _mm256_set1_epi8((char)stop);
+    usize i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        if (d)
+            _mm256_storeu_si256((__m256i*)&d[i], v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(v) |
+                     (unsigned)_mm256_movemask_epi8(
+                         _mm256_cmpeq_epi8(v, vstop));
+        if (m)
+            return i + (usize)__builtin_ctz(m);
+    }
+    return i + copy_ascii_sse2(&s[i], d ? &d[i] : NULL, len - i, stop);
+}
+#endif
+
+static usize copy_ascii(const u8* s, u8* d, usize len, u8 stop) {
+#ifdef TEXT_X86
+    if (__builtin_cpu_supports("avx2"))
+        return copy_ascii_avx2(s, d, len, stop);
+    return copy_ascii_sse2(s, d, len, stop);
+#else
+    return copy_ascii_scalar(s, d, len, stop);
+#endif
+}
+
+// decodes the UTF-8 sequence at `s`, returns its length, 0 if it is invalid
+static usize utf8_decode(const u8* s, usize len, u32* cp) {
+    u8 c = s[0];
+    usize n;
+    u32 v;
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        v = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        v = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        v = c & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (n > len)
+        return 0;
+    for (usize k = 1; k < n; k++) {
+        if ((s[k] & 0xC0) != 0x80)
+            return 0;
+        v = v << 6 | (s[k] & 0x3F);
+    }
+    // overlong forms, surrogates and what is beyond Unicode
+    if ((n == 3 && v < 0x800) || (n == 4 && (v < 0x10000 || v > 0x10FFFF)) ||
+        (v >= 0xD800 && v <= 0xDFFF))
+        return 0;
+    *cp = v;
+    return n;
+}
+
+static int cmp_char(const void* key, const void* elem) {
+    u32 cp = *(const u32*)key;
+    u32 other = ((const Ti_Char*)elem)->cp;
+    return cp < other ? -1 : cp > other;
+}
+
+usize text_to_ti(const char* src, usize len, char* dest, Text_Stats* st) {
+    Text_Stats ignored;
+    if (!st)
+        st = &ignored;
+    *st = (Text_Stats){0};
+
+    const u8* s = (const u8*)src;
+    u8* d = (u8*)dest;
+    usize i = 0;
+    usize o = 0;
+    if (len >= 3 && !memcmp(s, "\xEF\xBB\xBF", 3)) {
+        i = 3;
+        st->bom = true;
+    }
+
+    while (i < len) {
+        usize n = copy_ascii(&s[i], &d[o], len - i, '\r');
+        i += n;
+        o += n;
+        if (i >= len)
+            break;
+
+        if (s[i] == '\r') {
+            d[o++] = '\n';
+            if (++i < len && s[i] == '\n')
+                i++;
+            st->crlf++;
+            continue;
+        }
+
+        u32 cp;
+        usize k = utf8_decode(&s[i], len - i, &cp);
+        const Ti_Char* c = NULL;
+        if (k)
+            c = bsearch(&cp, TO_TI, LENGTH(TO_TI), sizeof(Ti_Char), cmp_char);
+        if (c) {
+            usize m = strlen(c->ti);
+            memcpy(&d[o], c->ti, m);
+            o += m;
+            st->mapped++;
+        } else {
+            d[o++] = '?';
+            st->unmapped++;
+        }
+        i += k ? k : 1;
+    }
+    return o;
+}
+
+usize text_from_ti(const char* src, usize len, char* dest) {
+    const u8* s = (const u8*)src;
+    u8* d = (u8*)dest;
+    usize i = 0;
+    usize o = 0;
+    while (i < len) {
+        usize n = copy_ascii(&s[i], &d[o], len - i, 0x80);
+        i += n;
+        o += n;
+        if (i >= len)
+            break;
+
+        usize g = s[i] - 0x80;
+        const char* c = g < LENGTH(FROM_TI) ? FROM_TI[g] : "?";
+        usize m = strlen(c);
+        memcpy(&d[o], c, m);
+        o += m;
+        i++;
+    }
+    return o;
+}
+
+bool text_is_utf8(const char* s, usize len) {
+    const u8* p = (const u8*)s;
+    usize i = 0;
+    while (i < len) {
+        i += copy_ascii(&p[i], NULL, len - i, 0x80);
+        if (i >= len)
+            break;
+        u32 cp;
+        usize k = utf8_decode(&p[i], len - i, &cp);
+        if (!k)
+            return false;
+        i += k;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: text normalization, and transcoding between UTF-8 and the
+ * calculator's character set (`--normalize`)
+ */
+
+#ifndef _TEXT_H
+#define _TEXT_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/*
+ * The calculator's character set is ASCII, with the glyphs of the TI font
+ * (subscript digits, accented letters, Greek letters and a few symbols) from
+ * 0x80 on. Characters that the font doesn't have, but that have an obvious
+ * ASCII spelling (curly quotes, dashes, `≤` and the like) are written in
+ * ASCII, and all others become `?`.
+ *
+ * Runs of ASCII are copied 32 (AVX2) or 16 (SSE2) bytes at a time on x86, a
+ * byte at a time elsewhere.
+ */
+
+typedef struct {
+    // CRLF (or lone CR) line breaks turned into LF
+    usize crlf;
+    // a byte order mark was dropped
+    bool bom;
+    // characters written in the calculator's character set, or in ASCII
+    usize mapped;
+    // characters (or invalid UTF-8 bytes) written as `?`
+    usize unmapped;
+} Text_Stats;
+
+/**
+ * Normalizes UTF-8 text for the calculator: line breaks become LF, the byte
+ * order mark is dropped and everything that isn't ASCII is transcoded to the
+ * calculator's character set. The result is never longer than the source.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param dest buffer of at least `len` bytes, must not overlap `src`
+ * @param st what was changed, may be NULL
+ * @return length of the result
+ */
+usize text_to_ti(const char* src, usize len, char* dest, Text_Stats* st);
+
+/**
+ * Transcodes text in the calculator's character set back to UTF-8. Bytes
+ * that the font has no glyph for become `?`.
+ *
+ * @param src the source
+ * @param len length of the source
+ * @param dest buffer of at least `3 * len` bytes, must not overlap `src`
+ * @return length of the result
+ */
+usize text_from_ti(const char* src, usize len, char* dest);
+
+/**
+ * Checks if text is valid UTF-8, which text in the calculator's character set
+ * almost never is (its glyphs would have to line up as UTF-8 sequences).
+ */
+bool text_is_utf8(const char* s, usize len);
+
+#endif // _TEXT_H
@@ -11,20 +11,71 @@
 #define _POSIX_C_SOURCE 200809L
 #define _GNU_SOURCE
 
-#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "3rdparty/include/a_common.h"
 #include "3rdparty/include/a_string.h"
+#include "commands.h"
 #include "common.h"
+#include "hash.h"
+#include "heap.h"
+#include "journal.h"
+#include "json.h"
+#include "manifest.h"
+#include "minify.h"
+#include "names.h"
+#include "queue.h"
+#include "results.h"
+#include "shard.h"
+#include "stats.h"
+#include "tar.h"
+#include "text.h"
+#include "trace.h"
+#include "uring.h"
+#include "watch.h"
+
+// starts timing a phase for `--stats`, `--trace` and `--results`
+static inline u64 phase_begin(void) {
+    return (stats_enabled || trace_enabled || results_enabled) ? stats_now()
+                                                               : 0;
+}
+
+// time elapsed since `phase_begin`, 0 if nothing is timed
+static inline u64 phase_elapsed(u64 start) {
+    return start ? stats_now() - start : 0;
+}
+
+// ends a phase started with `phase_begin`. Returns its duration.
+static inline u64 phase_end(Stats_Phase phase, u64 start) {
+    if (!start)
+        return 0;
 
+    u64 now = stats_now();
+    if (stats_enabled)
+        _stats_add_phase(phase, now - start);
+    trace_span(stats_phase_name(phase), start, now);
+    return now - start;
+}
+
+#define TI_CALLOC(n, sz)      (stats_allocs(1), calloc(n, sz))
+#define TI_REALLOC(p, sz)     (stats_allocs(1), realloc(p, sz))
+#define TI_PHASE_BEGIN(phase) u64 _ti_phase_##phase = phase_begin()
+#define TI_PHASE_END(phase)   phase_end(STATS_##phase, _ti_phase_##phase)
 #define _TIPYCONV_IMPLEMENTATION
 #include "tipyconv.h"
 
@@ -40,10 +91,69 @@ typedef enum {
     FMT_PY = 2,
 } Format;
 
+// long options without a short form
+enum {
+    OPT_TAR_IN = 256,
+    OPT_TAR_OUT,
+    OPT_IO,
+    OPT_NO_CLOBBER,
+    OPT_DURABLE,
+    OPT_JOURNAL,
+    OPT_SHARD,
+    OPT_MANIFEST,
+    OPT_RESULTS,
+    OPT_NAME_MAP,
+    OPT_IO_THREADS,
+    OPT_MAX_INFLIGHT,
+    OPT_WATCH,
+    OPT_DEBOUNCE,
+    OPT_MINIFY,
+    OPT_SPLIT,
+    OPT_HEAP_CHECK,
+    OPT_HEAP_REPORT,
+    OPT_NORMALIZE,
+};
+
+typedef enum {
+    IO_BLOCKING = 0,
+    IO_URING,
+    IO_PIPELINE,
+} Io_Backend;
+
 typedef struct {
-    a_string in_path;
+    // input paths (borrowed from argv)
+    char** in_paths;
+    usize in_paths_len;
     a_string out_path;
+    a_string out_dir;
     a_string var_name; // appvar
+    a_string tar_in;
+    a_string tar_out;
+    a_string journal;
+    a_string manifest;
+    a_string results;
+    a_string name_map;
+    a_string watch;
+    a_string heap_report;
+    u32 debounce_ms;
+    usize jobs;
+    // reader and writer threads of the pipeline, each
+    usize io_threads;
+    usize max_inflight;
+    // the heap scripts should fit in with `--heap-check`, 0 if not checked
+    usize heap_limit;
+    // this process converts shard `shard` out of `nshards`
+    usize shard;
+    usize nshards;
+    Stats_Format stats_fmt;
+    bool stats;
+    Io_Backend io;
+    bool minify;
+    bool minify_names;
+    bool split;
+    bool normalize;
+    bool no_clobber;
+    bool durable;
     bool verbose;
     bool help;
     bool license;
@@ -51,21 +161,122 @@ typedef struct {
 
 static const struct option LONG_OPTS[] = {
     {"outfile", required_argument, 0, 'o'},
+    {"outdir", required_argument, 0, 'd'},
     {"varname", required_argument, 0, 'N'},
+    {"jobs", required_argument, 0, 'j'},
+    {"stats", optional_argument, 0, 's'},
+    {"trace", required_argument, 0, 't'},
+    {"tar-in", required_argument, 0, OPT_TAR_IN},
+    {"tar-out", required_argument, 0, OPT_TAR_OUT},
+    {"io", required_argument, 0, OPT_IO},
+    {"no-clobber", no_argument, 0, OPT_NO_CLOBBER},
+    {"durable", no_argument, 0, OPT_DURABLE},
+    {"journal", required_argument, 0, OPT_JOURNAL},
+    {"shard", required_argument, 0, OPT_SHARD},
+    {"manifest", required_argument, 0, OPT_MANIFEST},
+    {"results", required_argument, 0, OPT_RESULTS},
+    {"name-map", required_argument, 0, OPT_NAME_MAP},
+    {"io-threads", required_argument, 0, OPT_IO_THREADS},
+    {"max-inflight", required_argument, 0, OPT_MAX_INFLIGHT},
+    {"watch", required_argument, 0, OPT_WATCH},
+    {"debounce", required_argument, 0, OPT_DEBOUNCE},
+    {"minify", optional_argument, 0, OPT_MINIFY},
+    {"split", no_argument, 0, OPT_SPLIT},
+    {"heap-check", optional_argument, 0, OPT_HEAP_CHECK},
+    {"heap-report", required_argument, 0, OPT_HEAP_REPORT},
+    {"normalize", no_argument, 0, OPT_NORMALIZE},
     {"version", no_argument, 0, 'V'},
     {"verbose", no_argument, 0, 'v'},
     {"help", no_argument, 0, 'h'},
     {"license", no_argument, 0, 'l'},
     {0},
 };
+
+// options of a single conversion. NULL fields are guessed from the input.
+typedef struct {
+    const char* out_path;
+    const char* var_name;
+    // long file name and file info comment of an AppVar
+    const char* file_name;
+    const char* comment;
+    // with `--split`, the names taken for the parts (malloc'ed), NULL to name
+    // them after the variable name
+    char (*part_names)[VAR_NAME_SZ + 1];
+    usize max_parts;
+} Convert_Opts;
+
+// one of the AppVars a source is cut into with `--split`
+typedef struct {
+    char var_name[VAR_NAME_SZ + 1];
+    char* data;
+    usize len;
+} Split_Part;
+
+// the import that chains a part of a split source to the one before it, and
+// its longest expansion
+#define SPLIT_IMPORT    "from %s import *\n"
+#define SPLIT_IMPORT_SZ (sizeof(SPLIT_IMPORT) - 3 + VAR_NAME_SZ)
+// the most source a part holds, besides its import
+#define SPLIT_PART_SZ (TI_MAX_SRC_SZ - SPLIT_IMPORT_SZ)
+// parts are numbered within the variable name, and the entry must fit in an
+// AppVar anyway
+#define SPLIT_MAX_PARTS 10000
+
+// the result of an in-memory conversion
+typedef struct {
+    // relative to the output directory, or `-`
+    char path[PATH_MAX];
+    char* data;
+    usize len;
+    // with `--split`, the parts that `data` imports. They are written first,
+    // next to it.
+    Split_Part* parts;
+    usize nparts;
+    // where it came from, for the journal
+    const char* in_path;
+    u64 in_hash;
+    // for `--results`
+    usize in_len;
+    int checksum;
+    u64 start;
+    u64 read_ns;
+    u64 convert_ns;
+    u64 write_ns;
+    // written into an existing device or FIFO rather than renamed over it
+    bool in_place;
+} Output;
+
 static Args args;
 
+// options from the command line, and per input ones from `--manifest`
+static Convert_Opts default_opts;
+static Convert_Opts* in_opts;
+static Manifest manifest;
+
+// variable names handed out to the inputs, and where they are reported
+static char (*var_names)[VAR_NAME_SZ + 1];
+static FILE* name_map_fp;
+
+// outputs are created relative to this, so that batches don't resolve the
+// directory again for every file
+static int out_dirfd = AT_FDCWD;
+
+// batch state, shared by the workers
+static atomic_size_t next_input;
+static atomic_size_t failed_inputs;
+// bytes of Python source cut by --minify, and how many there were before
+static atomic_size_t minify_saved;
+static atomic_size_t minify_total;
+// scripts whose heap was estimated with --heap-check, and those over the limit
+static atomic_size_t heap_checked;
+static atomic_size_t heap_over;
+
 // === function decls ===
-char* get_file_name(const char* src);
 char* get_file_extension(const char* src);
-bool file_exists(const char* path);
+bool is_stdio(const char* path);
 Format get_format_from_string(const char* ext);
 Format get_format_from_path(const char* path);
+Format get_format_from_data(const char* data, usize len);
 
 Args args_new(void);
 void args_deinit(Args* args);
@@ -74,23 +285,33 @@ void help(void);
 void license(void);
 bool parse_args(int argc, char** argv);
 
-Format get_output_format(Format in_fmt);
-char* get_python_file_path(const Ti_PyFile* pyfile);
-char* get_var_name_from_path(const char* path);
-bool convert_appvar(const a_string* in_file);
-bool convert_py(const a_string* in_file);
-bool convert(Format in_fmt);
-
-// returns a heap allocated char*
-char* get_file_name(const char* src) {
-    const char* base = basename(src);
-    const char* dot = strrchr(base, '.');
-    ptrdiff_t diff = dot - base;
-    char* res = calloc(diff + 1, 1);
-    check_alloc(res);
-    strncpy(res, base, diff);
-    return res;
-}
+Format get_output_format(Format in_fmt, const Convert_Opts* opts);
+bool get_python_file_name(const Ti_PyFile* pyfile, const char* in_path,
+                          char* dest, usize sz);
+bool get_appvar_file_name(const Ti_PyFile* pyfile, const char* in_path,
+                          char* dest, usize sz);
+bool guess_python_file_path(const Ti_PyFile* pyfile, const char* in_path,
+                            const Convert_Opts* opts, char* dest, usize sz);
+bool guess_appvar_path(const Ti_PyFile* pyfile, const char* in_path,
+                       const Convert_Opts* opts, char* dest, usize sz);
+Format detect_format(const char* in_path, const char* data, usize len);
+Ti_PyFile parse_appvar(const char* in_path, const char* data, usize len);
+usize dump_py(const char* in_path, const char* data, usize len,
+              const Convert_Opts* opts, Ti_PyFile* pyfile, char** dest,
+              Split_Part** parts, usize* nparts);
+void output_free(Output* out);
+bool convert_appvar(const char* in_path, const char* data, usize len,
+                    const Convert_Opts* opts, Output* out);
+bool convert_py(const char* in_path, const char* data, usize len,
+                const Convert_Opts* opts, Output* out);
+bool convert_buffer(const char* in_path, const char* data, usize len,
+                    const Convert_Opts* opts, Output* out);
+bool convert(const char* in_path, const Convert_Opts* opts);
+bool convert_all(void);
+bool convert_pipeline(void);
+bool watch_dir(void);
+bool convert_all_uring(void);
+bool convert_tar(void);
 
 char* get_file_extension(const char* src) {
     const char* base = basename(src);
@@ -103,13 +324,49 @@ char* get_file_extension(const char* src) {
     return ext;
 }
 
-bool file_exists(const char* path) {
-    FILE* fp = fopen(path, "r");
-    if (!fp) {
-        return false;
+// `-` stands for stdin (as an input) or stdout (as an output)
+bool is_stdio(const char* path) {
+    return path && !strcmp(path, "-");
+}
+
+// reads a whole file (or stdin) into a null-terminated, heap allocated buffer
+char* read_input(const char* path, usize* len) {
+    FILE* fp = is_stdio(path) ? stdin : fopen(path, "rb");
+    if (!fp)
+        return NULL;
+
+    // regular files are read in one go, pipes grow the buffer as needed
+    struct stat st;
+    usize cap = 4096;
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        cap = (usize)st.st_size + 1;
+
+    char* buf = malloc(cap);
+    check_alloc(buf);
+    usize n = 0;
+    for (;;) {
+        if (n + 1 >= cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            check_alloc(buf);
+        }
+        usize got = fread(&buf[n], 1, cap - n - 1, fp);
+        n += got;
+        if (got == 0)
+            break;
     }
-    fclose(fp);
-    return true;
+
+    bool failed = ferror(fp);
+    if (fp != stdin)
+        fclose(fp);
+    if (failed) {
+        free(buf);
+        return NULL;
+    }
+
+    buf[n] = '\0';
+    *len = n;
+    return buf;
 }
 
 Format get_format_from_string(const char* ext) {
@@ -129,18 +386,52 @@ Format get_format_from_path(const char* path) {
     return get_format_from_string(ext);
 }
 
+// sniffs the format from the content: the AppVar signature, or else text
+Format get_format_from_data(const char* data, usize len) {
+    if (ti_is_appvar(data, len))
+        return FMT_APPVAR;
+
+    // source code doesn't contain null bytes
+    usize probe = len < 512 ? len : 512;
+    if (memchr(data, '\0', probe))
+        return FMT_INVALID;
+
+    return FMT_PY;
+}
+
 Args args_new(void) {
     return (Args){
-        .in_path = as_with_capacity(25),
+        .jobs = 1,
+        .io_threads = 2,
+        .max_inflight = 64 << 20,
+        .debounce_ms = 150,
+        .nshards = 1,
         .out_path = as_with_capacity(25),
+        .out_dir = as_with_capacity(25),
         .var_name = as_with_capacity(25),
+        .tar_in = as_with_capacity(25),
+        .tar_out = as_with_capacity(25),
+        .journal = as_with_capacity(25),
+        .manifest = as_with_capacity(25),
+        .results = as_with_capacity(25),
+        .name_map = as_with_capacity(25),
+        .watch = as_with_capacity(25),
+        .heap_report = as_with_capacity(25),
     };
 }
 
 void args_deinit(Args* args) {
-    as_free(&args->in_path);
     as_free(&args->out_path);
+    as_free(&args->out_dir);
     as_free(&args->var_name);
+    as_free(&args->tar_in);
+    as_free(&args->tar_out);
+    as_free(&args->journal);
+    as_free(&args->manifest);
+    as_free(&args->results);
+    as_free(&args->name_map);
+    as_free(&args->watch);
+    as_free(&args->heap_report);
 }
 
 void version(void) {
@@ -158,18 +449,329 @@ void license(void) {
     exit(EXIT_SUCCESS);
 }
 
+// loads the inputs and their options from a manifest. Options that an entry
+// doesn't set are taken from the command line.
+static bool load_manifest(const char* path) {
+    if (!manifest_load(path, &manifest))
+        return false;
+    if (manifest.len == 0) {
+        warn("manifest \"%s\" has no entries", path);
+        return false;
+    }
+
+    args.in_paths = calloc(manifest.len, sizeof(char*));
+    in_opts = calloc(manifest.len, sizeof(Convert_Opts));
+    check_alloc(args.in_paths);
+    check_alloc(in_opts);
+    for (usize i = 0; i < manifest.len; i++) {
+        const Manifest_Entry* e = &manifest.items[i];
+        Convert_Opts* o = &in_opts[i];
+        *o = default_opts;
+        args.in_paths[i] = e->input;
+        if (e->output)
+            o->out_path = e->output;
+        if (e->var_name)
+            o->var_name = e->var_name;
+        o->file_name = e->file_name;
+        o->comment = e->comment;
+    }
+    args.in_paths_len = manifest.len;
+    _info("loaded %zu input(s) from manifest \"%s\"", manifest.len, path);
+    return true;
+}
+
+// options for input `i`
+static const Convert_Opts* input_opts(usize i) {
+    return &in_opts[i];
+}
+
+// the variable name that would be made from an input, or NULL for inputs
+// that don't need one
+static const char* wanted_var_name(const char* path, char* dest) {
+    // AppVars bring their own name, and stdin has no file name
+    if (is_stdio(path) || get_format_from_path(path) == FMT_APPVAR)
+        return NULL;
+    if (args.var_name.len != 0)
+        return args.var_name.data;
+    get_var_name_from_path(path, dest);
+    return dest;
+}
+
+// reports the name an input got in the name map
+static void report_var_name(const char* path, const char* name,
+                            const char* wanted) {
+    if (!name_map_fp)
+        return;
+    fputs("{\"input\":", name_map_fp);
+    json_write_string(name_map_fp, path);
+    fputs(",\"var_name\":", name_map_fp);
+    json_write_string(name_map_fp, name);
+    fputs(",\"wanted\":", name_map_fp);
+    json_write_string(name_map_fp, wanted);
+    fputs("}\n", name_map_fp);
+}
+
+// the most source an AppVar made with `opts` holds
+static usize max_src_len(const Convert_Opts* opts) {
+    usize file_name_len = opts->file_name ? strlen(opts->file_name) : 0;
+    return TI_MAX_SRC_SZ - (file_name_len ? file_name_len + 2 : 0);
+}
+
+// names part `k` (from 1) of `n` after `base`. The part number goes where the
+// name is cut short, `n` must be less than `SPLIT_MAX_PARTS`.
+static void split_part_name(const char* base, usize k, usize n, char* dest) {
+    char num[8];
+    int digits = snprintf(num, sizeof(num), "%zu", n);
+    int num_len = snprintf(num, sizeof(num), "%zu", k);
+    usize base_len = strnlen(base, VAR_NAME_SZ - digits);
+    memcpy(dest, base, base_len);
+    memcpy(&dest[base_len], num, num_len + 1);
+}
+
+// takes the names of the parts that a source of `len` bytes may be split
+// into, in `opts`. Greedy splitting leaves two parts in a row holding more
+// than a part can, which bounds their number.
+static void reserve_part_names(Name_Set* s, const char* base, usize len,
+                               Convert_Opts* opts) {
+    if (!args.split || len <= max_src_len(opts))
+        return;
+    usize n = 2 * len / SPLIT_PART_SZ + 1;
+    if (n >= SPLIT_MAX_PARTS)
+        return;
+
+    opts->part_names = calloc(n, sizeof(*opts->part_names));
+    check_alloc(opts->part_names);
+    opts->max_parts = n;
+    for (usize k = 0; k < n; k++) {
+        char want[VAR_NAME_SZ + 1];
+        split_part_name(base, k + 1, n, want);
+        name_set_allocate(s, want, opts->part_names[k]);
+    }
+}
+
+// the size of an input on disk, 0 if it can't be told
+static usize input_size(const char* path) {
+    struct stat st;
+    if (is_stdio(path) || stat(path, &st) != 0)
+        return 0;
+    return (usize)st.st_size;
+}
+
+// gives every input that is named after its path a variable name of its own.
+// Names are handed out in input order, so they don't depend on -j or --shard.
+static void assign_var_names(void) {
+    Name_Set names = name_set_new(args.in_paths_len);
+    var_names = calloc(args.in_paths_len, sizeof(*var_names));
+    check_alloc(var_names);
+
+    // names from the manifest are kept as they are, the others make way
+    for (usize i = 0; i < manifest.len; i++) {
+        const char* name = manifest.items[i].var_name;
+        if (!name)
+            continue;
+        if (!name_valid(name))
+            warn("\"%s\" is not a valid variable name", name);
+        if (!name_set_claim(&names, name))
+            warn("variable name \"%s\" is used by more than one input", name);
+    }
+
+    usize renamed = 0;
+    for (usize i = 0; i < args.in_paths_len; i++) {
+        const char* path = args.in_paths[i];
+        if (manifest.len != 0 && manifest.items[i].var_name) {
+            const char* name = manifest.items[i].var_name;
+            report_var_name(path, name, name);
+            if (get_format_from_path(path) != FMT_APPVAR)
+                reserve_part_names(&names, name, input_size(path),
+                                   &in_opts[i]);
+            continue;
+        }
+
+        char buf[VAR_NAME_SZ + 1];
+        const char* wanted = wanted_var_name(path, buf);
+        if (!wanted)
+            continue;
+
+        char* name = var_names[i];
+        name_set_allocate(&names, wanted, name);
+        in_opts[i].var_name = name;
+        if (strncmp(name, wanted, VAR_NAME_SZ)) {
+            _info("\"%s\" is named %s, %.8s is taken", path, name, wanted);
+            renamed++;
+        }
+        report_var_name(path, name, wanted);
+        // parts of a split source are named after it, right after it
+        reserve_part_names(&names, name, input_size(path), &in_opts[i]);
+    }
+
+    if (renamed > 0)
+        info("renamed %zu input(s) whose variable names were taken", renamed);
+    name_set_free(&names);
+}
+
+// parses a byte count, with an optional K, M or G suffix (powers of 1024)
+bool parse_size(const char* s, usize* res) {
+    char* end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s)
+        return false;
+
+    int shift = 0;
+    switch (*end) {
+        case 'k':
+        case 'K': shift = 10; break;
+        case 'm':
+        case 'M': shift = 20; break;
+        case 'g':
+        case 'G': shift = 30; break;
+        case '\0': break;
+        default: return false;
+    }
+    if (*end != '\0' && end[1] != '\0')
+        return false;
+    if (n > (SIZE_MAX >> shift))
+        return false;
+
+    *res = (usize)(n << shift);
+    return *res > 0;
+}
+
+static void open_out_dir(void) {
+    if (args.out_dir.len == 0)
+        return;
+
+    out_dirfd = open(args.out_dir.data, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (out_dirfd < 0)
+        fatal("could not open output directory \"%s\": %s", args.out_dir.data,
+              strerror(errno));
+}
+
 bool parse_args(int argc, char** argv) {
     args = args_new();
 
     int c;
-    while ((c = getopt_long(argc, argv, "o:N:Vvhl", LONG_OPTS, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "o:d:N:j:s::t:Vvhl", LONG_OPTS,
+                            NULL)) != -1) {
         switch (c) {
             case 'o': {
                 as_copy_cstr(&args.out_path, optarg);
             } break;
+            case 'd': {
+                as_copy_cstr(&args.out_dir, optarg);
+            } break;
             case 'N': {
                 as_copy_cstr(&args.var_name, optarg);
             } break;
+            case 'j': {
+                char* end;
+                long jobs = strtol(optarg, &end, 10);
+                if (*end != '\0' || jobs < 0)
+                    fatal("invalid number of jobs: \"%s\"", optarg);
+                if (jobs == 0)
+                    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+                args.jobs = jobs > 0 ? (usize)jobs : 1;
+            } break;
+            case 's': {
+                args.stats = true;
+                if (!optarg || !strcasecmp(optarg, "text"))
+                    args.stats_fmt = STATS_FMT_TEXT;
+                else if (!strcasecmp(optarg, "json"))
+                    args.stats_fmt = STATS_FMT_JSON;
+                else
+                    fatal("unknown stats format: \"%s\"", optarg);
+            } break;
+            case 't': {
+                if (!trace_init(optarg))
+                    fatal("could not open trace file \"%s\": %s", optarg,
+                          strerror(errno));
+            } break;
+            case OPT_TAR_IN: {
+                as_copy_cstr(&args.tar_in, optarg);
+            } break;
+            case OPT_TAR_OUT: {
+                as_copy_cstr(&args.tar_out, optarg);
+            } break;
+            case OPT_IO: {
+                if (!strcasecmp(optarg, "blocking"))
+                    args.io = IO_BLOCKING;
+                else if (!strcasecmp(optarg, "uring"))
+                    args.io = IO_URING;
+                else if (!strcasecmp(optarg, "pipeline"))
+                    args.io = IO_PIPELINE;
+                else
+                    fatal("unknown I/O backend: \"%s\"", optarg);
+            } break;
+            case OPT_NO_CLOBBER: {
+                args.no_clobber = true;
+            } break;
+            case OPT_DURABLE: {
+                args.durable = true;
+            } break;
+            case OPT_JOURNAL: {
+                as_copy_cstr(&args.journal, optarg);
+            } break;
+            case OPT_MANIFEST: {
+                as_copy_cstr(&args.manifest, optarg);
+            } break;
+            case OPT_RESULTS: {
+                as_copy_cstr(&args.results, optarg);
+            } break;
+            case OPT_NAME_MAP: {
+                as_copy_cstr(&args.name_map, optarg);
+            } break;
+            case OPT_IO_THREADS: {
+                char* end;
+                long n = strtol(optarg, &end, 10);
+                if (*end != '\0' || n <= 0)
+                    fatal("invalid number of I/O threads: \"%s\"", optarg);
+                args.io_threads = (usize)n;
+            } break;
+            case OPT_MAX_INFLIGHT: {
+                if (!parse_size(optarg, &args.max_inflight))
+                    fatal("invalid size: \"%s\"", optarg);
+            } break;
+            case OPT_WATCH: {
+                as_copy_cstr(&args.watch, optarg);
+            } break;
+            case OPT_DEBOUNCE: {
+                char* end;
+                long ms = strtol(optarg, &end, 10);
+                if (*end != '\0' || ms < 0 || ms > 60000)
+                    fatal("invalid debounce window: \"%s\"", optarg);
+                args.debounce_ms = (u32)ms;
+            } break;
+            case OPT_SPLIT: {
+                args.split = true;
+            } break;
+            case OPT_HEAP_CHECK: {
+                args.heap_limit = HEAP_DEFAULT_LIMIT;
+                bool ok = !optarg || parse_size(optarg, &args.heap_limit);
+                if (!ok || args.heap_limit == 0)
+                    fatal("invalid heap size: \"%s\"", optarg);
+            } break;
+            case OPT_HEAP_REPORT: {
+                as_copy_cstr(&args.heap_report, optarg);
+            } break;
+            case OPT_NORMALIZE: {
+                args.normalize = true;
+            } break;
+            case OPT_MINIFY: {
+                args.minify = true;
+                if (optarg && !strcasecmp(optarg, "names"))
+                    args.minify_names = true;
+                else if (optarg)
+                    fatal("unknown minify option: \"%s\"", optarg);
+            } break;
+            case OPT_SHARD: {
+                unsigned long i, n;
+                int end = 0;
+                if (sscanf(optarg, "%lu/%lu%n", &i, &n, &end) != 2 ||
+                    optarg[end] != '\0' || n == 0 || i >= n)
+                    fatal("invalid shard: \"%s\" (expected i/N, with i < N)",
+                          optarg);
+                args.shard = i;
+                args.nshards = n;
+            } break;
             case 'V': {
                 version();
             } break;
@@ -189,217 +791,2129 @@ bool parse_args(int argc, char** argv) {
         }
     }
 
-    // positional arg: input file
-    if (optind >= argc) {
-        warn("must supply input file as positional argument!");
-        help();
-        return false;
+    if (args.var_name.len != 0 && !name_valid(args.var_name.data))
+        warn("\"%s\" is not a valid variable name (1 to 8 letters and "
+             "digits, starting with a letter)",
+             args.var_name.data);
+
+    // the report comes with the check
+    if (args.heap_report.len != 0 && args.heap_limit == 0)
+        args.heap_limit = HEAP_DEFAULT_LIMIT;
+
+    if (args.name_map.len != 0) {
+        name_map_fp = is_stdio(args.name_map.data)
+                          ? stdout
+                          : fopen(args.name_map.data, "w");
+        if (!name_map_fp)
+            fatal("could not open name map \"%s\": %s", args.name_map.data,
+                  strerror(errno));
+    }
+
+    if (args.watch.len != 0) {
+        if (optind < argc || args.manifest.len != 0 || args.tar_in.len != 0)
+            fatal("input files cannot be used with --watch");
+        if (args.out_path.len != 0)
+            fatal("an output path cannot be used with --watch");
+        if (args.nshards > 1)
+            fatal("--shard cannot be used with --watch");
+        default_opts = (Convert_Opts){
+            .var_name = args.var_name.len != 0 ? args.var_name.data : NULL,
+        };
+        open_out_dir();
+        return true;
     }
-    as_copy_cstr(&args.in_path, argv[optind]);
 
-    if (args.in_path.len == 0)
-        fatal("no input file provided");
+    if (args.tar_in.len != 0) {
+        if (optind < argc)
+            fatal("input files cannot be used with --tar-in");
+        if (args.out_path.len != 0 || args.out_dir.len != 0)
+            fatal("an output path cannot be used with --tar-in");
+        if (args.journal.len != 0)
+            fatal("--journal cannot be used with --tar-in");
+        if (args.nshards > 1)
+            fatal("--shard cannot be used with --tar-in");
+        if (args.manifest.len != 0 || args.results.len != 0)
+            fatal("--manifest and --results cannot be used with --tar-in");
+        if (args.tar_out.len == 0)
+            as_copy_cstr(&args.tar_out, "-");
+        if (is_stdio(args.tar_out.data) && is_stdio(args.name_map.data))
+            fatal("stdout cannot be used for the name map and --tar-out");
+        if (is_stdio(args.tar_out.data) && is_stdio(args.heap_report.data))
+            fatal("stdout cannot be used for the heap report and --tar-out");
+        return true;
+    }
+
+    if (args.tar_out.len != 0)
+        fatal("--tar-out can only be used with --tar-in");
+
+    default_opts = (Convert_Opts){
+        .out_path = args.out_path.len != 0 ? args.out_path.data : NULL,
+        .var_name = args.var_name.len != 0 ? args.var_name.data : NULL,
+    };
+
+    if (args.manifest.len != 0) {
+        if (optind < argc)
+            fatal("input files cannot be used with --manifest");
+        if (args.out_path.len != 0)
+            fatal("an output path cannot be used with --manifest");
+        if (!load_manifest(args.manifest.data))
+            return false;
+    } else {
+        // positional args: input files
+        if (optind >= argc) {
+            warn("must supply input file as positional argument!");
+            help();
+            return false;
+        }
+        args.in_paths = &argv[optind];
+        args.in_paths_len = argc - optind;
+        in_opts = calloc(args.in_paths_len, sizeof(Convert_Opts));
+        check_alloc(in_opts);
+        for (usize i = 0; i < args.in_paths_len; i++)
+            in_opts[i] = default_opts;
+    }
 
+    usize nstdin = 0;
+    usize nstdout = 0;
+    for (usize i = 0; i < args.in_paths_len; i++) {
+        if (args.in_paths[i][0] == '\0')
+            fatal("no input file provided");
+        if (is_stdio(args.in_paths[i]))
+            nstdin++;
+        // piped in, pipe out
+        const char* out_path = input_opts(i)->out_path;
+        if (out_path ? is_stdio(out_path) : is_stdio(args.in_paths[i]))
+            nstdout++;
+    }
+
+    if (nstdin > 1)
+        fatal("stdin can only be used as an input once");
+    if (nstdin > 0 && args.nshards > 1)
+        fatal("stdin cannot be used as an input with --shard");
+    if (nstdin > 0 && is_stdio(args.manifest.data))
+        fatal("stdin cannot be used as an input and as the manifest");
+    if (nstdout > 0 && is_stdio(args.results.data))
+        fatal("stdout cannot be used for results and outputs at once");
+    if (nstdout > 0 && is_stdio(args.heap_report.data))
+        fatal("stdout cannot be used for the heap report and outputs at once");
+
+    if (args.in_paths_len > 1 && args.out_path.len != 0)
+        fatal("an output path cannot be used with multiple input files");
+    if (nstdout > 0 && is_stdio(args.name_map.data))
+        fatal("stdout cannot be used for the name map and outputs at once");
+
+    // before sharding, so that every shard hands out the same names
+    assign_var_names();
+
+    // keep the inputs of our shard only
+    if (args.nshards > 1) {
+        usize n = 0;
+        for (usize i = 0; i < args.in_paths_len; i++) {
+            if (shard_of(args.in_paths[i], args.nshards) != args.shard) {
+                free(in_opts[i].part_names);
+                continue;
+            }
+            in_opts[n] = in_opts[i];
+            args.in_paths[n++] = args.in_paths[i];
+        }
+        _info("shard %zu/%zu: %zu of %zu input(s)", args.shard, args.nshards,
+              n, args.in_paths_len);
+        args.in_paths_len = n;
+    }
+
+    open_out_dir();
     return true;
 }
 
-Format get_output_format(Format in_fmt) {
-    Format out_fmt = get_format_from_path(args.out_path.data);
-    if (out_fmt != FMT_INVALID)
-        return out_fmt;
+Format get_output_format(Format in_fmt, const Convert_Opts* opts) {
+    if (opts->out_path) {
+        Format out_fmt = get_format_from_path(opts->out_path);
+        if (out_fmt != FMT_INVALID)
+            return out_fmt;
+    }
 
     if (in_fmt == FMT_PY) {
         return FMT_APPVAR;
     } else if (in_fmt == FMT_APPVAR) {
         return FMT_PY;
     } else {
-        fatal("could not infer output file format!");
+        return FMT_INVALID;
     }
 }
 
-a_string guess_python_file_path(const Ti_PyFile* pyfile) {
-    if (args.out_path.len != 0)
-        return as_dupe(&args.out_path);
+// file name (without a directory) of the Python file extracted from an AppVar.
+// Returns false if it doesn't fit into `dest`.
+bool get_python_file_name(const Ti_PyFile* pyfile, const char* in_path,
+                          char* dest, usize sz) {
+    if (pyfile->file_name)
+        return (usize)snprintf(dest, sz, "%s", pyfile->file_name) < sz;
 
-    a_string res = astr("./");
+    char var_name[VAR_NAME_SZ + 1] = {0};
+    strncpy(var_name, pyfile->var_name, VAR_NAME_SZ);
+    if (strlen(var_name) == 0)
+        get_var_name_from_path(in_path, var_name);
 
-    if (pyfile->file_name) {
-        as_append(&res, pyfile->file_name);
-        return res;
+    return (usize)snprintf(dest, sz, "%s.py", var_name) < sz;
+}
+
+// file name (without a directory) of an AppVar. Returns false if it doesn't
+// fit into `dest`.
+bool get_appvar_file_name(const Ti_PyFile* pyfile, const char* in_path,
+                          char* dest, usize sz) {
+    char var_name[VAR_NAME_SZ + 1] = {0};
+    strncpy(var_name, pyfile->var_name, VAR_NAME_SZ);
+    if (strlen(var_name) == 0) {
+        warn("AppVar does not have a variable name!");
+        get_var_name_from_path(in_path, var_name);
     }
 
-    if (strlen(pyfile->var_name) == 0) {
-        char* var_name = get_var_name_from_path(args.in_path.data);
-        as_append(&res, var_name);
-        free(var_name);
-    } else {
-        as_append(&res, pyfile->var_name);
+    return (usize)snprintf(dest, sz, "%s.8xv", var_name) < sz;
+}
+
+// output path of a Python file, relative to the output directory
+bool guess_python_file_path(const Ti_PyFile* pyfile, const char* in_path,
+                            const Convert_Opts* opts, char* dest, usize sz) {
+    if (opts->out_path)
+        return (usize)snprintf(dest, sz, "%s", opts->out_path) < sz;
+
+    // piped in, pipe out
+    if (is_stdio(in_path))
+        return (usize)snprintf(dest, sz, "-") < sz;
+
+    return get_python_file_name(pyfile, in_path, dest, sz);
+}
+
+// the file name, without its extension, made into a variable name. `dest`
+// must hold `VAR_NAME_SZ + 1` bytes.
+void get_var_name_from_path(const char* path, char* dest) {
+    const char* base = basename(path);
+    const char* dot = strrchr(base, '.');
+    // no extension: the whole name
+    if (!dot || dot == base)
+        dot = base + strlen(base);
+
+    name_sanitize(base, (usize)(dot - base), dest);
+}
+
+// output path of an AppVar, relative to the output directory
+bool guess_appvar_path(const Ti_PyFile* pyfile, const char* in_path,
+                       const Convert_Opts* opts, char* dest, usize sz) {
+    if (opts->out_path)
+        return (usize)snprintf(dest, sz, "%s", opts->out_path) < sz;
+
+    if (is_stdio(in_path))
+        return (usize)snprintf(dest, sz, "-") < sz;
+
+    return get_appvar_file_name(pyfile, in_path, dest, sz);
+}
+
+// the content decides, but an extension that contradicts it is an error
+Format detect_format(const char* in_path, const char* data, usize len) {
+    Format fmt = get_format_from_data(data, len);
+    if (get_format_from_path(in_path) == FMT_APPVAR && fmt != FMT_APPVAR)
+        return FMT_INVALID;
+    return fmt;
+}
+
+// closes an output stream, which may be stdout. Returns false if anything
+// that was buffered could not be written out.
+static bool close_output(FILE* fp) {
+    if (fp == stdout)
+        return fflush(fp) == 0;
+    return fclose(fp) == 0;
+}
+
+// === helpers of the main program, for the commands ===
+
+bool has_ext(const char* path, const char* ext) {
+    usize len = strlen(path);
+    usize ext_len = strlen(ext);
+    return len > ext_len && !strcasecmp(&path[len - ext_len], ext);
+}
+
+void scan_scripts(const char* dir, void (*add)(const char* path, void* ctx),
+                  void* ctx) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        warn("could not open \"%s\": %s", dir, strerror(errno));
+        return;
     }
 
-    as_append(&res, ".py");
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        usize len = strlen(dir) + strlen(ent->d_name) + 2;
+        char* path = malloc(len);
+        check_alloc(path);
+        snprintf(path, len, "%s/%s", dir, ent->d_name);
+
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode))
+                scan_scripts(path, add, ctx);
+            else if (S_ISREG(st.st_mode) &&
+                     (has_ext(path, ".py") || has_ext(path, ".8xv")))
+                add(path, ctx);
+        }
+        free(path);
+    }
+    closedir(d);
+}
 
-    return res;
+void run_workers(usize jobs, void* (*worker)(void*), void* arg) {
+    pthread_t* threads = NULL;
+    usize spawned = 0;
+    if (jobs > 1) {
+        threads = calloc(jobs - 1, sizeof(pthread_t));
+        check_alloc(threads);
+        for (; spawned < jobs - 1; spawned++) {
+            if (pthread_create(&threads[spawned], NULL, worker, arg) != 0) {
+                warn("could not start worker thread, continuing with %zu",
+                     spawned + 1);
+                break;
+            }
+        }
+    }
+
+    worker(arg);
+
+    for (usize i = 0; i < spawned; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
 }
 
-char* get_var_name_from_path(const char* path) {
-    char* res = calloc(9, 1);
-    check_alloc(res);
-    char* name = get_file_name(path);
-    for (usize i = 0; i < 8; i++) {
-        if (name[i] == '\0')
+// === atomic outputs ===
+//
+// outputs are written to a temporary file next to their final path, which is
+// renamed over it once complete, so that a crash never leaves a truncated file
+// behind. With `--durable`, the renames are held back and committed in groups:
+// one syncfs() per file system makes the data of a whole group durable before
+// any of it is renamed into place, and a second round makes the renames
+// durable.
+
+#define OUT_CREATE_FLAGS   (O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC)
+#define OUT_IN_PLACE_FLAGS (O_WRONLY | O_TRUNC | O_CLOEXEC)
+#define DURABLE_BATCH      64
+
+typedef struct {
+    int fd;
+    char tmp[PATH_MAX];
+    char path[PATH_MAX];
+    const char* in_path;
+    u64 in_hash;
+    Result result;
+    // of the whole file, for `--stats`
+    u64 start;
+} Pending_Output;
+
+static atomic_size_t temp_seq;
+static pthread_mutex_t durable_lock = PTHREAD_MUTEX_INITIALIZER;
+static Pending_Output durable_pending[DURABLE_BATCH];
+static usize durable_len;
+
+// name of the temporary file for `path`, in the same directory. Returns false
+// if it doesn't fit into `dest`.
+static bool temp_path(const char* path, char* dest, usize sz) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    usize seq = atomic_fetch_add(&temp_seq, 1);
+    return (usize)snprintf(dest, sz, "%.*s.%s.%ld.%zu.tmp", dir_len, path,
+                           &path[dir_len], (long)getpid(), seq) < sz;
+}
+
+// looks at what is at `path` already. Renaming over a device or a FIFO would
+// replace the node itself, so they are written in place instead (`in_place`),
+// and symbolic links are refused. `mode` is the mode of an existing file, for
+// the temporary file to take over, or 0. Returns false with errno set if the
+// output can't be written.
+static bool output_target(const char* path, bool* in_place, mode_t* mode) {
+    *in_place = false;
+    *mode = 0;
+    struct stat st;
+    // a missing file is created, other errors show up when opening it
+    if (fstatat(out_dirfd, path, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return true;
+
+    if (S_ISLNK(st.st_mode)) {
+        errno = ELOOP;
+        return false;
+    }
+    if (S_ISCHR(st.st_mode) || S_ISFIFO(st.st_mode))
+        *in_place = true;
+    else
+        *mode = st.st_mode & 07777;
+    return true;
+}
+
+// opens `path` for writing, through a new temporary file `tmp` unless it is
+// written in place, in which case `tmp` is left empty. Returns the file
+// descriptor, or -1 with errno set.
+static int open_output(const char* path, char* tmp, usize sz) {
+    tmp[0] = '\0';
+    bool in_place;
+    mode_t mode;
+    if (!output_target(path, &in_place, &mode))
+        return -1;
+    if (in_place)
+        return openat(out_dirfd, path, OUT_IN_PLACE_FLAGS);
+
+    if (!temp_path(path, tmp, sz)) {
+        tmp[0] = '\0';
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = openat(out_dirfd, tmp, OUT_CREATE_FLAGS, 0666);
+    if (fd >= 0 && mode && fchmod(fd, mode) != 0) {
+        int err = errno;
+        close(fd);
+        unlinkat(out_dirfd, tmp, 0);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// renames a finished temporary file over `path`. Existing files are overwritten
+// unless `--no-clobber` is given. The temporary file is removed on failure.
+static bool commit_output(const char* tmp, const char* path) {
+    int res = renameat2(out_dirfd, tmp, out_dirfd, path, RENAME_NOREPLACE);
+    // not every file system supports RENAME_NOREPLACE
+    if (res != 0 && errno == EINVAL) {
+        res = faccessat(out_dirfd, path, F_OK, 0) == 0 ? -1 : 0;
+        if (res == 0)
+            res = renameat(out_dirfd, tmp, out_dirfd, path);
+        else
+            errno = EEXIST;
+    }
+    if (res != 0 && errno == EEXIST && !args.no_clobber) {
+        warn("file \"%s\" already exists, overwriting", path);
+        res = renameat(out_dirfd, tmp, out_dirfd, path);
+    }
+
+    if (res != 0) {
+        warn("could not move \"%s\" into place: \"%s\"", path,
+             strerror(errno));
+        unlinkat(out_dirfd, tmp, 0);
+        return false;
+    }
+    return true;
+}
+
+// records the result of an input in the journal
+static void journal_result(const char* in_path, u64 hash, const char* out_path,
+                           bool ok) {
+    if (journal_enabled && !is_stdio(in_path))
+        journal_record(in_path, hash, out_path, ok);
+}
+
+// the result record of a conversion. Failed ones have no output.
+static Result output_result(const Output* out, Result_Status status) {
+    bool ok = status == RESULT_OK;
+    return (Result){
+        .input = out->in_path,
+        .output = ok ? out->path : NULL,
+        .status = status,
+        .in_bytes = out->in_len,
+        .out_bytes = ok ? out->len : 0,
+        .checksum = ok ? out->checksum : -1,
+        .read_ns = out->read_ns,
+        .convert_ns = out->convert_ns,
+        .write_ns = out->write_ns,
+        .total_ns = phase_elapsed(out->start),
+    };
+}
+
+// records the result of a conversion for `--results`
+static void record_result(const Output* out, bool ok) {
+    if (results_enabled) {
+        Result res = output_result(out, ok ? RESULT_OK : RESULT_ERROR);
+        results_record(&res);
+    }
+}
+
+// whether an output is only final once its group is committed. The journal,
+// the results and the stats record it then.
+static bool output_deferred(const Output* out) {
+    return args.durable && out->path[0] && !is_stdio(out->path) &&
+           !out->in_place;
+}
+
+// syncs the file system of every pending output, once each. Manifest entries
+// can put their outputs on other file systems than the output directory's.
+// Must be called with `durable_lock` held.
+static bool durable_sync_locked(void) {
+    u64 t = phase_begin();
+    dev_t devs[DURABLE_BATCH];
+    bool ok = true;
+    for (usize i = 0; ok && i < durable_len; i++) {
+        struct stat st;
+        if (fstat(durable_pending[i].fd, &st) != 0) {
+            ok = false;
             break;
+        }
+        devs[i] = st.st_dev;
+        usize j = 0;
+        while (j < i && devs[j] != devs[i])
+            j++;
+        // the first output on its file system
+        if (j == i)
+            ok = syncfs(durable_pending[i].fd) == 0;
+    }
+    phase_end(STATS_SYNC, t);
+
+    if (!ok)
+        warn("could not sync outputs to disk: \"%s\"", strerror(errno));
+    return ok;
+}
+
+// commits every pending output. Must be called with `durable_lock` held.
+static void durable_flush_locked(void) {
+    if (durable_len == 0)
+        return;
+
+    bool synced = durable_sync_locked();
+
+    bool committed[DURABLE_BATCH];
+    for (usize i = 0; i < durable_len; i++) {
+        Pending_Output* p = &durable_pending[i];
+        committed[i] = synced && commit_output(p->tmp, p->path);
+        if (!synced)
+            unlinkat(out_dirfd, p->tmp, 0);
+    }
 
-        res[i] = toupper(name[i]);
+    if (synced)
+        synced = durable_sync_locked();
+
+    usize failed = 0;
+    for (usize i = 0; i < durable_len; i++) {
+        Pending_Output* p = &durable_pending[i];
+        bool ok = synced && committed[i];
+        // parts of a split source have no input of their own
+        if (p->in_path)
+            journal_result(p->in_path, p->in_hash, p->path, ok);
+        if (results_enabled && p->in_path) {
+            p->result.output = ok ? p->path : NULL;
+            if (!ok) {
+                p->result.status = RESULT_ERROR;
+                p->result.out_bytes = 0;
+                p->result.checksum = -1;
+            }
+            results_record(&p->result);
+        }
+        if (p->in_path)
+            stats_file_done(p->start, ok);
+        if (!ok)
+            failed++;
+        close(p->fd);
     }
-    free(name);
-    return res;
+    // the records of the group may only be durable after the group itself
+    journal_sync();
+
+    durable_len = 0;
+    atomic_fetch_add(&failed_inputs, failed);
+}
+
+// queues a written temporary file (and its still open `fd`) to be committed
+// with the next group
+static void durable_add(int fd, const char* tmp, const Output* out) {
+    pthread_mutex_lock(&durable_lock);
+    Pending_Output* p = &durable_pending[durable_len++];
+    p->fd = fd;
+    strcpy(p->tmp, tmp);
+    strcpy(p->path, out->path);
+    p->in_path = out->in_path;
+    p->in_hash = out->in_hash;
+    p->result = output_result(out, RESULT_OK);
+    p->start = out->start;
+    if (durable_len == DURABLE_BATCH)
+        durable_flush_locked();
+    pthread_mutex_unlock(&durable_lock);
 }
 
-// guesses the output path of an AppVar
-a_string guess_appvar_path(const Ti_PyFile* pyfile) {
-    if (args.out_path.len != 0)
-        return as_dupe(&args.out_path);
+// commits the last, partial group
+static void durable_flush(void) {
+    pthread_mutex_lock(&durable_lock);
+    durable_flush_locked();
+    pthread_mutex_unlock(&durable_lock);
+}
 
-    a_string res = astr("./");
-    if (strlen(pyfile->var_name) > 0) {
-        as_append(&res, pyfile->var_name);
+// writes all of `data`, retrying on short writes
+static bool write_all(int fd, const char* data, usize len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (usize)n;
+    }
+    return true;
+}
+
+// writes a single file out to its path
+static bool write_file(Output* out) {
+    const char* path = out->path;
+    const char* data = out->data;
+    usize len = out->len;
+    u64 t = phase_begin();
+    if (is_stdio(path)) {
+        if (fwrite(data, 1, len, stdout) != len || fflush(stdout) != 0) {
+            warn("short write-out on \"%s\"", path);
+            return false;
+        }
     } else {
-        warn("AppVar does not have a variable name!");
-        char* var_name = get_var_name_from_path(args.in_path.data);
-        as_append(&res, var_name);
-        free(var_name);
+        char tmp[PATH_MAX];
+        int fd = open_output(path, tmp, sizeof(tmp));
+        if (fd < 0) {
+            warn("could not open \"%s\" for writing: \"%s\"", path,
+                 strerror(errno));
+            return false;
+        }
+        out->in_place = !tmp[0];
+        if (trace_enabled)
+            trace_span("open", t, stats_now());
+
+        bool ok = write_all(fd, data, len);
+        if (ok && output_deferred(out)) {
+            out->write_ns = phase_elapsed(t);
+            durable_add(fd, tmp, out);
+        } else {
+            // errors of delayed writes may only show up here
+            if (close(fd) != 0)
+                ok = false;
+            if (!ok) {
+                warn("short write-out on \"%s\"", path);
+                if (!out->in_place)
+                    unlinkat(out_dirfd, tmp, 0);
+                return false;
+            }
+            if (!out->in_place && !commit_output(tmp, path))
+                return false;
+        }
     }
-    as_append(&res, ".8xv");
 
-    return res;
+    u64 write_ns = phase_end(STATS_WRITE, t);
+    if (!output_deferred(out))
+        out->write_ns = write_ns;
+    stats_bytes(0, len);
+    _info("file written to \"%s\"", path);
+    return true;
 }
 
-bool convert_appvar(const a_string* in_file) {
-    Ti_ParseResult res = {0};
-    Ti_PyFile pyfile = ti_pyfile_parse(in_file->data, &res);
+// writes the parts of a split source, into the directory of its output
+static bool write_parts(const Output* out) {
+    if (out->nparts == 0)
+        return true;
+    if (is_stdio(out->path)) {
+        warn("a split source cannot be written to stdout");
+        return false;
+    }
+
+    const char* slash = strrchr(out->path, '/');
+    int dir_len = slash ? (int)(slash - out->path) + 1 : 0;
+    for (usize i = 0; i < out->nparts; i++) {
+        const Split_Part* sp = &out->parts[i];
+        Output part = {.data = sp->data, .len = sp->len, .checksum = -1};
+        if ((usize)snprintf(part.path, sizeof(part.path), "%.*s%s.8xv",
+                            dir_len, out->path,
+                            sp->var_name) >= sizeof(part.path)) {
+            warn("output path for part \"%s\" is too long", sp->var_name);
+            return false;
+        }
+        if (!write_file(&part))
+            return false;
+    }
+    return true;
+}
+
+// writes a converted file out to its path, after its parts if it has any
+static bool write_output(Output* out) {
+    return write_parts(out) && write_file(out);
+}
+
+// validates and parses an AppVar. Returns an invalid file on error.
+Ti_PyFile parse_appvar(const char* in_path, const char* data, usize len) {
+    Ti_ParseResult res = TI_PARSE_OK;
+    // the parser trusts the header's sizes, so they must fit in the data
+    usize offset;
+    u16 src_len;
+    if (!ti_pyfile_locate_src(data, len, &offset, &src_len) ||
+        offset + src_len + 2 > len)
+        res = TI_INVALID_FORMAT;
+    else if (!ti_pyfile_checksum_valid(data, len))
+        res = TI_CHECKSUM_INCORRECT;
+
+    Ti_PyFile pyfile = ti_pyfile_new_invalid();
+    if (res == TI_PARSE_OK) {
+        u64 t = phase_begin();
+        pyfile = ti_pyfile_parse((char*)data, &res);
+        phase_end(STATS_PARSE, t);
+    }
 
     switch (res) {
         case TI_PARSE_OK: {
             _info("successfully parsed");
         } break;
         case TI_PARSE_ERROR: {
-            fatal("failed to parse AppVar!");
+            warn("failed to parse AppVar \"%s\"!", in_path);
         } break;
         case TI_INVALID_FORMAT: {
-            fatal("AppVar has an incorrect file format!");
+            warn("AppVar \"%s\" has an incorrect file format!", in_path);
         } break;
         case TI_CHECKSUM_INCORRECT: {
-            fatal("AppVar checksum verification failed");
+            warn("AppVar \"%s\" checksum verification failed", in_path);
         } break;
     }
 
-    a_string out_path = guess_python_file_path(&pyfile);
+    return pyfile;
+}
+
+// cuts a source that is too large for one AppVar into parts, at its top-level
+// statements. Each part star-imports the one before it, to see what was
+// defined there; sources whose meaning that would change are refused. Returns
+// the source of the entry AppVar, which imports every part in order
+// (malloc'ed), or NULL on error.
+static char* split_py(const char* in_path, const char* data, usize len,
+                      const char* var_name, const Convert_Opts* opts,
+                      Split_Part** parts, usize* nparts, usize* entry_len) {
+    usize* ends;
+    usize n = split_points(data, len, SPLIT_PART_SZ, &ends);
+    if (n == 0) {
+        warn("could not split \"%s\": a top-level statement is too large, "
+             "or it could not be tokenized",
+             in_path);
+        return NULL;
+    }
+    const char* name;
+    usize name_len;
+    const char* why = split_check(data, len, ends, n, &name, &name_len);
+    if (why) {
+        warn("could not split \"%s\": \"%.*s\" %s", in_path, (int)name_len,
+             name, why);
+        free(ends);
+        return NULL;
+    }
+    // the names taken up front are enough for any split of the source
+    if (opts->part_names ? n > opts->max_parts : n >= SPLIT_MAX_PARTS) {
+        warn("\"%s\" is split into too many parts", in_path);
+        free(ends);
+        return NULL;
+    }
+
+    Split_Part* res = calloc(n, sizeof(Split_Part));
+    check_alloc(res);
+    char* entry = malloc(n * SPLIT_IMPORT_SZ + 1);
+    check_alloc(entry);
+    char* src = malloc(TI_MAX_SRC_SZ);
+    check_alloc(src);
+    stats_allocs(3);
+
+    usize elen = 0;
+    usize start = 0;
+    for (usize k = 0; k < n; k++) {
+        Split_Part* sp = &res[k];
+        if (opts->part_names)
+            memcpy(sp->var_name, opts->part_names[k], sizeof(sp->var_name));
+        else
+            split_part_name(var_name, k + 1, n, sp->var_name);
+
+        usize src_len = 0;
+        if (k > 0)
+            src_len = sprintf(src, SPLIT_IMPORT, res[k - 1].var_name);
+        memcpy(&src[src_len], &data[start], ends[k] - start);
+        src_len += ends[k] - start;
+        start = ends[k];
+
+        Ti_PyFile f = ti_pyfile_new_with_metadata_full(src, src_len, NULL, 0,
+                                                       NULL, sp->var_name);
+        sp->len = ti_pyfile_dump(&f, &sp->data);
+        ti_pyfile_free(&f);
+        elen += sprintf(&entry[elen], SPLIT_IMPORT, sp->var_name);
+    }
+    _info("split \"%s\" into %zu parts", in_path, n);
+
+    free(src);
+    free(ends);
+    *parts = res;
+    *nparts = n;
+    *entry_len = elen;
+    return entry;
+}
 
-    if (file_exists(out_path.data))
-        warn("file %s already exists on disk, overwriting", out_path.data);
+static void split_parts_free(Split_Part* parts, usize nparts) {
+    for (usize i = 0; i < nparts; i++)
+        free(parts[i].data);
+    free(parts);
+}
 
-    FILE* out_fp = fopen(out_path.data, "w");
-    if (!out_fp)
-        fatal("could not open output path for writing: \"%s\"",
-              strerror(errno));
+// estimates the heap a script needs on the calculator, warns if it's more
+// than `--heap-check` allows and writes it to `--heap-report`
+static void check_heap(const char* in_path, const char* data, usize len) {
+    Heap_Estimate est;
+    if (!heap_estimate(data, len, &est)) {
+        warn("could not estimate the heap usage of \"%s\"", in_path);
+        return;
+    }
 
-    usize bytes_written = fwrite(pyfile.src, 1, pyfile.src_len, out_fp);
-    if (bytes_written < pyfile.src_len)
-        fatal("short write-out on Python file at \"%s\"", out_path.data);
-    _info("file written to \"%s\"", out_path.data);
+    atomic_fetch_add(&heap_checked, 1);
+    if (est.bytes > args.heap_limit) {
+        atomic_fetch_add(&heap_over, 1);
+        warn("\"%s\" may need %zu bytes of heap, more than the %zu there "
+             "are",
+             in_path, est.bytes, args.heap_limit);
+        for (usize i = 0; i < est.nfindings; i++) {
+            const Heap_Finding* f = &est.findings[i];
+            if (!f->unknown && f->bytes >= args.heap_limit / 4)
+                info("  line %zu: %s, %zu bytes", f->line, f->what, f->bytes);
+        }
+    }
+    if (est.nunknown)
+        _info("\"%s\": %zu heap finding(s) depend on what the script does",
+              in_path, est.nunknown);
 
-    ti_pyfile_free(&pyfile);
-    as_free(&out_path);
-    return true;
+    heap_report_record(in_path, &est, args.heap_limit);
+    heap_estimate_free(&est);
 }
 
-bool convert_py(const a_string* in_file) {
-    char* var_name;
-    if (args.var_name.len == 0)
-        var_name = get_var_name_from_path(args.in_path.data);
-    else
-        var_name = strdup(args.var_name.data);
+// builds an AppVar from Python source and dumps it into `*dest`. Sources that
+// are too large for one are cut into `parts` with `--split`. Returns the
+// length of the dump, 0 on error.
+usize dump_py(const char* in_path, const char* data, usize len,
+              const Convert_Opts* opts, Ti_PyFile* pyfile, char** dest,
+              Split_Part** parts, usize* nparts) {
+    *pyfile = ti_pyfile_new_invalid();
+    char path_name[VAR_NAME_SZ + 1];
+    const char* var_name = opts->var_name;
+    if (!var_name && !is_stdio(in_path)) {
+        get_var_name_from_path(in_path, path_name);
+        var_name = path_name;
+    }
+    // the manifest checks that it fits
+    u8 file_name_len = opts->file_name ? (u8)strlen(opts->file_name) : 0;
+
+    u64 t = phase_begin();
+    char* normalized = NULL;
+    if (args.normalize) {
+        normalized = malloc(len + 1);
+        check_alloc(normalized);
+        stats_allocs(1);
+        Text_Stats st;
+        len = text_to_ti(data, len, normalized, &st);
+        normalized[len] = '\0';
+        data = normalized;
+        if (st.crlf || st.bom || st.mapped)
+            _info("normalized \"%s\": %zu line break(s), %zu character(s)%s",
+                  in_path, st.crlf, st.mapped,
+                  st.bom ? ", byte order mark" : "");
+        if (st.unmapped)
+            warn("\"%s\" has %zu character(s) the calculator can't show, "
+                 "written as ?",
+                 in_path, st.unmapped);
+    }
 
-    Ti_PyFile pyfile = ti_pyfile_new_with_metadata_full(
-        in_file->data, in_file->len, NULL, 0, NULL, var_name);
+    char* minified = NULL;
+    if (args.minify) {
+        minified = malloc(len + 1);
+        check_alloc(minified);
+        stats_allocs(1);
+        usize min_len;
+        if (minify(data, len, minified, &min_len, args.minify_names)) {
+            _info("minified \"%s\", %zu bytes saved", in_path,
+                  len - min_len);
+            atomic_fetch_add(&minify_saved, len - min_len);
+            atomic_fetch_add(&minify_total, len);
+            data = minified;
+            len = min_len;
+        } else {
+            warn("could not minify \"%s\", leaving it as is", in_path);
+        }
+    }
 
-    char* buf = NULL;
-    usize len = ti_pyfile_dump(&pyfile, &buf);
+    if (args.heap_limit)
+        check_heap(in_path, data, len);
+
+    usize max_len = max_src_len(opts);
+    bool fits = len <= max_len;
+    char* entry = NULL;
+    if (!fits && !args.split) {
+        warn("\"%s\" is too large for an AppVar (%zu bytes, at most %zu), "
+             "see --split",
+             in_path, len, max_len);
+    } else if (!fits) {
+        // ti_pyfile_new's default name
+        const char* base = var_name ? var_name : "PYFILE";
+        entry = split_py(in_path, data, len, base, opts, parts, nparts,
+                         &len);
+        data = entry;
+        fits = entry && len <= max_len;
+        if (entry && !fits)
+            warn("\"%s\" is split into too many parts", in_path);
+    }
+    if (fits) {
+        *pyfile = ti_pyfile_new_with_metadata_full(
+            data, len, opts->file_name, file_name_len, opts->comment,
+            var_name);
+    }
+    free(normalized);
+    free(minified);
+    free(entry);
+    phase_end(STATS_PARSE, t);
+
+    if (!ti_pyfile_valid(pyfile))
+        return 0;
+    return ti_pyfile_dump(pyfile, dest);
+}
 
-    a_string out_path = guess_appvar_path(&pyfile);
-    if (file_exists(out_path.data))
-        warn("AppVar at path \"%s\" already exists, overwriting",
-             out_path.data);
+void output_free(Output* out) {
+    free(out->data);
+    out->data = NULL;
+    split_parts_free(out->parts, out->nparts);
+    out->parts = NULL;
+    out->nparts = 0;
+}
 
-    FILE* fp = fopen(out_path.data, "w");
-    if (!fp)
-        fatal("could not open AppVar for writing: \"%s\"", strerror(errno));
+// the checksum trailer of a (valid) AppVar
+static int appvar_checksum(const char* data, usize len) {
+    return (u8)data[len - 2] | ((u8)data[len - 1] << 8);
+}
+
+bool convert_appvar(const char* in_path, const char* data, usize len,
+                    const Convert_Opts* opts, Output* out) {
+    Ti_PyFile pyfile = parse_appvar(in_path, data, len);
+    if (!ti_pyfile_valid(&pyfile))
+        return false;
 
-    usize bytes_written = fwrite(buf, 1, len, fp);
-    if (bytes_written < len)
-        panic("short write-out on AppVar!");
-    _info("file written to \"%s\"", out_path.data);
+    out->checksum = appvar_checksum(data, len);
+    bool ok = guess_python_file_path(&pyfile, in_path, opts, out->path,
+                                     sizeof(out->path));
+    if (ok && args.normalize && !text_is_utf8(pyfile.src, pyfile.src_len)) {
+        out->data = malloc(3 * (usize)pyfile.src_len + 1);
+        check_alloc(out->data);
+        stats_allocs(1);
+        out->len = text_from_ti(pyfile.src, pyfile.src_len, out->data);
+        out->data[out->len] = '\0';
+    } else if (ok) {
+        // take the source over from the file
+        out->data = (char*)pyfile.src;
+        out->len = pyfile.src_len;
+        pyfile.src = NULL;
+    } else {
+        warn("output path for \"%s\" is too long", in_path);
+    }
 
-    free(buf);
-    fclose(fp);
-    free(var_name);
     ti_pyfile_free(&pyfile);
-    as_free(&out_path);
+    return ok;
+}
 
-    return true;
+bool convert_py(const char* in_path, const char* data, usize len,
+                const Convert_Opts* opts, Output* out) {
+    Ti_PyFile pyfile;
+    out->len = dump_py(in_path, data, len, opts, &pyfile, &out->data,
+                       &out->parts, &out->nparts);
+    if (out->len == 0)
+        return false;
+    out->checksum = appvar_checksum(out->data, out->len);
+    bool ok = guess_appvar_path(&pyfile, in_path, opts, out->path,
+                                sizeof(out->path));
+    if (!ok)
+        warn("output path for \"%s\" is too long", in_path);
+
+    ti_pyfile_free(&pyfile);
+    return ok;
+}
+
+bool convert_buffer(const char* in_path, const char* data, usize len,
+                    const Convert_Opts* opts, Output* out) {
+    Format in_fmt = detect_format(in_path, data, len);
+    Format out_fmt = get_output_format(in_fmt, opts);
+
+    if (in_fmt == FMT_INVALID) {
+        warn("unknown input file format: \"%s\"", in_path);
+    } else if (out_fmt == FMT_INVALID) {
+        warn("unknown output file format");
+    } else if (in_fmt == out_fmt) {
+        warn("input and output formats are the same, no conversion done");
+    } else if (in_fmt == FMT_APPVAR) {
+        _info("converting from AppVar to Python");
+        return convert_appvar(in_path, data, len, opts, out);
+    } else {
+        _info("converting from Python to AppVar");
+        return convert_py(in_path, data, len, opts, out);
+    }
+
+    return false;
+}
+
+typedef enum {
+    LOAD_OK = 0,
+    LOAD_FAILED,
+    // already converted according to the journal
+    LOAD_DONE,
+} Load_Result;
+
+// reads the input of `out`, and looks it up in the journal. Inputs that
+// failed to load or are skipped are recorded here.
+static Load_Result load_input(Output* out, char** data, usize* len) {
+    const char* in_path = out->in_path;
+    u64 t = out->start = phase_begin();
+    *data = read_input(in_path, len);
+    if (!*data) {
+        warn("failed to read input file \"%s\": \"%s\"", in_path,
+             strerror(errno));
+        journal_result(in_path, 0, NULL, false);
+        record_result(out, false);
+        return LOAD_FAILED;
+    }
+    out->read_ns = phase_end(STATS_READ, t);
+    out->in_len = *len;
+    stats_bytes(*len, 0);
+    stats_allocs(1);
+    _info("loaded file \"%s\"", in_path);
+
+    if (journal_enabled) {
+        out->in_hash = hash_bytes(*data, *len, HASH_SEED);
+        if (journal_is_done(in_path, out->in_hash)) {
+            _info("skipping \"%s\", already converted", in_path);
+            free(*data);
+            *data = NULL;
+            if (results_enabled) {
+                Result res = output_result(out, RESULT_SKIPPED);
+                results_record(&res);
+            }
+            return LOAD_DONE;
+        }
+    }
+
+    return LOAD_OK;
+}
+
+// converts a loaded input into `out`, and frees the input
+static bool convert_loaded(Output* out, char* data, usize len,
+                           const Convert_Opts* opts) {
+    u64 t = phase_begin();
+    bool ok = convert_buffer(out->in_path, data, len, opts, out);
+    out->convert_ns = phase_elapsed(t);
+    free(data);
+    return ok;
+}
+
+// records the result of an input once its output was written (or not)
+static void finish_output(const Output* out, bool ok) {
+    if (!ok || !output_deferred(out)) {
+        journal_result(out->in_path, out->in_hash, ok ? out->path : NULL, ok);
+        record_result(out, ok);
+        stats_file_done(out->start, ok);
+    }
+}
+
+static bool convert_file(const char* in_path, const Convert_Opts* opts) {
+    Output out = {.in_path = in_path, .checksum = -1};
+    char* data;
+    usize len = 0;
+    switch (load_input(&out, &data, &len)) {
+        case LOAD_FAILED: {
+            stats_file_done(out.start, false);
+            return false;
+        }
+        case LOAD_DONE: {
+            stats_file_done(out.start, true);
+            return true;
+        }
+        case LOAD_OK: break;
+    }
+
+    bool ok = convert_loaded(&out, data, len, opts);
+    if (ok)
+        ok = write_output(&out);
+    finish_output(&out, ok);
+
+    output_free(&out);
+    return ok;
+}
+
+bool convert(const char* in_path, const Convert_Opts* opts) {
+    trace_set_file(in_path);
+    u64 start = phase_begin();
+    bool ok = convert_file(in_path, opts);
+    if (trace_enabled)
+        trace_span("convert", start, stats_now());
+    return ok;
+}
+
+static void* convert_worker(void* arg) {
+    (void)arg;
+
+    usize i;
+    while ((i = atomic_fetch_add(&next_input, 1)) < args.in_paths_len) {
+        if (!convert(args.in_paths[i], input_opts(i)))
+            atomic_fetch_add(&failed_inputs, 1);
+    }
+
+    return NULL;
+}
+
+// converts every input file, on up to `args.jobs` threads (the calling thread
+// included). Returns false if any conversion failed.
+bool convert_all(void) {
+    usize nthreads = args.jobs;
+    if (nthreads > args.in_paths_len)
+        nthreads = args.in_paths_len;
+
+    run_workers(nthreads, convert_worker, NULL);
+    durable_flush();
+
+    return atomic_load(&failed_inputs) == 0;
+}
+
+// === pipelined backend ===
+//
+// reader threads load inputs, converter threads (`-j`) convert them and writer
+// threads write the outputs, connected by lock-free queues, so that I/O and
+// conversion overlap. Readers only load another input while the bytes held by
+// the pipeline fit into `--max-inflight`: a slow disk or a slow CPU makes the
+// other stages wait instead of piling files up in memory.
+
+#define PIPE_QUEUE_SZ 64
+
+typedef struct {
+    Output out;
+    const Convert_Opts* opts;
+    char* data;
+    usize len;
+    // bytes taken from the budget
+    usize held;
+    bool ok;
+} Pipe_Job;
+
+static Lf_Queue pipe_convert_q;
+static Lf_Queue pipe_write_q;
+static Budget pipe_budget;
+static atomic_size_t pipe_readers;
+static atomic_size_t pipe_converters;
+
+// the size of an input, as a guess of how much memory it will take
+static usize input_size_hint(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        return 0;
+    return (usize)st.st_size;
 }
 
-bool convert(Format in_fmt) {
-    a_string in_file = as_read_file(args.in_path.data);
-    if (!as_valid(&in_file)) {
-        warn("failed to read input file: \"%s\"", strerror(errno));
+static void* pipe_reader(void* arg) {
+    (void)arg;
+
+    usize i;
+    while ((i = atomic_fetch_add(&next_input, 1)) < args.in_paths_len) {
+        const char* path = args.in_paths[i];
+        // stdin is converted on the spot, there is only one
+        if (is_stdio(path)) {
+            if (!convert(path, input_opts(i)))
+                atomic_fetch_add(&failed_inputs, 1);
+            continue;
+        }
+
+        usize hint = input_size_hint(path);
+        budget_acquire(&pipe_budget, hint);
+
+        Pipe_Job* job = calloc(1, sizeof(Pipe_Job));
+        check_alloc(job);
+        job->out = (Output){.in_path = path, .checksum = -1};
+        job->opts = input_opts(i);
+        trace_set_file(path);
+
+        Load_Result res = load_input(&job->out, &job->data, &job->len);
+        // the file may have changed since
+        budget_add(&pipe_budget, job->len);
+        budget_release(&pipe_budget, hint);
+        job->held = job->len;
+
+        if (res != LOAD_OK) {
+            if (res == LOAD_FAILED)
+                atomic_fetch_add(&failed_inputs, 1);
+            stats_file_done(job->out.start, res == LOAD_DONE);
+            budget_release(&pipe_budget, job->held);
+            free(job);
+            continue;
+        }
+        lf_queue_push(&pipe_convert_q, job);
+    }
+
+    // the last reader out closes the door
+    if (atomic_fetch_sub(&pipe_readers, 1) == 1)
+        lf_queue_close(&pipe_convert_q);
+    return NULL;
+}
+
+static void* pipe_converter(void* arg) {
+    (void)arg;
+
+    Pipe_Job* job;
+    while ((job = lf_queue_pop(&pipe_convert_q))) {
+        trace_set_file(job->out.in_path);
+        job->ok = convert_loaded(&job->out, job->data, job->len, job->opts);
+        job->data = NULL;
+
+        // the output takes the place of the input
+        budget_add(&pipe_budget, job->out.len);
+        budget_release(&pipe_budget, job->held);
+        job->held = job->out.len;
+        lf_queue_push(&pipe_write_q, job);
+    }
+
+    if (atomic_fetch_sub(&pipe_converters, 1) == 1)
+        lf_queue_close(&pipe_write_q);
+    return NULL;
+}
+
+static void* pipe_writer(void* arg) {
+    (void)arg;
+
+    Pipe_Job* job;
+    while ((job = lf_queue_pop(&pipe_write_q))) {
+        trace_set_file(job->out.in_path);
+        bool ok = job->ok && write_output(&job->out);
+        finish_output(&job->out, ok);
+        if (!ok)
+            atomic_fetch_add(&failed_inputs, 1);
+
+        output_free(&job->out);
+        budget_release(&pipe_budget, job->held);
+        free(job);
+    }
+
+    return NULL;
+}
+
+// converts every input file with separate reader, converter and writer
+// threads. Returns false if any conversion failed.
+bool convert_pipeline(void) {
+    usize nreaders = args.io_threads;
+    if (nreaders > args.in_paths_len)
+        nreaders = args.in_paths_len;
+    // someone has to close the queues, even for an empty shard
+    if (nreaders == 0)
+        nreaders = 1;
+    usize nconverters = args.jobs;
+    usize nwriters = args.io_threads;
+    usize nthreads = nreaders + nconverters + nwriters;
+
+    lf_queue_init(&pipe_convert_q, PIPE_QUEUE_SZ);
+    lf_queue_init(&pipe_write_q, PIPE_QUEUE_SZ);
+    budget_init(&pipe_budget, args.max_inflight);
+    atomic_store(&pipe_readers, nreaders);
+    atomic_store(&pipe_converters, nconverters);
+
+    // the calling thread is one of the writers
+    pthread_t* threads = calloc(nthreads - 1, sizeof(pthread_t));
+    check_alloc(threads);
+    usize n = 0;
+    for (usize i = 0; i < nreaders; i++) {
+        if (pthread_create(&threads[n++], NULL, pipe_reader, NULL) != 0)
+            panic("could not start a reader thread");
+    }
+    for (usize i = 0; i < nconverters; i++) {
+        if (pthread_create(&threads[n++], NULL, pipe_converter, NULL) != 0)
+            panic("could not start a converter thread");
+    }
+    for (usize i = 0; i < nwriters - 1; i++) {
+        if (pthread_create(&threads[n++], NULL, pipe_writer, NULL) != 0)
+            panic("could not start a writer thread");
+    }
+
+    pipe_writer(NULL);
+
+    for (usize i = 0; i < n; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    lf_queue_free(&pipe_convert_q);
+    lf_queue_free(&pipe_write_q);
+    durable_flush();
+
+    return atomic_load(&failed_inputs) == 0;
+}
+
+// === watch mode ===
+//
+// converts files in a directory whenever they change, until interrupted. The
+// watcher coalesces bursts of events, and the content hashes it keeps skip
+// saves that changed nothing, as well as the outputs written back into the
+// watched directory.
+
+static Watch watcher;
+static volatile sig_atomic_t watch_stopped;
+
+static void watch_stop(int sig) {
+    (void)sig;
+    watch_stopped = 1;
+}
+
+static void watch_convert(const char* path, void* ctx) {
+    (void)ctx;
+    if (get_format_from_path(path) == FMT_INVALID)
+        return;
+
+    trace_set_file(path);
+    Output out = {.in_path = path, .checksum = -1};
+    char* data;
+    usize len = 0;
+    Load_Result res = load_input(&out, &data, &len);
+    if (res != LOAD_OK) {
+        if (res == LOAD_FAILED)
+            atomic_fetch_add(&failed_inputs, 1);
+        return;
+    }
+
+    if (!watch_changed(&watcher, path, hash_bytes(data, len, HASH_SEED))) {
+        _info("\"%s\" is unchanged", path);
+        free(data);
+        return;
+    }
+
+    bool ok = convert_loaded(&out, data, len, &default_opts);
+    if (ok)
+        ok = write_output(&out);
+    finish_output(&out, ok);
+    // the path is gone after this call, nothing may be held back
+    durable_flush();
+
+    if (ok) {
+        if (!is_stdio(out.path))
+            watch_note_output(&watcher, out_dirfd, out.path,
+                              hash_bytes(out.data, out.len, HASH_SEED));
+        info("converted \"%s\" to \"%s\"", path, out.path);
+    } else {
+        atomic_fetch_add(&failed_inputs, 1);
+    }
+    output_free(&out);
+}
+
+// watches `--watch` until SIGINT or SIGTERM. Returns false if the directory
+// can't be watched.
+bool watch_dir(void) {
+    if (!watch_init(&watcher, args.watch.data, args.debounce_ms)) {
+        warn("could not watch \"%s\": %s", args.watch.data, strerror(errno));
         return false;
     }
-    _info("loaded file \"%s\"", args.in_path.data);
 
-    switch (in_fmt) {
-        case FMT_APPVAR: {
-            _info("converting from AppVar to Python");
-            if (!convert_appvar(&in_file))
-                return false;
+    // no SA_RESTART, so that the signal interrupts the wait
+    struct sigaction sa = {.sa_handler = watch_stop};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    info("watching \"%s\" for changes, press Ctrl-C to stop",
+         args.watch.data);
+    bool ok = true;
+    while (ok && !watch_stopped) {
+        ok = watch_poll(&watcher, watch_convert, NULL);
+        if (!ok)
+            warn("could not watch \"%s\": %s", args.watch.data,
+                 strerror(errno));
+    }
+
+    watch_free(&watcher);
+    return ok;
+}
+
+// === io_uring backend ===
+//
+// every input goes through a small state machine (open, read, close, convert,
+// open, write, close) on one of `URING_SLOTS` slots. All I/O is submitted to
+// one ring, so a single thread keeps many files in flight at once.
+
+#ifdef HAVE_IO_URING
+
+#define URING_DEPTH   256
+#define URING_SLOTS   128
+#define URING_READ_SZ (16 * 1024)
+#define URING_MAX_IO  (1u << 30)
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_OPEN_IN,
+    SLOT_READ,
+    SLOT_CLOSE_IN,
+    SLOT_OPEN_OUT,
+    SLOT_WRITE,
+    SLOT_CLOSE_OUT,
+    SLOT_RENAME,
+} Slot_State;
+
+typedef struct {
+    Slot_State state;
+    const char* in_path;
+    const Convert_Opts* opts;
+    int fd;
+    char* buf;
+    usize cap;
+    usize len;
+    Output out;
+    char tmp[PATH_MAX];
+    // of the file the output replaces, see `output_target`
+    mode_t mode;
+    usize written;
+    bool overwrite;
+    bool skipped;
+    u64 start; // of the whole file
+    u64 t;     // of the current phase
+} Uring_Slot;
+
+static Uring ring;
+static Uring_Slot slots[URING_SLOTS];
+
+// queues a request for a slot. Slots have one request in flight at most, so
+// the submission queue (which is larger) can't run out.
+static struct io_uring_sqe* slot_sqe(void) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+    if (!sqe)
+        panic("io_uring submission queue overflow");
+    return sqe;
+}
+
+static u64 slot_id(const Uring_Slot* s) {
+    return (u64)(s - slots);
+}
+
+static void slot_next(Uring_Slot* s);
+
+static void slot_finish(Uring_Slot* s, bool ok) {
+    if (s->skipped) {
+        if (results_enabled) {
+            Result res = output_result(&s->out, RESULT_SKIPPED);
+            results_record(&res);
+        }
+        stats_file_done(s->start, ok);
+    } else {
+        finish_output(&s->out, ok);
+    }
+    if (!ok)
+        atomic_fetch_add(&failed_inputs, 1);
+    free(s->buf);
+    output_free(&s->out);
+    s->state = SLOT_FREE;
+    slot_next(s);
+}
+
+// starts the next input on a slot, if there is one
+static void slot_next(Uring_Slot* s) {
+    usize i;
+    while ((i = atomic_fetch_add(&next_input, 1)) < args.in_paths_len) {
+        const char* path = args.in_paths[i];
+        // stdin can't be opened by path
+        if (is_stdio(path)) {
+            if (!convert(path, input_opts(i)))
+                atomic_fetch_add(&failed_inputs, 1);
+            continue;
+        }
+
+        *s = (Uring_Slot){
+            .state = SLOT_OPEN_IN,
+            .in_path = path,
+            .opts = input_opts(i),
+            .fd = -1,
+            .start = phase_begin(),
+            .out.in_path = path,
+            .out.checksum = -1,
+        };
+        s->t = s->out.start = s->start;
+        uring_prep_openat(slot_sqe(), AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0,
+                          slot_id(s));
+        return;
+    }
+}
+
+static void slot_read(Uring_Slot* s) {
+    // keep a byte for the null terminator
+    if (s->len + 1 >= s->cap) {
+        s->cap *= 2;
+        s->buf = realloc(s->buf, s->cap);
+        check_alloc(s->buf);
+    }
+    usize n = s->cap - s->len - 1;
+    if (n > URING_MAX_IO)
+        n = URING_MAX_IO;
+
+    s->state = SLOT_READ;
+    uring_prep_read(slot_sqe(), s->fd, &s->buf[s->len], (u32)n, s->len,
+                    slot_id(s));
+}
+
+static void slot_rename(Uring_Slot* s) {
+    u32 flags = s->overwrite ? 0 : RENAME_NOREPLACE;
+
+    s->state = SLOT_RENAME;
+    uring_prep_renameat(slot_sqe(), out_dirfd, s->tmp, out_dirfd, s->out.path,
+                        flags, slot_id(s));
+}
+
+// the output is in place
+static void slot_written(Uring_Slot* s) {
+    s->out.write_ns = phase_end(STATS_WRITE, s->t);
+    stats_bytes(0, s->written);
+    _info("file written to \"%s\"", s->out.path);
+    slot_finish(s, true);
+}
+
+static void slot_write(Uring_Slot* s) {
+    if (s->written == s->out.len) {
+        // the group commit syncs and renames it later
+        if (output_deferred(&s->out)) {
+            s->out.write_ns = phase_elapsed(s->t);
+            durable_add(s->fd, s->tmp, &s->out);
+            phase_end(STATS_WRITE, s->t);
+            stats_bytes(0, s->written);
+            slot_finish(s, true);
+            return;
+        }
+        s->state = SLOT_CLOSE_OUT;
+        uring_prep_close(slot_sqe(), s->fd, slot_id(s));
+        return;
+    }
+
+    usize n = s->out.len - s->written;
+    if (n > URING_MAX_IO)
+        n = URING_MAX_IO;
+
+    s->state = SLOT_WRITE;
+    uring_prep_write(slot_sqe(), s->fd, &s->out.data[s->written], (u32)n,
+                     s->written, slot_id(s));
+}
+
+// the in-memory part, between reading the input and writing the output
+static void slot_convert(Uring_Slot* s) {
+    s->buf[s->len] = '\0';
+    trace_set_file(s->in_path);
+    if (journal_enabled) {
+        s->out.in_hash = hash_bytes(s->buf, s->len, HASH_SEED);
+        if (journal_is_done(s->in_path, s->out.in_hash)) {
+            _info("skipping \"%s\", already converted", s->in_path);
+            s->skipped = true;
+            slot_finish(s, true);
+            return;
+        }
+    }
+
+    u64 t = phase_begin();
+    bool ok = convert_buffer(s->in_path, s->buf, s->len, s->opts, &s->out);
+    s->out.convert_ns = phase_elapsed(t);
+    free(s->buf);
+    s->buf = NULL;
+
+    if (!ok) {
+        slot_finish(s, false);
+    } else if (is_stdio(s->out.path)) {
+        slot_finish(s, write_output(&s->out));
+    } else if (!write_parts(&s->out)) {
+        // only the entry goes through the ring, its parts are written here
+        slot_finish(s, false);
+    } else if (!output_target(s->out.path, &s->out.in_place, &s->mode)) {
+        warn("could not open \"%s\" for writing: \"%s\"", s->out.path,
+             strerror(errno));
+        slot_finish(s, false);
+    } else if (s->out.in_place) {
+        s->t = phase_begin();
+        s->state = SLOT_OPEN_OUT;
+        uring_prep_openat(slot_sqe(), out_dirfd, s->out.path,
+                          OUT_IN_PLACE_FLAGS, 0, slot_id(s));
+    } else if (!temp_path(s->out.path, s->tmp, sizeof(s->tmp))) {
+        warn("output path \"%s\" is too long", s->out.path);
+        slot_finish(s, false);
+    } else {
+        s->t = phase_begin();
+        s->state = SLOT_OPEN_OUT;
+        uring_prep_openat(slot_sqe(), out_dirfd, s->tmp, OUT_CREATE_FLAGS,
+                          0666, slot_id(s));
+    }
+}
+
+// advances a slot once its request completed with `res`
+static void slot_complete(Uring_Slot* s, int res) {
+    switch (s->state) {
+        case SLOT_OPEN_IN: {
+            if (res < 0) {
+                warn("failed to read input file \"%s\": \"%s\"", s->in_path,
+                     strerror(-res));
+                slot_finish(s, false);
+                break;
+            }
+            s->fd = res;
+            s->cap = URING_READ_SZ;
+            s->buf = malloc(s->cap);
+            check_alloc(s->buf);
+            stats_allocs(1);
+            slot_read(s);
         } break;
-        case FMT_PY: {
-            _info("converting from Python to AppVar");
-            if (!convert_py(&in_file))
-                return false;
+        case SLOT_READ: {
+            if (res < 0) {
+                warn("failed to read input file \"%s\": \"%s\"", s->in_path,
+                     strerror(-res));
+                close(s->fd);
+                slot_finish(s, false);
+                break;
+            }
+            if (res > 0) {
+                s->len += (usize)res;
+                slot_read(s);
+                break;
+            }
+            s->out.read_ns = phase_end(STATS_READ, s->t);
+            s->out.in_len = s->len;
+            stats_bytes(s->len, 0);
+            _info("loaded file \"%s\"", s->in_path);
+            s->state = SLOT_CLOSE_IN;
+            uring_prep_close(slot_sqe(), s->fd, slot_id(s));
+        } break;
+        case SLOT_CLOSE_IN: {
+            slot_convert(s);
+        } break;
+        case SLOT_OPEN_OUT: {
+            if (res < 0) {
+                warn("could not open \"%s\" for writing: \"%s\"",
+                     s->out.path, strerror(-res));
+                slot_finish(s, false);
+                break;
+            }
+            s->fd = res;
+            if (s->mode && fchmod(s->fd, s->mode) != 0) {
+                warn("could not open \"%s\" for writing: \"%s\"",
+                     s->out.path, strerror(errno));
+                close(s->fd);
+                unlinkat(out_dirfd, s->tmp, 0);
+                slot_finish(s, false);
+                break;
+            }
+            slot_write(s);
         } break;
-        default:
+        case SLOT_WRITE: {
+            if (res <= 0) {
+                warn("short write-out on \"%s\"", s->out.path);
+                close(s->fd);
+                if (!s->out.in_place)
+                    unlinkat(out_dirfd, s->tmp, 0);
+                slot_finish(s, false);
+                break;
+            }
+            s->written += (usize)res;
+            slot_write(s);
+        } break;
+        case SLOT_CLOSE_OUT: {
+            if (res < 0) {
+                warn("short write-out on \"%s\"", s->out.path);
+                if (!s->out.in_place)
+                    unlinkat(out_dirfd, s->tmp, 0);
+                slot_finish(s, false);
+                break;
+            }
+            if (s->out.in_place)
+                slot_written(s);
+            else
+                slot_rename(s);
+        } break;
+        case SLOT_RENAME: {
+            if (res == -EEXIST && !s->overwrite && !args.no_clobber) {
+                warn("file \"%s\" already exists, overwriting",
+                     s->out.path);
+                s->overwrite = true;
+                slot_rename(s);
+                break;
+            }
+            // no RENAME_NOREPLACE on this file system
+            if (res == -EINVAL && !s->overwrite) {
+                slot_finish(s, commit_output(s->tmp, s->out.path));
+                break;
+            }
+            if (res < 0) {
+                warn("could not move \"%s\" into place: \"%s\"",
+                     s->out.path, strerror(-res));
+                unlinkat(out_dirfd, s->tmp, 0);
+                slot_finish(s, false);
+                break;
+            }
+            slot_written(s);
+        } break;
+        case SLOT_FREE: {
+            panic("completion for an idle io_uring slot");
+        } break;
+    }
+}
+
+static bool slots_busy(void) {
+    for (usize i = 0; i < URING_SLOTS; i++) {
+        if (slots[i].state != SLOT_FREE)
+            return true;
+    }
+    return false;
+}
+
+#endif // HAVE_IO_URING
+
+// converts every input file with io_uring on the calling thread. Falls back
+// to `convert_all` if io_uring can't be used.
+bool convert_all_uring(void) {
+#ifdef HAVE_IO_URING
+    static const u8 ops[] = {IORING_OP_OPENAT, IORING_OP_READ,
+                             IORING_OP_WRITE, IORING_OP_CLOSE,
+                             IORING_OP_RENAMEAT};
+    if (!uring_init(&ring, URING_DEPTH, ops, LENGTH(ops))) {
+        warn("io_uring is not available, falling back to blocking I/O");
+        return convert_all();
+    }
+
+    for (usize i = 0; i < URING_SLOTS; i++)
+        slot_next(&slots[i]);
+
+    while (slots_busy()) {
+        int res = uring_submit_and_wait(&ring, 1);
+        if (res < 0)
+            panic("io_uring_enter failed: %s", strerror(-res));
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring_peek_cqe(&ring))) {
+            Uring_Slot* s = &slots[cqe->user_data];
+            int cqe_res = cqe->res;
+            uring_cqe_seen(&ring);
+            slot_complete(s, cqe_res);
+        }
+    }
+
+    uring_free(&ring);
+    durable_flush();
+    return atomic_load(&failed_inputs) == 0;
+#else
+    warn("built without io_uring support, falling back to blocking I/O");
+    return convert_all();
+#endif
+}
+
+// === tar streams ===
+//
+// entries are read by a reader thread, converted by `args.jobs` converter
+// threads and written out (in their original order) by the calling thread.
+// The stages are connected by bounded queues, so all three overlap.
+
+typedef struct {
+    Tar_Entry entry;
+    usize seq;
+    // empty if the entry doesn't need one
+    char var_name[VAR_NAME_SZ + 1];
+    Convert_Opts opts;
+    // with `--split`, written before the entry
+    Split_Part* parts;
+    usize nparts;
+    bool ok;
+    bool skipped;
+} Tar_Job;
+
+#define TAR_QUEUE_SZ 64
+
+static Queue tar_in_q;
+static Queue tar_out_q;
+static atomic_size_t tar_converters;
+static atomic_bool tar_read_failed;
+
+// names are handed out by the reader, in the order of the stream
+static Name_Set tar_names;
+
+// like `--watch`, only Python files and AppVars are converted. Anything else
+// would be taken for Python source if it is text.
+static bool tar_wanted(const char* name) {
+    return get_format_from_path(name) != FMT_INVALID;
+}
+
+static void* tar_reader(void* arg) {
+    FILE* fp = arg;
+
+    for (usize seq = 0;;) {
+        Tar_Job* job = calloc(1, sizeof(Tar_Job));
+        check_alloc(job);
+
+        u64 t = phase_begin();
+        Tar_Result res = tar_read_entry(fp, &job->entry, tar_wanted);
+        if (res != TAR_OK) {
+            if (res == TAR_ERROR) {
+                warn("malformed tar stream or read error");
+                atomic_store(&tar_read_failed, true);
+            }
+            free(job);
             break;
+        }
+        trace_set_file(job->entry.name);
+        phase_end(STATS_READ, t);
+        if (!job->entry.data) {
+            info("skipping \"%s\": not a Python file or an AppVar",
+                 job->entry.name);
+            tar_entry_free(&job->entry);
+            free(job);
+            continue;
+        }
+        stats_bytes(job->entry.len, 0);
+
+        char buf[VAR_NAME_SZ + 1];
+        const char* wanted = wanted_var_name(job->entry.name, buf);
+        job->opts = default_opts;
+        if (wanted) {
+            name_set_allocate(&tar_names, wanted, job->var_name);
+            report_var_name(job->entry.name, job->var_name, wanted);
+            job->opts.var_name = job->var_name;
+            reserve_part_names(&tar_names, job->var_name, job->entry.len,
+                               &job->opts);
+        }
+
+        job->seq = seq++;
+        if (!queue_push(&tar_in_q, job)) {
+            tar_entry_free(&job->entry);
+            free(job->opts.part_names);
+            free(job);
+            break;
+        }
     }
 
-    as_free(&in_file);
+    queue_close(&tar_in_q);
+    return NULL;
+}
+
+// converts an entry in place: its name and data are replaced by the output's
+static void convert_tar_entry(Tar_Job* job) {
+    Tar_Entry* e = &job->entry;
+    trace_set_file(e->name);
+    u64 start = phase_begin();
+
+    char* out = NULL;
+    usize out_len = 0;
+    char out_name[PATH_MAX];
+    Ti_PyFile pyfile = ti_pyfile_new_invalid();
+
+    switch (detect_format(e->name, e->data, e->len)) {
+        case FMT_PY: {
+            out_len = dump_py(e->name, e->data, e->len, &job->opts, &pyfile,
+                              &out, &job->parts, &job->nparts);
+            job->ok = out_len && get_appvar_file_name(&pyfile, e->name,
+                                                      out_name,
+                                                      sizeof(out_name));
+        } break;
+        case FMT_APPVAR: {
+            pyfile = parse_appvar(e->name, e->data, e->len);
+            if (!ti_pyfile_valid(&pyfile))
+                break;
+            // take the source over from the file
+            out = (char*)pyfile.src;
+            out_len = pyfile.src_len;
+            pyfile.src = NULL;
+            job->ok = get_python_file_name(&pyfile, e->name, out_name,
+                                           sizeof(out_name));
+        } break;
+        default: {
+            warn("skipping \"%s\": unknown file format", e->name);
+            job->skipped = true;
+        } break;
+    }
+    ti_pyfile_free(&pyfile);
+
+    if (!job->ok && out) {
+        warn("output name for \"%s\" is too long", e->name);
+        free(out);
+    }
+
+    if (job->ok) {
+        // keep the directory of the input entry
+        const char* slash = strrchr(e->name, '/');
+        usize dir_len = slash ? (usize)(slash - e->name) + 1 : 0;
+        usize name_len = strlen(out_name);
+        char* name = calloc(dir_len + name_len + 1, 1);
+        check_alloc(name);
+        memcpy(name, e->name, dir_len);
+        memcpy(&name[dir_len], out_name, name_len);
+
+        tar_entry_free(e);
+        e->name = name;
+        e->data = out;
+        e->len = out_len;
+    }
+
+    if (!job->skipped)
+        stats_file_done(start, job->ok);
+    if (trace_enabled)
+        trace_span("convert", start, stats_now());
+}
+
+static void* tar_converter(void* arg) {
+    (void)arg;
+
+    Tar_Job* job;
+    while ((job = queue_pop(&tar_in_q))) {
+        convert_tar_entry(job);
+        queue_push(&tar_out_q, job);
+    }
+
+    // the last converter out closes the door
+    if (atomic_fetch_sub(&tar_converters, 1) == 1)
+        queue_close(&tar_out_q);
+    return NULL;
+}
+
+// writes the parts of a split entry, into the directory of the entry
+static bool tar_write_parts(FILE* fp, const Tar_Job* j) {
+    const char* slash = strrchr(j->entry.name, '/');
+    int dir_len = slash ? (int)(slash - j->entry.name) + 1 : 0;
+    for (usize i = 0; i < j->nparts; i++) {
+        const Split_Part* sp = &j->parts[i];
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "%.*s%s.8xv", dir_len, j->entry.name,
+                 sp->var_name);
+        Tar_Entry e = {
+            .name = name,
+            .data = sp->data,
+            .len = sp->len,
+            .mtime = j->entry.mtime,
+        };
+        if (!tar_write_entry(fp, &e))
+            return false;
+        stats_bytes(0, sp->len);
+        _info("wrote \"%s\"", name);
+    }
     return true;
 }
 
+// writes the converted entries in input order. Returns false on write errors.
+static bool tar_writer(FILE* fp) {
+    bool ok = true;
+    usize next = 0;
+    Tar_Job** pending = NULL;
+    usize pending_len = 0;
+    usize pending_cap = 0;
+
+    Tar_Job* job;
+    while ((job = queue_pop(&tar_out_q))) {
+        if (pending_len + 1 > pending_cap) {
+            pending_cap = pending_cap ? pending_cap * 2 : 16;
+            pending = realloc(pending, pending_cap * sizeof(Tar_Job*));
+            check_alloc(pending);
+        }
+        pending[pending_len++] = job;
+
+        // flush everything that is next in line
+        for (usize i = 0; i < pending_len;) {
+            Tar_Job* j = pending[i];
+            if (j->seq != next) {
+                i++;
+                continue;
+            }
+
+            if (j->ok && ok) {
+                trace_set_file(j->entry.name);
+                u64 t = phase_begin();
+                if (!tar_write_parts(fp, j) ||
+                    !tar_write_entry(fp, &j->entry)) {
+                    warn("could not write to the output tar stream: \"%s\"",
+                         strerror(errno));
+                    ok = false;
+                }
+                phase_end(STATS_WRITE, t);
+                stats_bytes(0, j->entry.len);
+                _info("wrote \"%s\"", j->entry.name);
+            }
+            if (!j->ok && !j->skipped)
+                atomic_fetch_add(&failed_inputs, 1);
+
+            tar_entry_free(&j->entry);
+            split_parts_free(j->parts, j->nparts);
+            free(j->opts.part_names);
+            free(j);
+            pending[i] = pending[--pending_len];
+            next++;
+            i = 0;
+        }
+    }
+
+    free(pending);
+    return ok;
+}
+
+bool convert_tar(void) {
+    FILE* in_fp = is_stdio(args.tar_in.data) ? stdin
+                                              : fopen(args.tar_in.data, "rb");
+    if (!in_fp) {
+        warn("could not open \"%s\": \"%s\"", args.tar_in.data,
+             strerror(errno));
+        return false;
+    }
+
+    // a tar file is written like any other output: to a temporary file first
+    char tmp[PATH_MAX] = {0};
+    FILE* out_fp = stdout;
+    if (!is_stdio(args.tar_out.data)) {
+        int fd = open_output(args.tar_out.data, tmp, sizeof(tmp));
+        out_fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        if (fd >= 0 && !out_fp) {
+            close(fd);
+            if (tmp[0])
+                unlinkat(out_dirfd, tmp, 0);
+        }
+    }
+    if (!out_fp) {
+        warn("could not open \"%s\" for writing: \"%s\"", args.tar_out.data,
+             strerror(errno));
+        if (in_fp != stdin)
+            fclose(in_fp);
+        return false;
+    }
+
+    tar_in_q = queue_new(TAR_QUEUE_SZ);
+    tar_out_q = queue_new(TAR_QUEUE_SZ);
+    tar_names = name_set_new(0);
+    atomic_store(&tar_converters, args.jobs);
+
+    pthread_t reader;
+    pthread_t* converters = calloc(args.jobs, sizeof(pthread_t));
+    check_alloc(converters);
+    if (pthread_create(&reader, NULL, tar_reader, in_fp) != 0)
+        panic("could not start the tar reader thread");
+    for (usize i = 0; i < args.jobs; i++) {
+        if (pthread_create(&converters[i], NULL, tar_converter, NULL) != 0)
+            panic("could not start a converter thread");
+    }
+
+    bool ok = tar_writer(out_fp);
+
+    pthread_join(reader, NULL);
+    for (usize i = 0; i < args.jobs; i++)
+        pthread_join(converters[i], NULL);
+    free(converters);
+    queue_free(&tar_in_q);
+    queue_free(&tar_out_q);
+    name_set_free(&tar_names);
+
+    if (ok && !tar_write_end(out_fp))
+        ok = false;
+    // devices and FIFOs written in place have no temporary file
+    if (ok && args.durable && tmp[0] &&
+        (fflush(out_fp) != 0 || fsync(fileno(out_fp)) != 0))
+        ok = false;
+    if (!close_output(out_fp)) {
+        warn("could not finish writing \"%s\"", args.tar_out.data);
+        ok = false;
+    }
+    if (tmp[0]) {
+        if (ok)
+            ok = commit_output(tmp, args.tar_out.data);
+        else
+            unlinkat(out_dirfd, tmp, 0);
+    }
+    if (in_fp != stdin)
+        fclose(in_fp);
+
+    return ok && !atomic_load(&tar_read_failed) &&
+           atomic_load(&failed_inputs) == 0;
+}
+
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "merge"))
+        return merge_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "mount"))
+        return mount_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "bundle"))
+        return bundle_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "plan"))
+        return plan_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "pack"))
+        return pack_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "unpack"))
+        return unpack_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "get"))
+        return get_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "dedupe"))
+        return dedupe_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "grep"))
+        return grep_main(argc - 1, &argv[1]);
+    if (argc > 1 && !strcmp(argv[1], "diff"))
+        return diff_main(argc - 1, &argv[1]);
+
     if (!parse_args(argc, argv))
         return EXIT_FAILURE;
 
     info(VERSION_TXT);
 
-    Format in_fmt = get_format_from_path(args.in_path.data);
-    Format out_fmt = get_output_format(in_fmt);
+    stats_enabled = args.stats;
+    u64 start = stats_now();
 
-    if (in_fmt == FMT_INVALID)
-        fatal("unknown input file format");
+    if (args.journal.len != 0 && !journal_open(args.journal.data))
+        fatal("could not open journal \"%s\": %s", args.journal.data,
+              strerror(errno));
+    if (args.results.len != 0 && !results_open(args.results.data))
+        fatal("could not open results file \"%s\": %s", args.results.data,
+              strerror(errno));
+    if (args.heap_report.len != 0 && !heap_report_open(args.heap_report.data))
+        fatal("could not open heap report \"%s\": %s", args.heap_report.data,
+              strerror(errno));
 
-    if (out_fmt == FMT_INVALID)
-        fatal("unknown output file format");
+    bool ok;
+    if (args.watch.len != 0)
+        ok = watch_dir();
+    else if (args.tar_in.len != 0)
+        ok = convert_tar();
+    else if (args.io == IO_URING)
+        ok = convert_all_uring();
+    else if (args.io == IO_PIPELINE)
+        ok = convert_pipeline();
+    else
+        ok = convert_all();
 
-    if (in_fmt == out_fmt) {
-        warn("input and output formats are the same, no conversion done");
-        return EXIT_FAILURE;
+    if (!journal_close()) {
+        warn("the journal \"%s\" is incomplete", args.journal.data);
+        ok = false;
+    }
+    if (!results_close()) {
+        warn("could not write results to \"%s\"", args.results.data);
+        ok = false;
+    }
+    if (!heap_report_close()) {
+        warn("could not write the heap report to \"%s\"",
+             args.heap_report.data);
+        ok = false;
     }
 
-    if (!convert(in_fmt)) {
-        fatal("error occurred during conversion!");
+    if (args.minify) {
+        usize saved = atomic_load(&minify_saved);
+        usize total = atomic_load(&minify_total);
+        info("minify: saved %zu of %zu bytes (%.1f%%)", saved, total,
+             total ? 100.0 * (double)saved / (double)total : 0.0);
     }
 
+    if (args.heap_limit) {
+        usize over = atomic_load(&heap_over);
+        if (over)
+            info("heap: %zu of %zu script(s) may not fit in %zu bytes", over,
+                 atomic_load(&heap_checked), args.heap_limit);
+    }
+
+    if (args.stats) {
+        stats_report(stderr, args.stats_fmt, stats_now() - start);
+        stats_free();
+    }
+
+    if (!ok) {
+        if (args.in_paths_len > 1)
+            fatal("error occurred during conversion of %zu file(s)!",
+                  atomic_load(&failed_inputs));
+        else
+            fatal("error occurred during conversion!");
+    }
+
+    if (out_dirfd != AT_FDCWD)
+        close(out_dirfd);
+    if (name_map_fp && name_map_fp != stdout)
+        fclose(name_map_fp);
+    if (manifest.len != 0) {
+        free(args.in_paths);
+        manifest_free(&manifest);
+    }
+    for (usize i = 0; i < args.in_paths_len; i++)
+        free(in_opts[i].part_names);
+    free(in_opts);
+    free(var_names);
     args_deinit(&args);
     return EXIT_SUCCESS;
 }
@@ -23,6 +23,11 @@
 
 #define VAR_NAME_SZ  8
 #define FILE_INFO_SZ 42
+// bytes needed to locate the source in an AppVar, see `ti_pyfile_locate_src`
+#define TI_HEADER_SZ 0x50
+// the longest source whose AppVar sizes still fit in their 16-bit fields, less
+// the length of the file name (and 2) if there is one
+#define TI_MAX_SRC_SZ (0xffff - 24)
 
 typedef struct {
     // python source code (null terminated)
@@ -150,17 +155,83 @@ bool ti_pyfile_valid(const Ti_PyFile* f);
 void ti_pyfile_free(Ti_PyFile* f);
 
 /**
- * Checks if a buffer is a TI AppVar.
+ * Computes the checksum of a dumped AppVar, i.e. the 16-bit sum of every byte
+ * from the start of the data section up to (excluding) `len`.
  *
- * Assumes that data is longer than 11 bytes.
+ * @param data dumped AppVar
+ * @param len length of the checksummed region
+ * @return the checksum
+ */
+u16 ti_pyfile_checksum(const char* data, usize len);
+
+/**
+ * Verifies the checksum trailer of a dumped AppVar.
+ *
+ * Checksums written by tipyconv 0.1.1 and earlier, which summed bytes as
+ * signed chars, are accepted as well.
+ *
+ * @param data dumped AppVar, including the trailer
+ * @param len length of the buffer
+ * @return true if the trailer matches the data
+ */
+bool ti_pyfile_checksum_valid(const char* data, usize len);
+
+/**
+ * Checks if a buffer is a TI AppVar, by its `**TI83F*` signature.
  *
  * @param data buffer
+ * @param len length of the buffer
  * @return true if the buffer's header is that of an AppVar.
  */
-bool ti_is_appvar(const char* data);
+bool ti_is_appvar(const char* data, usize len);
+
+/**
+ * Finds the Python source within an AppVar from its header alone, without
+ * reading (or verifying) the rest of it.
+ *
+ * @param header the start of the AppVar
+ * @param len length of `header`, should be at least `TI_HEADER_SZ`
+ * @param offset the offset of the source within the AppVar
+ * @param src_len the length of the source
+ * @return false if `header` is not that of a Python AppVar
+ */
+bool ti_pyfile_locate_src(const char* header, usize len, usize* offset,
+                          u16* src_len);
+
+/**
+ * Computes the length of a dumped AppVar without dumping it.
+ *
+ * @param src_len source code length
+ * @param file_name_len file name length, 0 if there is none
+ * @return the length `ti_pyfile_dump` would return
+ */
+usize ti_pyfile_dump_size(usize src_len, u8 file_name_len);
+
+/**
+ * Computes the size of an AppVar's data on the calculator, which is its
+ * payload and the size word before it.
+ *
+ * @param src_len source code length
+ * @param file_name_len file name length, 0 if there is none
+ * @return the size of the data
+ */
+usize ti_pyfile_data_size(usize src_len, u8 file_name_len);
 
 #ifdef _TIPYCONV_IMPLEMENTATION
 
+// allocator and instrumentation hooks. Define these before including the
+// implementation to override them.
+#ifndef TI_CALLOC
+#define TI_CALLOC(n, sz) calloc(n, sz)
+#endif
+#ifndef TI_REALLOC
+#define TI_REALLOC(p, sz) realloc(p, sz)
+#endif
+#ifndef TI_PHASE_BEGIN
+#define TI_PHASE_BEGIN(phase)
+#define TI_PHASE_END(phase)
+#endif
+
 #define BSWORD(w) ((u8[]){(u8)w, (u8)(w >> 8)})
 
 // NOTE: since this aims to be a single-header library with no dependencies, but
@@ -172,7 +243,7 @@ typedef struct {
 } _v_u8;
 static _v_u8 _v_u8_with_capacity(size_t cap) {
     _v_u8 res = {.len = 0, .cap = cap};
-    res.data = calloc(res.cap, sizeof(u8));
+    res.data = TI_CALLOC(res.cap, sizeof(u8));
     check_alloc(res.data);
     return res;
 }
@@ -189,7 +260,7 @@ static void _v_u8_reserve(_v_u8* v, size_t cap) {
     if (!_v_u8_valid(v)) {
         panic("the vector is invalid");
     }
-    v->data = realloc(v->data, sizeof(u8) * cap);
+    v->data = TI_REALLOC(v->data, sizeof(u8) * cap);
     check_alloc(v->data);
     v->cap = cap;
 }
@@ -233,6 +304,8 @@ static void _v_u8_append_slice(_v_u8* v, const u8* data, size_t nitems) {
 
 static const char FILE_HEADER[] = {0x2a, 0x2a, 0x54, 0x49, 0x38, 0x33,
                                    0x46, 0x2a, 0x1a, 0x0a, 0x00};
+// "**TI83F*", the part of the header that identifies the file type
+#define FILE_SIGNATURE_SZ 8
 
 Ti_PyFile ti_pyfile_new(const char* src, usize src_len, const char* var_name) {
     return ti_pyfile_new_with_metadata_full(src, src_len, NULL, 0, NULL,
@@ -264,13 +337,13 @@ Ti_PyFile ti_pyfile_new_with_metadata_full(const char* src, u16 src_len,
     if (!src)
         return ti_pyfile_new_invalid();
 
-    char* a_src = calloc(src_len + 1, 1);
+    char* a_src = TI_CALLOC(src_len + 1, 1);
     check_alloc(a_src);
     strncpy(a_src, src, src_len);
 
     char* a_fname = NULL;
     if (file_name) {
-        a_fname = calloc(file_name_len + 1, 1);
+        a_fname = TI_CALLOC(file_name_len + 1, 1);
         check_alloc(a_fname);
         strncpy(a_fname, file_name, file_name_len);
     }
@@ -311,15 +384,18 @@ static _v_u8 _ti_pyfile_dump_payload(Ti_PyFile* f) {
     return res;
 }
 
-static u16 _ti_pyfile_get_checksum(const char* data, usize len) {
+u16 ti_pyfile_checksum(const char* data, usize len) {
+    TI_PHASE_BEGIN(CHECKSUM);
     u32 sum = 0;
     for (usize i = 0x37; i < len; i++) {
-        sum += data[i];
+        sum += (u8)data[i];
     }
+    TI_PHASE_END(CHECKSUM);
     return (u16)(sum & 0xffff);
 }
 
 usize ti_pyfile_dump(Ti_PyFile* f, char** dest) {
+    TI_PHASE_BEGIN(DUMP);
     // we at least need that much
     _v_u8 res = _v_u8_with_capacity(81);
     if (!_v_u8_valid(&res))
@@ -362,8 +438,10 @@ usize ti_pyfile_dump(Ti_PyFile* f, char** dest) {
     _v_u8_append_slice(&res, BSWORD(psize), 2);
     _v_u8_append_vector(&res, &payload);
 
+    TI_PHASE_END(DUMP);
+
     // checksum
-    u16 checksum = _ti_pyfile_get_checksum((char*)res.data, res.len);
+    u16 checksum = ti_pyfile_checksum((char*)res.data, res.len);
     _v_u8_append_slice(&res, BSWORD(checksum), 2);
 
     _v_u8_free(&payload);
@@ -423,7 +501,7 @@ Ti_PyFile ti_pyfile_parse(char* data, Ti_ParseResult* pres) {
     }
 
     // check header
-    if (memcmp(&data[0], FILE_HEADER, 1) != 0) {
+    if (memcmp(&data[0], FILE_HEADER, FILE_SIGNATURE_SZ) != 0) {
         if (pres)
             *pres = TI_INVALID_FORMAT;
         return ti_pyfile_new_invalid();
@@ -443,18 +521,19 @@ Ti_PyFile ti_pyfile_parse(char* data, Ti_ParseResult* pres) {
     if (data[0x4E] != '\0') {
         u8 file_name_len = data[0x4E];
         // 0x4F is SOH, can ignore
-        file_name = calloc(file_name_len + 1, 1);
+        file_name = TI_CALLOC(file_name_len + 1, 1);
         check_alloc(file_name);
         // should stop at nullterm in stream anyway
         strncpy(file_name, &data[0x50], file_name_len);
-        src_start = 0x50 + file_name_len; // payload should start later
-        src_len -= 1 + file_name_len;
+        // the name is null terminated as well, payload starts after that
+        src_start = 0x51 + file_name_len;
+        src_len -= 2 + file_name_len;
 
         res.file_name = file_name;
         res.file_name_len = file_name_len;
     }
 
-    char* src = calloc(src_len + 1, 1);
+    char* src = TI_CALLOC(src_len + 1, 1);
     check_alloc(src);
     strncpy(src, &data[src_start], src_len);
 
@@ -468,7 +547,8 @@ Ti_PyFile ti_pyfile_parse(char* data, Ti_ParseResult* pres) {
 }
 
 bool ti_pyfile_valid(const Ti_PyFile* f) {
-    return !memcmp(f, &(Ti_PyFile){0}, sizeof(Ti_PyFile));
+    // every valid file has (possibly empty) source
+    return f->src != NULL;
 }
 
 void ti_pyfile_free(Ti_PyFile* f) {
@@ -478,8 +558,57 @@ void ti_pyfile_free(Ti_PyFile* f) {
         free((void*)f->src);
 }
 
-bool ti_is_appvar(const char* data) {
-    return (memcmp(data, FILE_HEADER, 1) != 0);
+bool ti_pyfile_checksum_valid(const char* data, usize len) {
+    // header, data section and trailer
+    if (len < 0x37 + 2)
+        return false;
+
+    u16 expected = _ti_pyfile_get_word((char*)&data[len - 2]);
+    if (ti_pyfile_checksum(data, len - 2) == expected)
+        return true;
+
+    // legacy (signed) checksum
+    int sum = 0;
+    for (usize i = 0x37; i < len - 2; i++)
+        sum += (signed char)data[i];
+    return (u16)(sum & 0xffff) == expected;
+}
+
+bool ti_is_appvar(const char* data, usize len) {
+    if (len < FILE_SIGNATURE_SZ)
+        return false;
+    return memcmp(data, FILE_HEADER, FILE_SIGNATURE_SZ) == 0;
+}
+
+bool ti_pyfile_locate_src(const char* header, usize len, usize* offset,
+                          u16* src_len) {
+    if (len < TI_HEADER_SZ || !ti_is_appvar(header, len))
+        return false;
+    if (memcmp(&header[0x4A], "PYCD", 4) != 0)
+        return false;
+
+    // same layout as in ti_pyfile_parse: SOH, the name and its terminator
+    u16 psize = _ti_pyfile_get_word((char*)&header[0x48]);
+    u8 file_name_len = (u8)header[0x4E];
+    usize skip = file_name_len ? 2 + file_name_len : 0;
+    if (psize < 5 + skip)
+        return false;
+
+    *offset = 0x4F + skip;
+    *src_len = (u16)(psize - 5 - skip);
+    return true;
+}
+
+usize ti_pyfile_dump_size(usize src_len, u8 file_name_len) {
+    // headers, "PYCD", the file name (with its length and SOH) and the
+    // checksum trailer
+    usize payload = 5 + src_len + (file_name_len ? 2 + file_name_len : 0);
+    return 0x4A + payload + 2;
+}
+
+usize ti_pyfile_data_size(usize src_len, u8 file_name_len) {
+    // the dump without its header and checksum trailer
+    return ti_pyfile_dump_size(src_len, file_name_len) - 0x48 - 2;
 }
 
 #endif // _TIPYCONV_IMPLEMENTATION
@@ -0,0 +1,177 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _GNU_SOURCE
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "stats.h"
+#include "trace.h"
+
+#define TRACE_RING_SZ  8192
+#define TRACE_FILE_SZ  64
+
+typedef struct {
+    const char* name;
+    u64 start;
+    u64 end;
+    // tail of the input path (null terminated)
+    char file[TRACE_FILE_SZ];
+} Trace_Event;
+
+// one ring per thread, written only by its owner. Linked together with a
+// lock-free push so that the flush can find them.
+typedef struct Trace_Thread {
+    Trace_Event* ring;
+    // total number of events ever recorded; the ring holds the last
+    // TRACE_RING_SZ of them
+    u64 count;
+    pid_t tid;
+    usize index;
+    char file[TRACE_FILE_SZ];
+    struct Trace_Thread* next;
+} Trace_Thread;
+
+bool trace_enabled = false;
+
+static char* trace_path = NULL;
+static u64 trace_epoch = 0;
+static atomic_size_t nthreads = 0;
+static _Atomic(Trace_Thread*) threads = NULL;
+static _Thread_local Trace_Thread* local = NULL;
+
+static Trace_Thread* trace_local(void) {
+    if (local)
+        return local;
+
+    local = calloc(1, sizeof(Trace_Thread));
+    check_alloc(local);
+    local->ring = calloc(TRACE_RING_SZ, sizeof(Trace_Event));
+    check_alloc(local->ring);
+    local->tid = (pid_t)syscall(SYS_gettid);
+    local->index = atomic_fetch_add(&nthreads, 1);
+
+    Trace_Thread* head = atomic_load_explicit(&threads, memory_order_relaxed);
+    do {
+        local->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &threads, &head, local, memory_order_release, memory_order_relaxed));
+
+    return local;
+}
+
+bool trace_init(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        return false;
+    fclose(fp);
+
+    trace_path = strdup(path);
+    check_alloc(trace_path);
+    trace_epoch = stats_now();
+    trace_enabled = true;
+    atexit(trace_flush);
+    return true;
+}
+
+void trace_set_file(const char* path) {
+    if (!trace_enabled)
+        return;
+
+    Trace_Thread* t = trace_local();
+    if (!path) {
+        t->file[0] = '\0';
+        return;
+    }
+
+    // keep the end of long paths, that's where the file name is
+    usize len = strlen(path);
+    if (len >= TRACE_FILE_SZ)
+        path += len - (TRACE_FILE_SZ - 1);
+    strncpy(t->file, path, TRACE_FILE_SZ - 1);
+    t->file[TRACE_FILE_SZ - 1] = '\0';
+}
+
+void trace_span(const char* name, u64 start, u64 end) {
+    if (!trace_enabled)
+        return;
+
+    Trace_Thread* t = trace_local();
+    Trace_Event* ev = &t->ring[t->count % TRACE_RING_SZ];
+    ev->name = name;
+    ev->start = start;
+    ev->end = end;
+    memcpy(ev->file, t->file, TRACE_FILE_SZ);
+    t->count++;
+}
+
+void trace_flush(void) {
+    if (!trace_enabled)
+        return;
+    trace_enabled = false;
+
+    FILE* fp = fopen(trace_path, "w");
+    if (!fp) {
+        warn("could not write trace to \"%s\"", trace_path);
+        return;
+    }
+
+    pid_t pid = getpid();
+    u64 dropped = 0;
+    bool first = true;
+
+    fputs("{\"traceEvents\":[\n", fp);
+    Trace_Thread* t = atomic_exchange(&threads, NULL);
+    while (t) {
+        fprintf(fp,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"worker %zu\"}}",
+                first ? "" : ",\n", (int)pid, (int)t->tid, t->index);
+        first = false;
+
+        u64 begin = 0;
+        if (t->count > TRACE_RING_SZ) {
+            begin = t->count - TRACE_RING_SZ;
+            dropped += begin;
+        }
+
+        for (u64 i = begin; i < t->count; i++) {
+            const Trace_Event* ev = &t->ring[i % TRACE_RING_SZ];
+            fprintf(fp,
+                    ",\n{\"name\":\"%s\",\"cat\":\"tipyconv\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"file\":",
+                    ev->name, (double)(ev->start - trace_epoch) / 1e3,
+                    (double)(ev->end - ev->start) / 1e3, (int)pid,
+                    (int)t->tid);
+            json_write_string(fp, ev->file);
+            fputs("}}", fp);
+        }
+
+        Trace_Thread* next = t->next;
+        free(t->ring);
+        free(t);
+        t = next;
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{"
+                "\"dropped_events\":%llu}}\n",
+            (unsigned long long)dropped);
+
+    fclose(fp);
+    local = NULL;
+    free(trace_path);
+    trace_path = NULL;
+}
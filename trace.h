@@ -0,0 +1,57 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: Chrome trace-event output (`--trace`), viewable in Perfetto
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+// set once before any worker starts, read-only afterwards.
+extern bool trace_enabled;
+
+/**
+ * Enables tracing. The trace is written to `path` when the program exits.
+ *
+ * @param path path of the JSON trace file
+ * @return true on success
+ */
+bool trace_init(const char* path);
+
+/**
+ * Sets the file that the calling thread's subsequent spans belong to.
+ *
+ * @param path the input path, or NULL
+ */
+void trace_set_file(const char* path);
+
+/**
+ * Records a span on the calling thread. Timestamps come from `stats_now`.
+ *
+ * The span goes into the thread's ring buffer; when it is full the oldest
+ * spans are overwritten.
+ *
+ * @param name name of the span, must have static lifetime
+ * @param start start timestamp in nanoseconds
+ * @param end end timestamp in nanoseconds
+ */
+void trace_span(const char* name, u64 start, u64 end);
+
+/**
+ * Writes out every thread's spans. Called at exit; must not race with
+ * workers.
+ */
+void trace_flush(void);
+
+#endif // _TRACE_H
@@ -0,0 +1,291 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_setup(u32 entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, u32 to_submit, u32 min_complete, u32 flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int sys_register(int fd, u32 opcode, void* arg, u32 nargs) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+static bool probe_ops(int fd, const u8* ops, usize nops) {
+    usize sz = sizeof(struct io_uring_probe) +
+               256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, sz);
+    check_alloc(probe);
+
+    bool ok = sys_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (usize i = 0; ok && i < nops; i++) {
+        ok = ops[i] <= probe->last_op &&
+             (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    return ok;
+}
+
+bool uring_init(Uring* r, u32 entries, const u8* ops, usize nops) {
+    memset(r, 0, sizeof(Uring));
+    r->fd = -1;
+
+    struct io_uring_params p = {0};
+    int fd = sys_setup(entries, &p);
+    if (fd < 0)
+        return false;
+    r->fd = fd;
+    r->entries = p.sq_entries;
+
+    if (!probe_ops(fd, ops, nops))
+        goto fail;
+
+    r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(u32);
+    r->cq_ring_sz =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_sz > r->sq_ring_sz)
+            r->sq_ring_sz = r->cq_ring_sz;
+        r->cq_ring_sz = r->sq_ring_sz;
+    }
+
+    r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        r->sq_ring = NULL;
+        goto fail;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            r->cq_ring = NULL;
+            goto fail;
+        }
+    }
+
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    u8* sq = r->sq_ring;
+    r->sq_head = (u32*)(sq + p.sq_off.head);
+    r->sq_tail = (u32*)(sq + p.sq_off.tail);
+    r->sq_mask = (u32*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (u32*)(sq + p.sq_off.array);
+    r->sq_local_tail = *r->sq_tail;
+
+    u8* cq = r->cq_ring;
+    r->cq_head = (u32*)(cq + p.cq_off.head);
+    r->cq_tail = (u32*)(cq + p.cq_off.tail);
+    r->cq_mask = (u32*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    return true;
+
+fail:
+    uring_free(r);
+    return false;
+}
+
+struct io_uring_sqe* uring_get_sqe(Uring* r) {
+    u32 head = atomic_load_explicit((_Atomic u32*)r->sq_head,
+                                    memory_order_acquire);
+    if (r->sq_local_tail - head >= r->entries)
+        return NULL;
+
+    u32 idx = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+void uring_prep_openat(struct io_uring_sqe* sqe, int dirfd, const char* path,
+                       int flags, u32 mode, u64 user_data) {
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dirfd;
+    sqe->addr = (u64)(uintptr_t)path;
+    sqe->len = mode;
+    sqe->open_flags = (u32)flags;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_read(struct io_uring_sqe* sqe, int fd, void* buf, u32 len,
+                     u64 offset, u64 user_data) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (u64)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_write(struct io_uring_sqe* sqe, int fd, const void* buf,
+                      u32 len, u64 offset, u64 user_data) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (u64)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_renameat(struct io_uring_sqe* sqe, int old_dirfd,
+                         const char* old_path, int new_dirfd,
+                         const char* new_path, u32 flags, u64 user_data) {
+    sqe->opcode = IORING_OP_RENAMEAT;
+    sqe->fd = old_dirfd;
+    sqe->addr = (u64)(uintptr_t)old_path;
+    sqe->len = (u32)new_dirfd;
+    sqe->addr2 = (u64)(uintptr_t)new_path;
+    sqe->rename_flags = flags;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_close(struct io_uring_sqe* sqe, int fd, u64 user_data) {
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+}
+
+int uring_submit_and_wait(Uring* r, u32 wait_nr) {
+    u32 tail = *r->sq_tail;
+    u32 to_submit = r->sq_local_tail - tail;
+    atomic_store_explicit((_Atomic u32*)r->sq_tail, r->sq_local_tail,
+                          memory_order_release);
+
+    u32 flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    int res;
+    do {
+        res = sys_enter(r->fd, to_submit, wait_nr, flags);
+    } while (res < 0 && errno == EINTR);
+
+    return res < 0 ? -errno : res;
+}
+
+struct io_uring_cqe* uring_peek_cqe(Uring* r) {
+    u32 head = *r->cq_head;
+    u32 tail = atomic_load_explicit((_Atomic u32*)r->cq_tail,
+                                    memory_order_acquire);
+    if (head == tail)
+        return NULL;
+    return &r->cqes[head & *r->cq_mask];
+}
+
+void uring_cqe_seen(Uring* r) {
+    atomic_store_explicit((_Atomic u32*)r->cq_head, *r->cq_head + 1,
+                          memory_order_release);
+}
+
+void uring_free(Uring* r) {
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_sz);
+    if (r->cq_ring && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_sz);
+    if (r->sq_ring)
+        munmap(r->sq_ring, r->sq_ring_sz);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(Uring));
+    r->fd = -1;
+}
+
+#else // HAVE_IO_URING
+
+bool uring_init(Uring* r, u32 entries, const u8* ops, usize nops) {
+    (void)entries;
+    (void)ops;
+    (void)nops;
+    memset(r, 0, sizeof(Uring));
+    r->fd = -1;
+    return false;
+}
+
+struct io_uring_sqe* uring_get_sqe(Uring* r) {
+    (void)r;
+    return NULL;
+}
+
+void uring_prep_openat(struct io_uring_sqe* sqe, int dirfd, const char* path,
+                       int flags, u32 mode, u64 user_data) {
+    (void)sqe, (void)dirfd, (void)path, (void)flags, (void)mode;
+    (void)user_data;
+}
+
+void uring_prep_read(struct io_uring_sqe* sqe, int fd, void* buf, u32 len,
+                     u64 offset, u64 user_data) {
+    (void)sqe, (void)fd, (void)buf, (void)len, (void)offset, (void)user_data;
+}
+
+void uring_prep_write(struct io_uring_sqe* sqe, int fd, const void* buf,
+                      u32 len, u64 offset, u64 user_data) {
+    (void)sqe, (void)fd, (void)buf, (void)len, (void)offset, (void)user_data;
+}
+
+void uring_prep_renameat(struct io_uring_sqe* sqe, int old_dirfd,
+                         const char* old_path, int new_dirfd,
+                         const char* new_path, u32 flags, u64 user_data) {
+    (void)sqe, (void)old_dirfd, (void)old_path, (void)new_dirfd;
+    (void)new_path, (void)flags, (void)user_data;
+}
+
+void uring_prep_close(struct io_uring_sqe* sqe, int fd, u64 user_data) {
+    (void)sqe, (void)fd, (void)user_data;
+}
+
+int uring_submit_and_wait(Uring* r, u32 wait_nr) {
+    (void)r;
+    (void)wait_nr;
+    return -ENOSYS;
+}
+
+struct io_uring_cqe* uring_peek_cqe(Uring* r) {
+    (void)r;
+    return NULL;
+}
+
+void uring_cqe_seen(Uring* r) {
+    (void)r;
+}
+
+void uring_free(Uring* r) {
+    (void)r;
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,142 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: minimal io_uring wrapper on top of the raw system calls
+ */
+
+#ifndef _URING_H
+#define _URING_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#else
+// opaque stand-ins, so that callers compile everywhere
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+typedef struct {
+    int fd;
+    u32 entries;
+    // submission ring
+    void* sq_ring;
+    usize sq_ring_sz;
+    u32* sq_head;
+    u32* sq_tail;
+    u32* sq_mask;
+    u32* sq_array;
+    struct io_uring_sqe* sqes;
+    usize sqes_sz;
+    // local tail, published on submit
+    u32 sq_local_tail;
+    // completion ring
+    void* cq_ring;
+    usize cq_ring_sz;
+    u32* cq_head;
+    u32* cq_tail;
+    u32* cq_mask;
+    struct io_uring_cqe* cqes;
+} Uring;
+
+/**
+ * Sets up an io_uring instance.
+ *
+ * Fails if io_uring is not compiled in, not supported by the kernel, blocked
+ * (e.g. by seccomp), or lacks any of the opcodes in `ops`.
+ *
+ * @param r the ring
+ * @param entries number of submission queue entries
+ * @param ops opcodes that must be supported
+ * @param nops number of opcodes
+ * @return true on success
+ */
+bool uring_init(Uring* r, u32 entries, const u8* ops, usize nops);
+
+/**
+ * Gets a zeroed submission queue entry.
+ *
+ * @param r the ring
+ * @return the entry, or NULL if the submission queue is full
+ */
+struct io_uring_sqe* uring_get_sqe(Uring* r);
+
+/**
+ * Prepares an openat(2) request.
+ */
+void uring_prep_openat(struct io_uring_sqe* sqe, int dirfd, const char* path,
+                       int flags, u32 mode, u64 user_data);
+
+/**
+ * Prepares a read(2) request at `offset`.
+ */
+void uring_prep_read(struct io_uring_sqe* sqe, int fd, void* buf, u32 len,
+                     u64 offset, u64 user_data);
+
+/**
+ * Prepares a write(2) request at `offset`.
+ */
+void uring_prep_write(struct io_uring_sqe* sqe, int fd, const void* buf,
+                      u32 len, u64 offset, u64 user_data);
+
+/**
+ * Prepares a renameat2(2) request.
+ */
+void uring_prep_renameat(struct io_uring_sqe* sqe, int old_dirfd,
+                         const char* old_path, int new_dirfd,
+                         const char* new_path, u32 flags, u64 user_data);
+
+/**
+ * Prepares a close(2) request.
+ */
+void uring_prep_close(struct io_uring_sqe* sqe, int fd, u64 user_data);
+
+/**
+ * Submits all queued entries and waits for at least `wait_nr` completions.
+ *
+ * @param r the ring
+ * @param wait_nr number of completions to wait for
+ * @return number of submitted entries, or -errno on error
+ */
+int uring_submit_and_wait(Uring* r, u32 wait_nr);
+
+/**
+ * Gets the next completion without waiting.
+ *
+ * @param r the ring
+ * @return the completion, or NULL if there is none. Must be released with
+ * `uring_cqe_seen`.
+ */
+struct io_uring_cqe* uring_peek_cqe(Uring* r);
+
+/**
+ * Marks the completion returned by `uring_peek_cqe` as consumed.
+ *
+ * @param r the ring
+ */
+void uring_cqe_seen(Uring* r);
+
+/**
+ * Tears down the ring.
+ *
+ * @param r the ring
+ */
+void uring_free(Uring* r);
+
+#endif // _URING_H
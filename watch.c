@@ -0,0 +1,388 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "hash.h"
+#include "stats.h"
+#include "watch.h"
+
+// === maps ===
+
+// 0 marks empty slots
+static u64 map_key(u64 key) {
+    return key ? key : 1;
+}
+
+static Watch_Slot* map_find(Watch_Map* m, u64 key) {
+    usize i = (usize)(key ^ (key >> 29)) & (m->cap - 1);
+    while (m->items[i].key && m->items[i].key != key)
+        i = (i + 1) & (m->cap - 1);
+    return &m->items[i];
+}
+
+static void map_put(Watch_Map* m, u64 key, u64 value);
+
+static void map_grow(Watch_Map* m) {
+    Watch_Map old = *m;
+    m->cap = old.cap ? old.cap * 2 : 64;
+    m->len = 0;
+    m->items = calloc(m->cap, sizeof(Watch_Slot));
+    check_alloc(m->items);
+    for (usize i = 0; i < old.cap; i++) {
+        if (old.items[i].key)
+            map_put(m, old.items[i].key, old.items[i].value);
+    }
+    free(old.items);
+}
+
+static void map_put(Watch_Map* m, u64 key, u64 value) {
+    key = map_key(key);
+    if ((m->len + 1) * 2 > m->cap)
+        map_grow(m);
+
+    Watch_Slot* s = map_find(m, key);
+    if (!s->key) {
+        s->key = key;
+        m->len++;
+    }
+    s->value = value;
+}
+
+static bool map_get(Watch_Map* m, u64 key, u64* value) {
+    if (m->cap == 0)
+        return false;
+
+    Watch_Slot* s = map_find(m, map_key(key));
+    if (!s->key)
+        return false;
+    *value = s->value;
+    return true;
+}
+
+static void map_clear(Watch_Map* m) {
+    if (m->items)
+        memset(m->items, 0, m->cap * sizeof(Watch_Slot));
+    m->len = 0;
+}
+
+static void map_free(Watch_Map* m) {
+    free(m->items);
+    *m = (Watch_Map){0};
+}
+
+static u64 inode_key(const struct stat* st) {
+    return hash_bytes(&st->st_ino, sizeof(st->st_ino),
+                      hash_bytes(&st->st_dev, sizeof(st->st_dev), HASH_SEED));
+}
+
+bool watch_changed(Watch* w, const char* path, u64 hash) {
+    u64 prev;
+    struct stat st;
+    if (stat(path, &st) == 0 && map_get(&w->outputs, inode_key(&st), &prev) &&
+        prev == hash)
+        return false;
+
+    u64 key = hash_str(path);
+    if (map_get(&w->inputs, key, &prev) && prev == hash)
+        return false;
+    map_put(&w->inputs, key, hash);
+    return true;
+}
+
+void watch_note_output(Watch* w, int dirfd, const char* path, u64 hash) {
+    struct stat st;
+    if (fstatat(dirfd, path, &st, 0) == 0)
+        map_put(&w->outputs, inode_key(&st), hash);
+}
+
+#ifdef __linux__
+
+// hidden files, including the temporary files of editors (and of tipyconv)
+static bool ignored(const char* name) {
+    return name[0] == '.';
+}
+
+static char* join_path(const char* dir, const char* name) {
+    usize dir_len = strlen(dir);
+    usize name_len = strlen(name);
+    char* path = malloc(dir_len + name_len + 2);
+    check_alloc(path);
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(&path[dir_len + 1], name, name_len + 1);
+    return path;
+}
+
+// calls `fn` for every file in a directory tree
+static void scan_tree(const char* dir, Watch_Fn fn, void* ctx) {
+    DIR* d = opendir(dir);
+    if (!d)
+        return;
+
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        if (ignored(ent->d_name))
+            continue;
+
+        char* path = join_path(dir, ent->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode))
+                scan_tree(path, fn, ctx);
+            else if (S_ISREG(st.st_mode))
+                fn(path, ctx);
+        }
+        free(path);
+    }
+    closedir(d);
+}
+
+#define WATCH_MASK                                                             \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+// watches a directory and everything below it
+static bool add_tree(Watch* w, const char* dir) {
+    int wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+    if (wd < 0)
+        return false;
+
+    if ((usize)wd >= w->dirs_cap) {
+        usize cap = w->dirs_cap ? w->dirs_cap : 16;
+        while (cap <= (usize)wd)
+            cap *= 2;
+        w->dirs = realloc(w->dirs, cap * sizeof(char*));
+        check_alloc(w->dirs);
+        memset(&w->dirs[w->dirs_cap], 0, (cap - w->dirs_cap) * sizeof(char*));
+        w->dirs_cap = cap;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(dir);
+    check_alloc(w->dirs[wd]);
+
+    DIR* d = opendir(dir);
+    if (!d)
+        return true;
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        if (ignored(ent->d_name))
+            continue;
+        char* path = join_path(dir, ent->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode) && !add_tree(w, path))
+            warn("could not watch \"%s\": %s", path, strerror(errno));
+        free(path);
+    }
+    closedir(d);
+    return true;
+}
+
+bool watch_init(Watch* w, const char* dir, u32 debounce_ms) {
+    *w = (Watch){.debounce_ns = (u64)debounce_ms * 1000000ull};
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0)
+        return false;
+    if (!add_tree(w, dir)) {
+        watch_free(w);
+        return false;
+    }
+    return true;
+}
+
+// calls `fn` for every file in the watched directories
+static void watch_scan(Watch* w, Watch_Fn fn, void* ctx) {
+    for (usize i = 0; i < w->dirs_cap; i++) {
+        // subdirectories are watched (and scanned) on their own
+        if (!w->dirs[i])
+            continue;
+        DIR* d = opendir(w->dirs[i]);
+        if (!d)
+            continue;
+        struct dirent* ent;
+        while ((ent = readdir(d))) {
+            if (ignored(ent->d_name))
+                continue;
+            char* path = join_path(w->dirs[i], ent->d_name);
+            struct stat st;
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+                fn(path, ctx);
+            free(path);
+        }
+        closedir(d);
+    }
+}
+
+// (re)starts the debounce window of a file. Takes `path` over.
+static void touch(Watch* w, char* path) {
+    u64 deadline = stats_now() + w->debounce_ns;
+    u64 key = hash_str(path);
+    u64 idx;
+    if (map_get(&w->pending_idx, key, &idx) &&
+        !strcmp(w->pending[idx].path, path)) {
+        w->pending[idx].deadline = deadline;
+        free(path);
+        return;
+    }
+
+    if (w->pending_len + 1 > w->pending_cap) {
+        w->pending_cap = w->pending_cap ? w->pending_cap * 2 : 16;
+        w->pending =
+            realloc(w->pending, w->pending_cap * sizeof(Watch_Pending));
+        check_alloc(w->pending);
+    }
+    w->pending[w->pending_len] = (Watch_Pending){path, deadline};
+    map_put(&w->pending_idx, key, w->pending_len);
+    w->pending_len++;
+}
+
+static void touch_cb(const char* path, void* ctx) {
+    char* copy = strdup(path);
+    check_alloc(copy);
+    touch(ctx, copy);
+}
+
+// milliseconds until the earliest deadline, -1 if nothing is pending
+static int next_timeout(const Watch* w) {
+    if (w->pending_len == 0)
+        return -1;
+
+    u64 now = stats_now();
+    u64 first = w->pending[0].deadline;
+    for (usize i = 1; i < w->pending_len; i++) {
+        if (w->pending[i].deadline < first)
+            first = w->pending[i].deadline;
+    }
+    if (first <= now)
+        return 0;
+    // round up, so that the deadline has passed when poll() returns
+    return (int)((first - now + 999999) / 1000000);
+}
+
+static void read_events(Watch* w) {
+    _Alignas(struct inotify_event) char buf[16 * 1024];
+    ssize_t n;
+    while ((n = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // events were lost, look at everything again
+                warn("too many changes at once, rescanning");
+                watch_scan(w, touch_cb, w);
+                continue;
+            }
+            if (ev->wd < 0 || (usize)ev->wd >= w->dirs_cap || !w->dirs[ev->wd])
+                continue;
+            if (ev->mask & IN_IGNORED) {
+                free(w->dirs[ev->wd]);
+                w->dirs[ev->wd] = NULL;
+                continue;
+            }
+            if (ev->len == 0 || ignored(ev->name))
+                continue;
+
+            char* path = join_path(w->dirs[ev->wd], ev->name);
+            if (ev->mask & IN_ISDIR) {
+                // a new directory: watch it, and whatever is already in it
+                if (!add_tree(w, path))
+                    warn("could not watch \"%s\": %s", path, strerror(errno));
+                else
+                    scan_tree(path, touch_cb, w);
+                free(path);
+            } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                touch(w, path);
+            } else {
+                free(path);
+            }
+        }
+    }
+}
+
+bool watch_poll(Watch* w, Watch_Fn fn, void* ctx) {
+    struct pollfd pfd = {.fd = w->fd, .events = POLLIN};
+    int res = poll(&pfd, 1, next_timeout(w));
+    if (res < 0)
+        return errno == EINTR;
+    if (res > 0)
+        read_events(w);
+
+    // report whatever has settled, and keep the rest
+    u64 now = stats_now();
+    usize kept = 0;
+    for (usize i = 0; i < w->pending_len; i++) {
+        Watch_Pending* p = &w->pending[i];
+        if (p->deadline > now) {
+            w->pending[kept++] = *p;
+            continue;
+        }
+        fn(p->path, ctx);
+        free(p->path);
+    }
+    if (kept != w->pending_len) {
+        w->pending_len = kept;
+        map_clear(&w->pending_idx);
+        for (usize i = 0; i < kept; i++)
+            map_put(&w->pending_idx, hash_str(w->pending[i].path), i);
+    }
+    return true;
+}
+
+void watch_free(Watch* w) {
+    if (w->fd >= 0)
+        close(w->fd);
+    for (usize i = 0; i < w->dirs_cap; i++)
+        free(w->dirs[i]);
+    free(w->dirs);
+    for (usize i = 0; i < w->pending_len; i++)
+        free(w->pending[i].path);
+    free(w->pending);
+    map_free(&w->pending_idx);
+    map_free(&w->inputs);
+    map_free(&w->outputs);
+    *w = (Watch){.fd = -1};
+}
+
+#else // __linux__
+
+bool watch_init(Watch* w, const char* dir, u32 debounce_ms) {
+    (void)dir, (void)debounce_ms;
+    *w = (Watch){.fd = -1};
+    errno = ENOSYS;
+    return false;
+}
+
+bool watch_poll(Watch* w, Watch_Fn fn, void* ctx) {
+    (void)w, (void)fn, (void)ctx;
+    return false;
+}
+
+void watch_free(Watch* w) {
+    map_free(&w->inputs);
+    map_free(&w->outputs);
+}
+
+#endif // __linux__
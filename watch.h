@@ -0,0 +1,118 @@
+/*
+ * tipyconv: Tools to convert to and from the TI Python file format.
+ *
+ * Copyright (c) Eason Qin (eason@ezntek.com), 2025.
+ *
+ * This source code form is licensed under the BSD 3-clause License. You may
+ * find the full text of the license in the root of the project directory at
+ * `LICENSE.md`. Alternatively, find an online copy at
+ * https://spdx.org/licenses/BSD-3-Clause.html.
+ *
+ * INFO: directory watching with inotify (`--watch`)
+ */
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include "3rdparty/include/a_common.h"
+
+#include <stdbool.h>
+
+/*
+ * Files are reported once they have been written and closed, or moved into
+ * a watched directory, and then stayed untouched for the debounce window: an
+ * editor that saves through a temporary file, or a burst of saves, results in
+ * a single report. Hidden files (like editor swap files) are ignored.
+ *
+ * Content hashes of the files seen so far are kept, so that saves that don't
+ * change anything can be skipped, as well as the outputs tipyconv writes into
+ * a watched directory itself.
+ */
+
+typedef void (*Watch_Fn)(const char* path, void* ctx);
+
+typedef struct {
+    u64 key;
+    u64 value;
+} Watch_Slot;
+
+// an open addressing map from u64 keys to u64 values
+typedef struct {
+    Watch_Slot* items;
+    usize cap;
+    usize len;
+} Watch_Map;
+
+typedef struct {
+    char* path;
+    u64 deadline;
+} Watch_Pending;
+
+typedef struct {
+    int fd;
+    // watch descriptor -> directory path
+    char** dirs;
+    usize dirs_cap;
+    u64 debounce_ns;
+    // files waiting for the debounce window to pass
+    Watch_Pending* pending;
+    usize pending_len;
+    usize pending_cap;
+    // path hash -> index into `pending`
+    Watch_Map pending_idx;
+    // path hash -> content hash of inputs
+    Watch_Map inputs;
+    // device and inode -> content hash of outputs
+    Watch_Map outputs;
+} Watch;
+
+/**
+ * Starts watching a directory and its subdirectories.
+ *
+ * @param w the watcher
+ * @param dir the directory
+ * @param debounce_ms how long a file must stay untouched before it is reported
+ * @return false if inotify is unavailable, or the directory can't be watched
+ */
+bool watch_init(Watch* w, const char* dir, u32 debounce_ms);
+
+/**
+ * Waits for changes, and reports the files whose debounce window has passed.
+ *
+ * @param w the watcher
+ * @param fn called with the path of each changed file
+ * @param ctx passed to `fn`
+ * @return false on errors. Interruptions by signals are not errors.
+ */
+bool watch_poll(Watch* w, Watch_Fn fn, void* ctx);
+
+/**
+ * Records the content hash of a file, and tells whether it changed since the
+ * last time.
+ *
+ * @param w the watcher
+ * @param path the path of the file
+ * @param hash the hash of its contents
+ * @return false if the file is an output written by `watch_note_output`, or
+ * had the same contents the last time
+ */
+bool watch_changed(Watch* w, const char* path, u64 hash);
+
+/**
+ * Records an output, so that its own change event is ignored.
+ *
+ * @param w the watcher
+ * @param dirfd the directory `path` is relative to
+ * @param path the path of the output
+ * @param hash the hash of its contents
+ */
+void watch_note_output(Watch* w, int dirfd, const char* path, u64 hash);
+
+/**
+ * Stops watching.
+ *
+ * @param w the watcher
+ */
+void watch_free(Watch* w);
+
+#endif // _WATCH_H